@@ -316,6 +316,21 @@ void DbfColContainer::GetVec(std::vector<double>& vec)
 	}
 }
 
+void DbfColContainer::GetVec(int first, int count, std::vector<double>& vec)
+{
+	if (GetType() != GdaConst::double_type &&
+		GetType() != GdaConst::long64_type) return;
+	if (!IsVecDataAlloc() && IsRawDataAlloc()) CopyRawDataToVector();
+	if (vec.size() != (size_t) count) vec.resize(count);
+	if (!IsVecDataAlloc()) {
+		std::fill(vec.begin(), vec.end(), 0);
+	} else if (GetType() == GdaConst::double_type) {
+		for (int i=0; i<count; i++) vec[i] = d_vec[first+i];
+	} else {
+		for (int i=0; i<count; i++) vec[i] = (double) l_vec[first+i];
+	}
+}
+
 // Allow for filling of long64 from double field
 void DbfColContainer::GetVec(std::vector<wxInt64>& vec)
 {
@@ -379,6 +394,33 @@ void DbfColContainer::SetFromVec(const std::vector<double>& vec)
 	UpdateMinMaxVals();
 }
 
+void DbfColContainer::SetFromVec(int first, const std::vector<double>& vec)
+{
+	const int count = vec.size();
+	if (first < 0 || first + count > size) return;
+	if (GetType() != GdaConst::long64_type &&
+		GetType() != GdaConst::double_type) return;
+	// the other rows are kept, so raw data is converted rather than freed
+	CheckUndefined();
+	if (!IsVecDataAlloc() && IsRawDataAlloc()) CopyRawDataToVector();
+	if (!IsVecDataAlloc()) AllocVecData();
+	if (IsRawDataAlloc()) FreeRawData();
+	
+	for (int i=0; i<count; i++) {
+		undefined[first+i] = !boost::math::isfinite<double>(vec[i]);
+	}
+	if (GetType() == GdaConst::long64_type) {
+		for (int i=0; i<count; i++) {
+			l_vec[first+i] = undefined[first+i] ? 0 : (wxInt64) vec[i];
+		}
+	} else { // must be double_type
+		for (int i=0; i<count; i++) {
+			d_vec[first+i] = undefined[first+i] ? 0 : vec[i];
+		}
+	}
+	stale_min_max_val = true;
+}
+
 void DbfColContainer::SetFromVec(const std::vector<wxInt64>& vec)
 {
 	if (vec.size() != size) return;
@@ -117,12 +117,16 @@ public:
 	void GetVec(std::vector<double>& vec);
 	void GetVec(std::vector<wxInt64>& vec);
 	void GetVec(std::vector<wxString>& vec);
+	// rows first to first+count-1 of a numeric field
+	void GetVec(int first, int count, std::vector<double>& vec);
 	
 	// note: the following two functions only have an
 	// effect on numeric fields currently.
 	void SetFromVec(const std::vector<double>& vec);
 	void SetFromVec(const std::vector<wxInt64>& vec);
 	void SetFromVec(const std::vector<wxString>& vec);
+	// rows first to first+vec.size()-1 of a numeric field
+	void SetFromVec(int first, const std::vector<double>& vec);
 	void CheckUndefined();
 	void SetUndefined(const std::vector<bool>& undef_vec);
 	void GetUndefined(std::vector<bool>& undef_vec);
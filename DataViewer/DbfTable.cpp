@@ -511,6 +511,18 @@ void DbfTable::GetColData(int col, int time, std::vector<double>& data)
 	for (size_t i=0; i<rows; i++) if (c->undefined[i]) data[i] = 0;
 }
 
+void DbfTable::GetColData(int col, int time, int first, int count,
+						  std::vector<double>& data)
+{
+	if (col < 0 || col >= var_order.GetNumVarGroups()
+		||! IsColNumeric(col)) return;
+	DbfColContainer* c = FindDbfCol(col, time);
+	if (!c) return;
+	c->CheckUndefined();
+	c->GetVec(first, count, data);
+	for (int i=0; i<count; i++) if (c->undefined[first+i]) data[i] = 0;
+}
+
 void DbfTable::GetColData(int col, int time, std::vector<wxInt64>& data)
 {
 	if (col < 0 || col >= var_order.GetNumVarGroups()
@@ -631,6 +643,20 @@ void DbfTable::SetColData(int col, int time,
 	SetChangedSinceLastSave(true);
 }
 
+void DbfTable::SetColData(int col, int time, int first,
+						  const std::vector<double>& data)
+{
+	if (col < 0 || col >= var_order.GetNumVarGroups()) return;
+	if (!IsColNumeric(col)) return;
+	DbfColContainer* c = FindDbfCol(col, time);
+	if (!c) return;
+	c->SetFromVec(first, data);
+	if (first + (int) data.size() < GetNumberRows()) return;
+	table_state->SetColDataChangeEvtTyp(c->GetName(), col);
+	table_state->notifyObservers();
+	SetChangedSinceLastSave(true);
+}
+
 void DbfTable::SetColUndefined(int col, int time,
 							   const std::vector<bool>& undefined)
 {
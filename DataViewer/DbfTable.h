@@ -89,6 +89,8 @@ public:
 	virtual void GetColData(int col, int time, std::vector<double>& data);
 	virtual void GetColData(int col, int time, std::vector<wxInt64>& data);
 	virtual void GetColData(int col, int time, std::vector<wxString>& data);
+	virtual void GetColData(int col, int time, int first, int count,
+							std::vector<double>& data);
 	virtual void GetColUndefined(int col, b_array_type& undefined);
 	virtual void GetColUndefined(int col, int time,
 								 std::vector<bool>& undefined);
@@ -103,6 +105,8 @@ public:
 							const std::vector<wxInt64>& data);
 	virtual void SetColData(int col, int time,
 							const std::vector<wxString>& data);
+	virtual void SetColData(int col, int time, int first,
+							const std::vector<double>& data);
 	virtual void SetColUndefined(int col, int time,
 								 const std::vector<bool>& undefined);
 	virtual bool ColChangeProperties(int col, int time, int new_len,
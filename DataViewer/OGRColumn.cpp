@@ -147,6 +147,12 @@ void OGRColumn::UpdateData(const vector<wxString> &data)
 
 }
 
+void OGRColumn::UpdateData(int first, const vector<double> &data)
+{
+    wxString msg = "Internal error: UpdateData(first, double) not implemented.";
+    throw GdaException(msg.mb_str());
+}
+
 void OGRColumn::GetCellValue(int row, wxInt64& val)
 {
     wxString msg = "Internal error: GetCellValue(wxInt64) not implemented.";
@@ -168,6 +174,12 @@ void OGRColumn::GetCellValue(int row, wxString& val)
 
 }
 
+void OGRColumn::FillData(int first, int count, vector<double>& data)
+{
+    wxString msg = "Internal error: FillData(first, count) not implemented.";
+    throw GdaException(msg.mb_str());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 OGRColumnInteger::OGRColumnInteger(wxString name, int field_length, int decimals, int n_rows)
@@ -247,6 +259,21 @@ void OGRColumnInteger::FillData(vector<double> &data)
     }
 }
 
+void OGRColumnInteger::FillData(int first, int count, vector<double> &data)
+{
+    if (is_new) {
+        for (int i=0; i<count; ++i) {
+            data[i] = (double)new_data[first+i];
+        }
+    } else {
+        int col_idx = GetColIndex();
+        for (int i=0; i<count; ++i) {
+            data[i] = (double)ogr_layer->data[first+i]->
+                GetFieldAsInteger64(col_idx);
+        }
+    }
+}
+
 void OGRColumnInteger::FillData(vector<wxString> &data)
 {
     if (is_new) {
@@ -294,6 +321,23 @@ void OGRColumnInteger::UpdateData(const vector<double>& data)
     }
 }
 
+void OGRColumnInteger::UpdateData(int first, const vector<double>& data)
+{
+    int count = data.size();
+    if (is_new) {
+        for (int i=0; i<count; ++i) {
+            new_data[first+i] = (int)data[i];
+            set_markers[first+i] = true;
+        }
+    } else {
+        int col_idx = GetColIndex();
+        for (int i=0; i<count; ++i) {
+            ogr_layer->data[first+i]->SetField(col_idx, (GIntBig)data[i]);
+            set_markers[first+i] = true;
+        }
+    }
+}
+
 void OGRColumnInteger::GetCellValue(int row, wxInt64& val)
 {
     if (is_new) {
@@ -417,6 +461,20 @@ void OGRColumnDouble::FillData(vector<double> &data)
     }
 }
 
+void OGRColumnDouble::FillData(int first, int count, vector<double> &data)
+{
+    if (is_new) {
+        for (int i=0; i<count; ++i) {
+            data[i] = new_data[first+i];
+        }
+    } else {
+        int col_idx = GetColIndex();
+        for (int i=0; i<count; ++i) {
+            data[i] = ogr_layer->data[first+i]->GetFieldAsDouble(col_idx);
+        }
+    }
+}
+
 void OGRColumnDouble::FillData(vector<wxString> &data)
 {
     if (is_new) {
@@ -448,6 +506,23 @@ void OGRColumnDouble::UpdateData(const vector<double>& data)
     }
 }
 
+void OGRColumnDouble::UpdateData(int first, const vector<double>& data)
+{
+    int count = data.size();
+    if (is_new) {
+        for (int i=0; i<count; ++i) {
+            new_data[first+i] = data[i];
+            set_markers[first+i] = true;
+        }
+    } else {
+        int col_idx = GetColIndex();
+        for (int i=0; i<count; ++i) {
+            ogr_layer->data[first+i]->SetField(col_idx, data[i]);
+            set_markers[first+i] = true;
+        }
+    }
+}
+
 void OGRColumnDouble::UpdateData(const vector<wxInt64>& data)
 {
     if (is_new) {
@@ -75,6 +75,8 @@ public:
     virtual void UpdateData(const vector<double>& data);
     virtual void UpdateData(const vector<wxInt64>& data);
     virtual void UpdateData(const vector<wxString>& data);
+    // rows first to first+data.size()-1, for numeric columns
+    virtual void UpdateData(int first, const vector<double>& data);
 	virtual void GetCellValue(int row, wxInt64& val);
 	virtual void GetCellValue(int row, double& val);
 	virtual void GetCellValue(int row, wxString& val);
@@ -82,6 +84,8 @@ public:
     virtual void FillData(vector<double>& data) = 0;
     virtual void FillData(vector<wxInt64>& data) = 0;
     virtual void FillData(vector<wxString>& data) = 0;
+    // rows first to first+count-1, for numeric columns
+    virtual void FillData(int first, int count, vector<double>& data);
     virtual wxString GetValueAt(int row_idx, int disp_decimals=0,
                                 wxCSConv* m_wx_encoding=NULL) = 0;
     virtual void SetValueAt(int row_idx, const wxString& value) = 0;
@@ -107,8 +111,10 @@ public:
     virtual void FillData(vector<double>& data);
     virtual void FillData(vector<wxInt64>& data);
     virtual void FillData(vector<wxString>& data);
+    virtual void FillData(int first, int count, vector<double>& data);
     virtual void UpdateData(const vector<wxInt64>& data);
     virtual void UpdateData(const vector<double>& data);
+    virtual void UpdateData(int first, const vector<double>& data);
 	virtual void GetCellValue(int row, wxInt64& val);
     virtual wxString GetValueAt(int row_idx, int disp_decimals=0,
                                 wxCSConv* m_wx_encoding=NULL);
@@ -135,8 +141,10 @@ public:
     virtual void FillData(vector<double>& data);
     virtual void FillData(vector<wxInt64>& data);
     virtual void FillData(vector<wxString>& data);
+    virtual void FillData(int first, int count, vector<double>& data);
     virtual void UpdateData(const vector<wxInt64>& data);
     virtual void UpdateData(const vector<double>& data);
+    virtual void UpdateData(int first, const vector<double>& data);
 	virtual void GetCellValue(int row, double& val);
     virtual wxString GetValueAt(int row_idx, int disp_decimals=0,
                                 wxCSConv* m_wx_encoding=NULL);
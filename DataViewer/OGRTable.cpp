@@ -739,6 +739,17 @@ void OGRTable::GetColData(int col, int time, std::vector<double>& data)
     ogr_col->FillData(data);
 }
 
+void OGRTable::GetColData(int col, int time, int first, int count,
+						  std::vector<double>& data)
+{
+	wxString nm(var_order.GetSimpleColName(col, time));
+	if (nm.IsEmpty()) return;
+	OGRColumn* ogr_col = FindOGRColumn(nm);
+	if (ogr_col == NULL) return;
+	data.resize(count);
+	ogr_col->FillData(first, count, data);
+}
+
 void OGRTable::GetColData(int col, int time, std::vector<wxInt64>& data)
 {
 	//if (!IsColNumeric(col)) return;
@@ -893,6 +904,28 @@ void OGRTable::SetColData(int col, int time,
 	SetChangedSinceLastSave(true);
 }
 
+void OGRTable::SetColData(int col, int time, int first,
+						  const std::vector<double>& data)
+{
+	if (col < 0 || col >= GetNumberCols()) return;
+	if (!IsColNumeric(col)) return;
+	int ogr_col_id = FindOGRColId(col, time);
+	if (ogr_col_id == wxNOT_FOUND) return;
+	
+    OGRColumn* ogr_col = columns[ogr_col_id];
+    if (first < 0 || first + (int) data.size() > ogr_col->GetNumRows()) return;
+    // one operation for the whole column: it keeps the values before the
+    // first chunk and reads the new ones from the column when committed
+    if (first == 0)
+        operations_queue.push(new OGRTableOpUpdateColumn(ogr_col,
+                                                         std::vector<double>()));
+    ogr_col->UpdateData(first, data);
+    if (first + (int) data.size() < ogr_col->GetNumRows()) return;
+	table_state->SetColDataChangeEvtTyp(ogr_col->GetName(), col);
+	table_state->notifyObservers();
+	SetChangedSinceLastSave(true);
+}
+
 /**
  * OGR doesn't keep track of defined/undefined
  */
@@ -226,9 +226,17 @@ void OGRTableOpUpdateColumn::Commit()
     GdaConst::FieldType type = ogr_col->GetType();
    
     if ( type == GdaConst::long64_type) {
+        if (l_new_data.empty()) {
+            l_new_data.resize(n_rows);
+            ogr_col->FillData(l_new_data);
+        }
         ogr_layer->UpdateColumn(col_idx, l_new_data);
         
     } else if (type == GdaConst::double_type) {
+        if (d_new_data.empty()) {
+            d_new_data.resize(n_rows);
+            ogr_col->FillData(d_new_data);
+        }
         ogr_layer->UpdateColumn(col_idx, d_new_data);
         
     } else if (type == GdaConst::string_type) {
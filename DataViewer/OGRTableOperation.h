@@ -111,7 +111,8 @@ public:
 };
 
 /**
- * Content / entire column
+ * Content / entire column.  Empty new data means the column was written a
+ * range of rows at a time, and the new values are read from it on Commit.
  */
 class OGRTableOpUpdateColumn : public OGRTableOperation
 {
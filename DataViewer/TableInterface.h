@@ -147,6 +147,12 @@ public:
 	virtual void GetColData(int col, int time, std::vector<double>& data) = 0;
 	virtual void GetColData(int col, int time, std::vector<wxInt64>& data) = 0;
 	virtual void GetColData(int col, int time, std::vector<wxString>& data) = 0;
+	/** Reads rows first to first+count-1 of a numeric column into data,
+	 which is resized to count, so that long columns can be processed in
+	 chunks without a copy of the whole column.  Undefined values are 0
+	 as for the full column. */
+	virtual void GetColData(int col, int time, int first, int count,
+							std::vector<double>& data) = 0;
 	virtual void GetColUndefined(int col, b_array_type& undefined) = 0;
 	virtual void GetColUndefined(int col, int time,
 								 std::vector<bool>& undefined) = 0;
@@ -161,6 +167,12 @@ public:
 							const std::vector<wxInt64>& data) = 0;
 	virtual void SetColData(int col, int time,
 							const std::vector<wxString>& data) = 0;
+	/** Writes data to rows first to first+data.size()-1 of a numeric
+	 column, so that a long column can be filled a chunk at a time without
+	 a copy of the whole column.  Observers are notified once the chunk
+	 ending at the last row has been written. */
+	virtual void SetColData(int col, int time, int first,
+							const std::vector<double>& data) = 0;
 	virtual void SetColUndefined(int col, int time,
 								 const std::vector<bool>& undefined) = 0;
 	
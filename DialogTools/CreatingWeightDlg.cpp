@@ -131,6 +131,7 @@ bool CreatingWeightDlg::Create( wxWindow* parent, wxWindowID id,
 	m_include_lower = 0;
 	m_txt_precision_threshold = 0;
 	m_cbx_precision_threshold = 0;
+	m_cbx_contig_hash = 0;
 	m_dist_choice = 0;
 	m_X = 0;
 	m_Y = 0;
@@ -161,6 +162,7 @@ void CreatingWeightDlg::CreateControls()
 	m_spincont = XRCCTRL(*this, "IDC_SPIN_ORDEROFCONTIGUITY", wxSpinButton);
 	m_include_lower = XRCCTRL(*this, "IDC_CHECK1", wxCheckBox);
 	m_cbx_precision_threshold= XRCCTRL(*this, "IDC_PRECISION_CBX", wxCheckBox);
+	m_cbx_contig_hash = XRCCTRL(*this, "IDC_CONTIG_HASH_CBX", wxCheckBox);
 	m_dist_choice = XRCCTRL(*this, "IDC_DISTANCE_METRIC", wxChoice);
 	m_X = XRCCTRL(*this, "IDC_XCOORDINATES", wxChoice);
 	m_Y = XRCCTRL(*this, "IDC_YCOORDINATES", wxChoice);
@@ -401,7 +403,13 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
 						precision_threshold = 0.0;
 					}
 				}
-				gal = PolysToContigWeights(project->main_data, !is_rook, precision_threshold);
+				if (m_cbx_contig_hash->IsChecked()) {
+					gal = PolysToContigWeightsHash(project->main_data, !is_rook,
+												   precision_threshold);
+				} else {
+					gal = PolysToContigWeights(project->main_data, !is_rook,
+											   precision_threshold);
+				}
 			}
 		
             bool empty_w = true;
@@ -573,6 +581,7 @@ void CreatingWeightDlg::SetRadioBtnAndAssocWidgets(RadioBtnId radio)
 	m_contiguity->Enable(false);
 	m_spincont->Enable(false);
 	m_cbx_precision_threshold->Enable(false);
+	m_cbx_contig_hash->Enable(false);
 	m_include_lower->Enable(false);
 	EnableThresholdControls(false);
 	FindWindow(XRCID("IDC_STATIC_KNN"))->Enable(false);
@@ -594,6 +603,7 @@ void CreatingWeightDlg::SetRadioBtnAndAssocWidgets(RadioBtnId radio)
 			m_contiguity->Enable(true);
 			m_spincont->Enable(true);
 			m_cbx_precision_threshold->Enable(true);
+			m_cbx_contig_hash->Enable(true);
 			m_include_lower->Enable(true);
 		}
 			break;
@@ -966,6 +976,7 @@ void CreatingWeightDlg::InitDlg()
 	FindWindow(XRCID("wxID_OK"))->Enable(false);
 	m_cbx_precision_threshold->Enable(false);
 	m_txt_precision_threshold->Enable(false);
+	m_cbx_contig_hash->Enable(false);
 	
 	col_id_map.clear();
 	table_int->FillColIdMap(col_id_map);
@@ -119,6 +119,7 @@ private:
 	wxTextCtrl* m_threshold;
 	wxCheckBox* m_cbx_precision_threshold;
 	wxTextCtrl* m_txt_precision_threshold;
+	wxCheckBox* m_cbx_contig_hash; // IDC_CONTIG_HASH_CBX
 	wxSlider* m_sliderdistance;
 	wxRadioButton* m_radio_knn;  // IDC_RADIO_KNN
 	wxTextCtrl* m_neighbors;
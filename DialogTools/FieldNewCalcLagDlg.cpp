@@ -150,10 +150,10 @@ void FieldNewCalcLagDlg::Apply()
 	std::vector<bool> r_undefined(table_int->GetNumberRows(), false);
 	
 	boost::uuids::uuid id = GetWeightsId();
-	GalElement* W = NULL;
+	const CsrWeight* W = NULL;
 	{
 		GalWeight* gw = w_man_int->GetGal(id);
-		W = gw ? gw->gal : NULL;
+		W = gw && gw->gal ? &gw->GetCsr() : NULL;
 		if (W == NULL) {
 			wxString msg("Was not able to load weights matrix.");
 			wxMessageDialog dlg (this, msg, "Error", wxOK | wxICON_ERROR);
@@ -174,16 +174,17 @@ void FieldNewCalcLagDlg::Apply()
 		// Row-standardized lag calculation.
 		for (int i=0, iend=table_int->GetNumberRows(); i<iend; i++) {
 			double lag = 0;
-			const GalElement& elm_i = W[i];
-			if (elm_i.Size() == 0) r_undefined[i] = true;
-			for (int j=0, sz=W[i].Size(); j<sz && !r_undefined[i]; j++) {
-				if (undefined[elm_i[j]]) {
+			const long* nbr_i = W->Nbrs(i);
+			const long sz_i = W->Size(i);
+			if (sz_i == 0) r_undefined[i] = true;
+			for (long j=0; j<sz_i && !r_undefined[i]; j++) {
+				if (undefined[nbr_i[j]]) {
 					r_undefined[i] = true;
 				} else {
-					lag += data[elm_i[j]];
+					lag += data[nbr_i[j]];
 				}
 			}
-			r_data[i] = r_undefined[i] ? 0 : lag /= W[i].Size();
+			r_data[i] = r_undefined[i] ? 0 : lag /= sz_i;
 		}
 		table_int->SetColData(result_col, time_list[t], r_data);
 		table_int->SetColUndefined(result_col, time_list[t], r_undefined);
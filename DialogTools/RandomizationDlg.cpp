@@ -17,15 +17,19 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <time.h>
+#include <boost/bind.hpp>
 #include <wx/wxprec.h>
 #include <wx/wx.h>
 #include <wx/image.h>
 #include <wx/xrc/xmlres.h>
 #include <wx/dcbuffer.h>
+#include <wx/stopwatch.h>
 
 #include "../rc/GeoDaIcon-16x16.xpm"
-#include "../ShapeOperations/GalWeight.h"
+#include "../ShapeOperations/GeodaWeight.h"
 #include "../GeoDa.h"
+#include "../GenUtils.h"
 #include "../TemplateCanvas.h"
 #include "../GdaConst.h"
 #include "../GdaConst.h"
@@ -34,7 +38,7 @@
 
 
 RandomizationPanel::RandomizationPanel(const std::vector<double>& raw_data1_s,
-                                       const GalElement* W_s, int NumPermutations,
+                                       const CsrWeight* W_s, int NumPermutations,
                                        bool reuse_user_seed,
                                        uint64_t user_specified_seed,
                                        wxFrame* parent)
@@ -54,18 +58,17 @@ wxPanel(parent, -1, wxDefaultPosition, wxSize(550,300))
     Connect(wxEVT_SIZE, wxSizeEventHandler(RandomizationPanel::OnSize));
     Connect(wxEVT_RIGHT_UP, wxMouseEventHandler(RandomizationPanel::OnMouse));
 
-    if (reuse_user_seed)
-        rng = new Randik(user_specified_seed);
-    else
-        rng = new Randik();
+    seed = reuse_user_seed ? user_specified_seed : (uint64_t) time(0);
+    num_runs = 0;
     
 	CalcMoran();
     Init();
+    RunRandomTrials();
 }
 
 RandomizationPanel::RandomizationPanel(const std::vector<double>& raw_data1_s,
                                        const std::vector<double>& raw_data2_s,
-                                       const GalElement* W_s, int NumPermutations,
+                                       const CsrWeight* W_s, int NumPermutations,
                                        bool reuse_user_seed,
                                        uint64_t user_specified_seed,
                                        wxFrame* parent)
@@ -80,21 +83,16 @@ wxPanel(parent, -1, wxDefaultPosition, wxSize(550,300))
     Connect(wxEVT_SIZE, wxSizeEventHandler(RandomizationPanel::OnSize));
 	Connect(wxEVT_RIGHT_UP, wxMouseEventHandler(RandomizationPanel::OnMouse));
     
-    if (reuse_user_seed)
-        rng = new Randik(user_specified_seed);
-    else
-        rng = new Randik();
+    seed = reuse_user_seed ? user_specified_seed : (uint64_t) time(0);
+    num_runs = 0;
     
 	CalcMoran();
     Init();
+    RunRandomTrials();
 }
 
 RandomizationPanel::~RandomizationPanel()
 {
-	if (perm) delete [] perm;
-	if (theRands) delete [] theRands;
-	if (rng) 
-		delete rng;
 }
 
 void RandomizationPanel::OnMouse( wxMouseEvent& event )
@@ -110,7 +108,6 @@ void RandomizationPanel::OnMouse( wxMouseEvent& event )
 void RandomizationPanel::OnRunClick( wxCommandEvent& event )
 {
 	RunRandomTrials();
-	Refresh();
 }
 
 void RandomizationPanel::CalcMoran()
@@ -118,11 +115,11 @@ void RandomizationPanel::CalcMoran()
 	Moran = 0;
 	if (is_bivariate) {
 		for (int i=0; i<num_obs; i++) {
-			Moran += W[i].SpatialLag(raw_data2) * raw_data1[i];
+			Moran += W->SpatialLag(i, raw_data2) * raw_data1[i];
 		}
 	} else {
 		for (int i=0; i<num_obs; i++) {
-			Moran += W[i].SpatialLag(raw_data1) * raw_data1[i];
+			Moran += W->SpatialLag(i, raw_data1) * raw_data1[i];
 		}
 	}
 	Moran /= (double) num_obs - 1.0;
@@ -130,9 +127,6 @@ void RandomizationPanel::CalcMoran()
 
 void RandomizationPanel::Init()
 {
-	perm = new int[num_obs];
-	theRands = new long[num_obs];
-	
 	if (Permutations <= 10) bins = 10;
 	else if (Permutations <= 100) bins = 20;
 	else if (Permutations <= 1000) bins = (Permutations+1)/4;
@@ -148,13 +142,26 @@ void RandomizationPanel::Init()
 	// take the last bin
 	else if (thresholdBin >= bins) thresholdBin = bins-1;
 	
-	experiment_run_once = false;
+	running = false;
+	next_perm = 0;
 }
 
 
 // NOTE: must carefully look at thresholdBin!
+/** Starts a run of Permutations permutations.  The permutations run on the
+ shared task pool in ten or so batches.  Each batch is a separate
+ RunBatch call queued with CallAfter, so the event loop repaints the
+ histogram and handles input between batches.  Permutation p of run r is
+ a Fisher-Yates shuffle driven by the Gda::CounterRng stream (seed, r, p),
+ so the reference distribution does not depend on the number of threads,
+ and a reused seed gives the same first run.  Ignored while a run is in
+ progress. */
 void RandomizationPanel::RunRandomTrials()
 {
+	if (running) return;
+	running = true;
+	next_perm = 0;
+	run_sw.Start();
 	totFrequency = 0;
 	for (int i=0; i<bins; i++) 
 		freq[i]=0;
@@ -165,33 +172,90 @@ void RandomizationPanel::RunRandomTrials()
 	minBin = thresholdBin; 
 	maxBin = thresholdBin;
 	
-	for (int i=0; i<Permutations; i++) {
+	MMean = 0;
+	MSdev = 0;
+	pseudo_p_val = 1;
+	count_greater = true;
+	expected_val = (double) -1/(num_obs - 1);
+	
+	// scratch space of each worker, reused by all of its permutations
+	int nworkers = GenUtils::NumThreads(Permutations);
+	perm_bufs.resize(nworkers);
+	perm_data1.resize(nworkers);
+	perm_data2.resize(nworkers);
+	for (int i=0; i<nworkers; i++) {
+		perm_bufs[i].resize(num_obs);
+		perm_data1[i].resize(num_obs);
+		if (is_bivariate) perm_data2[i].resize(num_obs);
+	}
+	Refresh();
+	CallAfter(&RandomizationPanel::RunBatch);
+}
+
+/** Runs the next batch of the run started by RunRandomTrials, adds it to
+ the histogram and queues the batch after it, if any. */
+void RandomizationPanel::RunBatch()
+{
+	const int batch_size = GenUtils::max<int>(100, (Permutations+9)/10);
+	int first = next_perm;
+	int last = GenUtils::min<int>(first+batch_size, Permutations) - 1;
+	if (last >= first) {
+		GenUtils::RunTasks(last-first+1,
+						   boost::bind(&RandomizationPanel::PermuteRange,
+									   this, first, _1, _2, _3));
+		for (int i=first; i<=last; i++) {
+			// find its place in the distribution
+			int newBin = (int)floor( (MoranI[i] - start)/range );
+			if (newBin < 0) newBin = 0;
+			else if (newBin >= bins) newBin = bins-1;
+			
+			freq[newBin] = freq[newBin] + 1;
+			if (newBin < minBin) minBin = newBin;
+			if (newBin > maxBin) maxBin = newBin;
+		}
+		totFrequency = last+1;
+		UpdateStatistics();
+		Refresh();
+	}
+	next_perm = last+1;
+	if (next_perm < Permutations) {
+		CallAfter(&RandomizationPanel::RunBatch);
+		return;
+	}
+	running = false;
+	num_runs++;
+	LOG_MSG(wxString::Format("Moran's I randomization with %d perms on %d "
+							 "obs took %ld ms", Permutations, num_obs,
+							 run_sw.Time()));
+}
+
+/** Moran's I of permutations base+first to base+last into MoranI. */
+void RandomizationPanel::PermuteRange(int base, size_t first, size_t last,
+									  int worker)
+{
+	int* perm = &perm_bufs[worker][0];
+	double* data1 = &perm_data1[worker][0];
+	double* data2 = is_bivariate ? &perm_data2[worker][0] : data1;
+	for (size_t p=base+first; p<=base+last; p++) {
 		//create a random permutation
-		rng->Perm(num_obs, perm, theRands);
-		double newMoran = 0;
+		Gda::CounterRng rng(seed, num_runs, p);
+		for (int i=0; i<num_obs; i++) perm[i] = i;
+		for (int i=num_obs-1; i>0; i--) {
+			int j = (int) (rng.NextDouble() * (i+1));
+			int tmp = perm[i];
+			perm[i] = perm[j];
+			perm[j] = tmp;
+		}
+		for (int i=0; i<num_obs; i++) data1[i] = raw_data1[perm[i]];
 		if (is_bivariate) {
-			for (int i=0; i<num_obs; i++) {
-				newMoran += (W[i].SpatialLag(raw_data2, perm)
-							 * raw_data1[perm[i]]);
-			}
-		} else {
-			for (int i=0; i<num_obs; i++) {
-				newMoran += (W[i].SpatialLag(raw_data1, perm)
-							 * raw_data1[perm[i]]);
-			}
+			for (int i=0; i<num_obs; i++) data2[i] = raw_data2[perm[i]];
 		}
-		newMoran /= (double) num_obs - 1.0;
-		// find its place in the distribution
-		MoranI[ totFrequency++ ] = newMoran;
-		int newBin = (int)floor( (newMoran - start)/range );
-		if (newBin < 0) newBin = 0;
-		else if (newBin >= bins) newBin = bins-1;
-		
-		freq[newBin] = freq[newBin] + 1;
-		if (newBin < minBin) minBin = newBin;
-		if (newBin > maxBin) maxBin = newBin;
+		double newMoran = 0;
+		for (int i=0; i<num_obs; i++) {
+			newMoran += W->SpatialLag(i, data2) * data1[i];
+		}
+		MoranI[p] = newMoran / ((double) num_obs - 1.0);
 	}
-	UpdateStatistics();
 }
 
 /** For a pseudo p-val based on permutations, we use a one-sided test,
@@ -322,7 +386,7 @@ void RandomizationPanel::Draw(wxDC* dc)
 							Moran, expected_val, MMean, MSdev, zval);
 	dc->DrawText(text, Left, Top + Height + Bottom/2);
  
-	text = wxString::Format("permutations: %d  ", Permutations);
+	text = wxString::Format("permutations: %d  ", totFrequency);
 	dc->DrawText(text, Left+5, 35);
 
 	text = wxString::Format("pseudo p-value: %-7.6f", pseudo_p_val);
@@ -337,13 +401,6 @@ void RandomizationPanel::OnSize( wxSizeEvent& event )
 
 void RandomizationPanel::OnPaint( wxPaintEvent& event )
 {
-	if (!experiment_run_once) {
-		experiment_run_once = true;
-		//wxCommandEvent ev;
-		//OnOkClick(ev);
-        RunRandomTrials();
-        Refresh();
-	}
     wxAutoBufferedPaintDC dc(this);
 	dc.Clear();
 	Paint(&dc);
@@ -395,7 +452,7 @@ END_EVENT_TABLE()
 
 RandomizationDlg::RandomizationDlg( const std::vector<double>& raw_data1_s,
 								   const std::vector<double>& raw_data2_s,
-								   const GalElement* W_s,
+								   const CsrWeight* W_s,
 								   int NumPermutations,
                                    bool reuse_user_seed,
                                    uint64_t user_specified_seed,
@@ -415,7 +472,7 @@ RandomizationDlg::RandomizationDlg( const std::vector<double>& raw_data1_s,
 }
 
 RandomizationDlg::RandomizationDlg( const std::vector<double>& raw_data1_s,
-								   const GalElement* W_s,
+								   const CsrWeight* W_s,
 								   int NumPermutations,
                                    bool reuse_user_seed,
                                    uint64_t user_specified_seed,
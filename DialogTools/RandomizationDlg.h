@@ -21,23 +21,24 @@
 #define __GEODA_CENTER_RANDOMIZATION_DLG_H__
 
 #include <vector>
-#include "../ShapeOperations/Randik.h"
+#include <stdint.h>
+#include <wx/stopwatch.h>
 
 
 
-class GalElement;
+class CsrWeight;
 
 class RandomizationPanel: public wxPanel
 {
 public:
     RandomizationPanel(const std::vector<double>& raw_data1,
-                       const GalElement* W, int NumPermutations,
+                       const CsrWeight* W, int NumPermutations,
                        bool reuse_user_seed,
                        uint64_t user_specified_seed,
                        wxFrame* parent);
     RandomizationPanel(const std::vector<double>& raw_data1,
                        const std::vector<double>& raw_data2,
-                       const GalElement* W, int NumPermutations,
+                       const CsrWeight* W, int NumPermutations,
                        bool reuse_user_seed,
                        uint64_t user_specified_seed,
                        wxFrame* parent);
@@ -61,6 +62,8 @@ public:
     void SinglePermute();
 	void RunPermutations();
 	void RunRandomTrials();
+	void RunBatch();
+	void PermuteRange(int base, size_t first, size_t last, int worker);
 	void UpdateStatistics();
 	
     int	Width, Height, Left, Right, Top, Bottom;
@@ -76,7 +79,7 @@ public:
 	std::vector<int> freq;
 	
 	bool is_bivariate;
-	const GalElement* W;
+	const CsrWeight* W;
 	std::vector<double> raw_data1;
 	std::vector<double> raw_data2;
 	double Moran;
@@ -87,11 +90,16 @@ public:
 	double  expected_val;
 	bool count_greater;
 	
-	int* perm;
-	long* theRands;
+	// permutation and permuted data of each task pool worker
+	std::vector<std::vector<int> > perm_bufs;
+	std::vector<std::vector<double> > perm_data1;
+	std::vector<std::vector<double> > perm_data2;
 	
-	Randik*  rng;
-	bool    experiment_run_once;
+	uint64_t seed;
+	int     num_runs; // runs so far, each with its own random streams
+	bool    running; // batches of a run are still queued
+	int     next_perm; // first permutation of the next batch
+	wxStopWatch run_sw;
 };
 
 class RandomizationDlg: public wxFrame
@@ -101,7 +109,7 @@ class RandomizationDlg: public wxFrame
 
 public:
 	RandomizationDlg(const std::vector<double>& raw_data1,
-					 const GalElement* W, int NumPermutations,
+					 const CsrWeight* W, int NumPermutations,
                      bool reuse_user_seed,
 					 uint64_t user_specified_seed,                    
 					 wxWindow* parent, wxWindowID id = wxID_ANY,
@@ -111,7 +119,7 @@ public:
 					 long style = wxCAPTION|wxSYSTEM_MENU);
 	RandomizationDlg( const std::vector<double>& raw_data1,
 					 const std::vector<double>& raw_data2,
-					 const GalElement* W, int NumPermutations,
+					 const CsrWeight* W, int NumPermutations,
                      bool reuse_user_seed,
 					 uint64_t user_specified_seed,
 					 wxWindow* parent, wxWindowID id = wxID_ANY,
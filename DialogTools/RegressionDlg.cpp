@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <time.h>
 #include <boost/foreach.hpp>
 #include <wx/grid.h>
@@ -59,12 +60,84 @@ bool classicalRegression(GalElement *g, int num_obs, double * Y,
 
 bool spatialLagRegression(GalElement *g, int num_obs, double * Y,
 						  int dim, double ** X, int deps, DiagnosticReport *dr,
-						  bool InclConstant, wxGauge* p_bar = 0) ;
+						  bool InclConstant, wxGauge* p_bar = 0,
+						  TraceApprox* approx = 0) ;
 
 bool spatialErrorRegression(GalElement *g, int num_obs, double * Y,
 							int dim, double ** XX, int deps,
 							DiagnosticReport *rr, 
-							bool InclConstant, wxGauge* p_bar = 0);
+							bool InclConstant, wxGauge* p_bar = 0,
+							TraceApprox* approx = 0);
+
+bool batchRegression(GalElement *g, int dim, double * Y, double ** X,
+					 int expl, const std::vector< std::vector<int> >& specs,
+					 DiagnosticReport *dr, bool InclConstant, bool m_moranz,
+					 wxGauge* gauge);
+
+bool streamingRegression(TableInterface* table, const std::vector<int>& cols,
+						 const std::vector<int>& tms, DiagnosticReport *dr,
+						 bool InclConstant, int resid_col, int pred_col,
+						 wxGauge* gauge);
+
+/** Id of the column for streamed regression output name.  An existing
+ column is reused only if it holds doubles for a single time period,
+ otherwise a double column with a unique name based on name is appended.
+ Returns -1 if the column cannot be added. */
+static int StreamOutputColumn(TableInterface* table_int, const wxString& name)
+{
+	int col = table_int->FindColId(name);
+	if (col != wxNOT_FOUND &&
+		table_int->GetColType(col) == GdaConst::double_type &&
+		!table_int->IsColTimeVariant(col)) return col;
+	wxString nm = name;
+	if (col != wxNOT_FOUND) nm = table_int->GetUniqueColNames(name, 1)[0];
+	col = table_int->InsertCol(GdaConst::double_type, nm,
+							   table_int->GetNumberCols(), 1,
+							   GdaConst::default_dbf_double_len,
+							   GdaConst::default_dbf_double_decimals);
+	return col < 0 ? -1 : col;
+}
+
+/** Specifications compared by "Compare Subsets": every subset of the
+ independent variables when there are at most max_subset_vars of them,
+ otherwise the full model and the model without each variable.  The
+ constant, column 0 of X, is in every specification. */
+static void BatchSpecifications(int nX, bool constant,
+								std::vector< std::vector<int> >& specs)
+{
+	const int max_subset_vars = 10;
+	const int first = constant ? 1 : 0;
+	const int nvars = nX - first;
+	specs.clear();
+	if (nvars <= max_subset_vars) {
+		for (int mask = 1; mask < (1 << nvars); mask++) {
+			std::vector<int> v;
+			if (constant) v.push_back(0);
+			for (int i = 0; i < nvars; i++) {
+				if (mask & (1 << i)) v.push_back(first + i);
+			}
+			specs.push_back(v);
+		}
+	} else {
+		for (int drop = -1; drop < nvars; drop++) {
+			std::vector<int> v;
+			for (int i = 0; i < nX; i++) {
+				if (drop < 0 || i != first + drop) v.push_back(i);
+			}
+			specs.push_back(v);
+		}
+	}
+}
+
+/** Orders specifications by Akaike info criterion, failed ones last. */
+struct SpecAicLess {
+	SpecAicLess(const std::vector<RegressionSpecResult>& r_) : r(r_) {}
+	bool operator()(int a, int b) const {
+		if (r[a].ok != r[b].ok) return r[a].ok;
+		return r[a].ok && r[a].aic < r[b].aic;
+	}
+	const std::vector<RegressionSpecResult>& r;
+};
 
 BEGIN_EVENT_TABLE( RegressionDlg, wxDialog )
     EVT_BUTTON( XRCID("ID_RUN"), RegressionDlg::OnRunClick )
@@ -86,6 +159,8 @@ BEGIN_EVENT_TABLE( RegressionDlg, wxDialog )
     EVT_BUTTON( XRCID("IDC_BUTTON3"), RegressionDlg::OnCButton3Click )
     EVT_BUTTON( XRCID("IDC_BUTTON4"), RegressionDlg::OnCButton4Click )
     EVT_BUTTON( XRCID("IDC_BUTTON5"), RegressionDlg::OnCButton5Click )
+	EVT_CHECKBOX( XRCID("ID_APPROX_ML_CB"), RegressionDlg::OnApproxMlCbClick )
+	EVT_CHECKBOX( XRCID("ID_STREAM_CB"), RegressionDlg::OnStreamCbClick )
     EVT_CHECKBOX( XRCID("IDC_WEIGHT_CHECK"),
 				 RegressionDlg::OnCWeightCheckClick )
     EVT_BUTTON( XRCID("IDC_SAVE_REGRESSION"),
@@ -173,6 +248,11 @@ bool RegressionDlg::Create(wxWindow* parent, wxWindowID id,
     m_gauge = NULL;
 	m_gauge_text = NULL;
 	m_white_test_cb = NULL;
+	m_approx_ml_cb = NULL;
+	m_approx_probes_spin = NULL;
+	m_batch_cb = NULL;
+	m_stream_cb = NULL;
+	m_spill_cb = NULL;
 
     SetParent(parent);
     CreateControls();
@@ -205,6 +285,21 @@ void RegressionDlg::CreateControls()
 	m_coef_var_matrix_cb = XRCCTRL(*this, "ID_COEF_VAR_MATRIX_CB", wxCheckBox);
 	m_white_test_cb = XRCCTRL(*this, "ID_WHITE_TEST_CB", wxCheckBox);
 	m_white_test_cb->SetValue(false);
+	m_approx_ml_cb = XRCCTRL(*this, "ID_APPROX_ML_CB", wxCheckBox);
+	m_approx_ml_cb->SetValue(false);
+	m_approx_probes_spin = XRCCTRL(*this, "ID_APPROX_PROBES_SPIN",
+									 wxSpinCtrl);
+	m_approx_probes_spin->SetValue(TraceApprox::default_probes);
+	m_approx_probes_spin->Enable(false);
+	m_sparse_chol_cb = XRCCTRL(*this, "ID_SPARSE_CHOL_CB", wxCheckBox);
+	m_sparse_chol_cb->SetValue(false);
+	m_batch_cb = XRCCTRL(*this, "ID_BATCH_CB", wxCheckBox);
+	m_batch_cb->SetValue(false);
+	m_stream_cb = XRCCTRL(*this, "ID_STREAM_CB", wxCheckBox);
+	m_stream_cb->SetValue(false);
+	m_spill_cb = XRCCTRL(*this, "ID_SPILL_CB", wxCheckBox);
+	m_spill_cb->SetValue(false);
+	m_spill_cb->Enable(false);
 	
 	m_gauge = XRCCTRL(*this, "IDC_GAUGE", wxGauge);
 	m_gauge->SetRange(200);
@@ -266,6 +361,9 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 	bool m_constant_term = true; // m_CheckConstant->GetValue();
 	bool m_WeightCheck = m_CheckWeight->GetValue();
 	bool m_standardization = true; // m_standardize->GetValue();
+	// classic OLS can read the table in chunks instead of copying it
+	const bool stream = (m_stream_cb->GetValue() && RegressModel == 1 &&
+						 !m_WeightCheck);
 
 	wxString m_Yname = m_dependent->GetValue();
 
@@ -282,7 +380,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 
 	if (m_constant_term) {
 		x = new double* [nX + 1]; // the last one is for Y
-		alloc(x[0], m_obs, 1.0);
+		if (stream) x[0] = NULL; else alloc(x[0], m_obs, 1.0);
 	} else {
 		x = new double* [nX];
 	}
@@ -302,14 +400,15 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 	m_Yname.Trim(true);
 	
 	double** dt = new double* [sz + 1];
-	for (i = 0; i < sz + 1; i++) dt[i] = new double[m_obs];
+	for (i = 0; i < sz + 1; i++) dt[i] = stream ? NULL : new double[m_obs];
 
 	// WS1447
 	// fill in each field from m_independentlist and tack on
 	// m_Yname to the end
 	// NOTE: We need to close this gapping memory leak!d  It looks like
 	// dt and x is allocated, but never freed!
-	std::vector<double> vec(m_obs);
+	std::vector<double> vec(stream ? 0 : m_obs);
+	std::vector<int> col_ids(sz + 1), col_tms(sz + 1);
 	for (i=0; i < m_independentlist->GetCount(); i++) {
 		wxString nm = name_to_nm[m_independentlist->GetString(i)];
 		int col = table_int->FindColId(nm);
@@ -323,6 +422,9 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 			return;
 		}
 		int tm = name_to_tm_id[m_independentlist->GetString(i)];
+		col_ids[i] = col;
+		col_tms[i] = tm;
+		if (stream) continue;
 		table_int->GetColData(col, tm, vec);
 		for (int j=0; j<m_obs; j++) dt[i][j] = vec[j];
 	}
@@ -336,8 +438,12 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 		dlg.ShowModal();
 		return;
 	}
-	table_int->GetColData(y_col_id, name_to_tm_id[m_Yname], vec);
-	for (int j=0; j<m_obs; j++) dt[sz][j] = vec[j];
+	col_ids[sz] = y_col_id;
+	col_tms[sz] = name_to_tm_id[m_Yname];
+	if (!stream) {
+		table_int->GetColData(y_col_id, name_to_tm_id[m_Yname], vec);
+		for (int j=0; j<m_obs; j++) dt[sz][j] = vec[j];
+	}
 		
 	for (i = 0; i < sz + 1; i++) {
 		x[i + ix] = dt[i];
@@ -353,6 +459,14 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 	
 	const int n = m_obs;
 	bool do_white_test = m_white_test_cb->GetValue();
+	std::vector< std::vector<int> > batch_specs;
+	if (m_batch_cb->GetValue()) {
+		BatchSpecifications(nX, m_constant_term, batch_specs);
+	}
+	// probe budget of the stochastic log-Jacobian and trace estimates
+	TraceApprox approx(m_approx_ml_cb->GetValue() ?
+					   m_approx_probes_spin->GetValue() : 0);
+	approx.cholesky = m_sparse_chol_cb->GetValue();
 	
         if (m_constant_term) {
             if (RegressModel == 2) {             
@@ -398,6 +512,10 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 		boost::uuids::uuid id = GetWeightsId();
 		GalWeight* gw = w_man_int->GetGal(id);
 		GalElement* gal_weight = gw ? gw->gal : NULL;
+		// the spectrum of W is kept between ML regressions on the weights
+		approx.eigenvalues = w_man_int->GetEigenvalues(id);
+		const bool had_eigenvalues = (approx.eigenvalues &&
+									  !approx.eigenvalues->empty());
 		
         bool isAuto = false;
         if (RegressModel == 4) {
@@ -490,6 +608,11 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 				UpdateMessageBox("");
 				return;
 			} else {
+				if (gal_weight && !batch_specs.empty()) {
+					UpdateMessageBox("comparing specifications...");
+					batchRegression(gal_weight, n, y, x, nX, batch_specs,
+									&m_DR, m_constant_term, true, m_gauge);
+				}
 				m_resid1= m_DR.GetResidual();
 				printAndShowClassicalResults(table_int->GetTableName(),
 											 w_man_int->GetLongDispName(id),
@@ -534,7 +657,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 
 			if (gal_weight && !spatialLagRegression(gal_weight, m_obs,
 													y, n, x, nX, &m_DR, true,
-													m_gauge)) {
+													m_gauge, &approx)) {
 				wxMessageBox("Error: the inverse matrix is ill-conditioned.");
 				m_OpenDump = false;
 				OnCResetClick(event);
@@ -544,6 +667,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 				printAndShowLagResults(table_int->GetTableName(),
 									   w_man_int->GetLongDispName(id),
 									   &m_DR, n, nX);
+				if (!had_eigenvalues) w_man_int->SaveEigenvalues(id);
 				m_yhat2 = m_DR.GetYHAT();
 				m_resid2= m_DR.GetResidual();
 				m_prederr2 = m_DR.GetPredError();
@@ -585,7 +709,8 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 
 			if (gal_weight && !spatialErrorRegression(gal_weight, m_obs,
 													  y, n, x, nX,
-													  &m_DR, true, m_gauge)) {
+													  &m_DR, true, m_gauge,
+													  &approx)) {
 				wxMessageBox("Error: the inverse matrix is ill-conditioned.");
 				m_OpenDump = false;
 				OnCResetClick(event);
@@ -595,6 +720,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 	  			printAndShowErrorResults(table_int->GetTableName(),
 										 w_man_int->GetLongDispName(id),
 										 &m_DR, n, nX);
+				if (!had_eigenvalues) w_man_int->SaveEigenvalues(id);
 				m_yhat3 = m_DR.GetYHAT();
 				m_resid3= m_DR.GetResidual();
 				m_prederr3 = m_DR.GetPredError();
@@ -616,6 +742,47 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
             // reset regressModel after auto
             RegressModel = 4;
         }
+	} else if (stream) {
+		if (n <= nX) {
+			wxString msg = wxString::Format("Error: %d observations are too "
+											"few to estimate %d "
+											"coefficients.", n, nX);
+			wxMessageBox(msg);
+			UpdateMessageBox("");
+			return;
+		}
+		int resid_col = -1, pred_col = -1;
+		if (m_spill_cb->GetValue()) {
+			pred_col = StreamOutputColumn(table_int, "OLS_PREDIC");
+			resid_col = StreamOutputColumn(table_int, "OLS_RESIDU");
+			if (pred_col == -1 || resid_col == -1) {
+				wxMessageBox("Error: could not add the predicted value and "
+							 "residual columns to the Table.");
+				UpdateMessageBox("");
+				return;
+			}
+		}
+		DiagnosticReport m_DR(n, nX, m_constant_term, false, RegressModel,
+							  resid_col == -1);
+		SetXVariableNames(&m_DR);
+		if (!streamingRegression(table_int, col_ids, col_tms, &m_DR,
+								 m_constant_term, resid_col, pred_col,
+								 m_gauge)) {
+			wxMessageBox("Error: the inverse matrix is ill-conditioned.");
+			m_OpenDump = false;
+			OnCResetClick(event);
+			UpdateMessageBox("");
+			return;
+		} else {
+			printAndShowClassicalResults(table_int->GetTableName(),
+										 wxEmptyString, &m_DR, n, nX, false);
+			m_yhat1 = m_DR.GetYHAT();
+			m_resid1= m_DR.GetResidual();
+			m_OpenDump = true;
+			m_Run = true;
+			b_done1 = false;
+		}
+		m_DR.release_Var();
 	} else {
 		DiagnosticReport m_DR(n, nX, m_constant_term, false, RegressModel);
 		SetXVariableNames(&m_DR);
@@ -631,6 +798,11 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 			UpdateMessageBox("");
 			return;
 		} else {
+			if (!batch_specs.empty()) {
+				UpdateMessageBox("comparing specifications...");
+				batchRegression((GalElement*)NULL, n, y, x, nX, batch_specs,
+								&m_DR, m_constant_term, false, m_gauge);
+			}
 			printAndShowClassicalResults(table_int->GetTableName(),
 										 wxEmptyString, &m_DR, n, nX,
 										 do_white_test);
@@ -800,7 +972,16 @@ void RegressionDlg::OnCResetClick( wxCommandEvent& event )
 
 	RegressModel = 1;
 	m_white_test_cb->SetValue(false);
+	m_approx_ml_cb->SetValue(false);
+	m_approx_probes_spin->SetValue(TraceApprox::default_probes);
+	m_approx_probes_spin->Enable(false);
+	m_sparse_chol_cb->SetValue(false);
+	m_batch_cb->SetValue(false);
+	m_stream_cb->SetValue(false);
+	m_spill_cb->SetValue(false);
 	m_white_test_cb->Enable(true);
+	m_batch_cb->Enable(true);
+	UpdateStreamItems();
 	
 	m_gauge->SetValue(0);
 
@@ -866,6 +1047,12 @@ void RegressionDlg::OnCSaveRegressionClick( wxCommandEvent& event )
 	std::vector<double> prederr(RegressModel > 1 ? n_obs : 0);
 	std::vector<SaveToTableEntry> data(RegressModel > 1 ? 3 : 2);
 		
+	if (RegressModel==1 && m_resid1 == NULL) {
+		wxMessageBox("The predicted values and residuals were written to "
+					 "the Table when the regression was run.");
+		return;
+	}
+	
 	wxString pre = "";
 	if (RegressModel==1) {
 		pre = "OLS_";
@@ -1077,7 +1264,11 @@ void RegressionDlg::OnCWeightCheckClick( wxCommandEvent& event )
 	b_done1 = b_done2 = b_done3 = false;
 	EnablingItems();
 
-	if (!m_CheckWeight->IsChecked()) m_radio1->SetValue(true);
+	if (!m_CheckWeight->IsChecked()) {
+		m_radio1->SetValue(true);
+		RegressModel = 1;
+	}
+	UpdateStreamItems();
 }
 
 void RegressionDlg::UpdateMessageBox(wxString msg)
@@ -1233,6 +1424,45 @@ void RegressionDlg::printAndShowClassicalResults(const wxString& datasetname,
 		slog << wxString::Format(f, rr[0], rr[1], rr[2]);
 	}
 	
+	std::vector<RegressionSpecResult>& specs = r->GetSpecifications();
+	if (!specs.empty()) {
+		std::vector<int> order(specs.size());
+		for (size_t i=0; i<specs.size(); i++) order[i] = i;
+		std::sort(order.begin(), order.end(), SpecAicLess(specs));
+		slog << "\n"; cnt++;
+		slog << "COMPARISON OF SPECIFICATIONS (sorted by Akaike info criterion)\n";
+		cnt++;
+		slog << "   K     Adj.R2          AIC           SC";
+		if (m_WeightCheck) slog << "   LM-lag  RLM-lag   LM-err  RLM-err";
+		slog << "\n"; cnt++;
+		if (m_WeightCheck) {
+			slog << "                                       ";
+			slog << "   (probabilities of the LM tests)\n"; cnt++;
+		}
+		for (size_t o=0; o<order.size(); o++) {
+			const RegressionSpecResult& s = specs[order[o]];
+			slog << wxString::Format("%4d", (int) s.vars.size());
+			if (!s.ok) {
+				slog << "  (ill-conditioned)\n"; cnt++;
+			} else {
+				slog << wxString::Format("  %9.5f  %11.6g  %11.6g",
+										 s.r2_a, s.aic, s.sc);
+				if (m_WeightCheck) {
+					slog << wxString::Format("  %7.4f  %7.4f  %7.4f  %7.4f",
+											 s.lmlag_prob, s.lmlagr_prob,
+											 s.lmerr_prob, s.lmerrr_prob);
+				}
+				slog << "\n"; cnt++;
+			}
+			wxString vars;
+			for (size_t i=0; i<s.vars.size(); i++) {
+				if (i > 0) vars << ", ";
+				vars << r->GetXVarName(s.vars[i]);
+			}
+			slog << "      " << vars << "\n"; cnt++;
+		}
+	}
+	
 	if (m_output2) {
 		slog << "\n"; cnt++;
 		slog << "COEFFICIENTS VARIANCE MATRIX\n"; cnt++;
@@ -1255,20 +1485,31 @@ void RegressionDlg::printAndShowClassicalResults(const wxString& datasetname,
 		}
 	}
 	
-	if (m_output1) {
+	if (m_output1 && r->GetResidual()) {
 		slog << "\n"; cnt++;
 		slog << "  OBS    " << GenUtils::Pad(m_dependent->GetValue(), 12);
 		slog << "        PREDICTED        RESIDUAL\n"; cnt++;
 		double *res = r->GetResidual();
 		double *yh = r->GetYHAT();
 		for (int i=0; i<m_obs; i++) {
+			// y is not copied when the table was streamed
 			slog << wxString::Format("%5d     %12.5f    %12.5f    %12.5f\n",
-									 i+1, y[i], yh[i], res[i]); cnt++;
+									 i+1, y ? y[i] : yh[i] + res[i],
+									 yh[i], res[i]); cnt++;
 		}
 		res = NULL;
 		yh = NULL;
 	}
 	
+	if (r->GetTimingCount() > 0) {
+		slog << "\n"; cnt++;
+		slog << "DIAGNOSTIC TIMINGS (ms)\n"; cnt++;
+		for (int i=0; i<r->GetTimingCount(); i++) {
+			slog << GenUtils::Pad(r->GetTimingName(i), 36, false);
+			slog << wxString::Format("%10ld\n", r->GetTimingMs(i)); cnt++;
+		}
+	}
+	
 	slog << "============================== END OF REPORT";
 	slog <<  " ================================\n\n"; cnt++; cnt++;
 	
@@ -1321,6 +1562,31 @@ void RegressionDlg::printAndShowLagResults(const wxString& datasetname,
 	f = "S.E of regression   :%12.6g";
 	slog << wxString::Format(f, sqrt(r->GetSIQ_SQ()));
 	slog << "\n\n"; cnt++; cnt++;
+	if (r->GetCholeskyFactorSize() > 0) {
+		f = "Log-Jacobian        : sparse Cholesky, %ld nonzeros\n"; cnt++;
+		slog << wxString::Format(f, r->GetCholeskyFactorSize());
+	}
+	if (r->IsCholeskyAsymmetric()) {
+		slog << "Log-Jacobian        : weights not symmetric, ";
+		slog << "sparse Cholesky not used\n"; cnt++;
+	}
+	if (r->GetApproxLogDetProbes() > 0) {
+		f = "Approximate ML      : %3d series terms, %d / %d probes\n"; cnt++;
+		slog << wxString::Format(f, r->GetApproxSeriesOrder(),
+								 r->GetApproxLogDetProbes(),
+								 r->GetApproxTraceProbes());
+		f = "Log lik. std. error :%12.6g  Series truncation bound:%12.6g\n";
+		cnt++;
+		slog << wxString::Format(f, r->GetApproxLIKStdError(),
+								 r->GetApproxLIKTruncation());
+		if (r->IsApproxTruncationHigh()) {
+			f = "Warning: series truncation bound above tolerance at %d terms\n";
+			cnt++;
+			slog << wxString::Format(f, r->GetApproxSeriesOrder());
+		}
+		f = "Trace rel. std. err.:%12.6g\n\n"; cnt++; cnt++;
+		slog << wxString::Format(f, r->GetApproxTraceRelError());
+	}
 	
 	slog << "----------------------------------------";
 	slog << "-------------------------------------\n"; cnt++;
@@ -1447,6 +1713,31 @@ void RegressionDlg::printAndShowErrorResults(const wxString& datasetname,
 	slog << wxString::Format(f, r->GetSIQ_SQ(), r->GetAIC());
 	f = "S.E of regression   :%12.6g  Schwarz criterion     :%12.6g\n\n"; cnt++; cnt++;
 	slog << wxString::Format(f, sqrt(r->GetSIQ_SQ()), r->GetOLS_SC());
+	if (r->GetCholeskyFactorSize() > 0) {
+		f = "Log-Jacobian        : sparse Cholesky, %ld nonzeros\n"; cnt++;
+		slog << wxString::Format(f, r->GetCholeskyFactorSize());
+	}
+	if (r->IsCholeskyAsymmetric()) {
+		slog << "Log-Jacobian        : weights not symmetric, ";
+		slog << "sparse Cholesky not used\n"; cnt++;
+	}
+	if (r->GetApproxLogDetProbes() > 0) {
+		f = "Approximate ML      : %3d series terms, %d / %d probes\n"; cnt++;
+		slog << wxString::Format(f, r->GetApproxSeriesOrder(),
+								 r->GetApproxLogDetProbes(),
+								 r->GetApproxTraceProbes());
+		f = "Log lik. std. error :%12.6g  Series truncation bound:%12.6g\n";
+		cnt++;
+		slog << wxString::Format(f, r->GetApproxLIKStdError(),
+								 r->GetApproxLIKTruncation());
+		if (r->IsApproxTruncationHigh()) {
+			f = "Warning: series truncation bound above tolerance at %d terms\n";
+			cnt++;
+			slog << wxString::Format(f, r->GetApproxSeriesOrder());
+		}
+		f = "Trace rel. std. err.:%12.6g\n\n"; cnt++; cnt++;
+		slog << wxString::Format(f, r->GetApproxTraceRelError());
+	}
 	
 	slog << "----------------------------------------";
 	slog << "-------------------------------------\n"; cnt++;
@@ -1542,6 +1833,8 @@ void RegressionDlg::OnCRadio1Selected( wxCommandEvent& event )
 	UpdateMessageBox(" ");
     EnablingItems();
 	m_white_test_cb->Enable(true);
+	m_batch_cb->Enable(true);
+	UpdateStreamItems();
 	m_gauge->SetValue(0);
 }
 
@@ -1552,6 +1845,9 @@ void RegressionDlg::OnCRadio2Selected( wxCommandEvent& event )
 	UpdateMessageBox(" ");
     EnablingItems();
 	m_white_test_cb->Enable(false);
+	m_batch_cb->Enable(false);
+	m_stream_cb->Enable(false);
+	m_spill_cb->Enable(false);
 	m_gauge->SetValue(0);
 }
 
@@ -1562,6 +1858,9 @@ void RegressionDlg::OnCRadio3Selected( wxCommandEvent& event )
 	UpdateMessageBox(" ");
     EnablingItems();
 	m_white_test_cb->Enable(false);
+	m_batch_cb->Enable(false);
+	m_stream_cb->Enable(false);
+	m_spill_cb->Enable(false);
 	m_gauge->SetValue(0);
 }
 
@@ -1572,9 +1871,44 @@ void RegressionDlg::OnCRadio4Selected( wxCommandEvent& event )
 	UpdateMessageBox(" ");
     EnablingItems();
 	m_white_test_cb->Enable(false);
+	m_batch_cb->Enable(false);
+	m_stream_cb->Enable(false);
+	m_spill_cb->Enable(false);
 	m_gauge->SetValue(0);
 }
 
+void RegressionDlg::OnApproxMlCbClick( wxCommandEvent& event )
+{
+	m_approx_probes_spin->Enable(m_approx_ml_cb->GetValue());
+}
+
+void RegressionDlg::OnStreamCbClick( wxCommandEvent& event )
+{
+	UpdateStreamItems();
+}
+
+/** Streaming is only done for the classic model without weights, and
+ computes neither White's test nor the subset comparison, so these are
+ unchecked and disabled while Stream Table is on.  Results can only go to
+ the table when it is streamed. */
+void RegressionDlg::UpdateStreamItems()
+{
+	if (RegressModel != 1) return;
+	const bool can_stream = !m_CheckWeight->GetValue();
+	if (!can_stream) m_stream_cb->SetValue(false);
+	const bool stream = m_stream_cb->GetValue();
+	if (stream) {
+		m_white_test_cb->SetValue(false);
+		m_batch_cb->SetValue(false);
+	} else {
+		m_spill_cb->SetValue(false);
+	}
+	m_stream_cb->Enable(can_stream);
+	m_white_test_cb->Enable(!stream);
+	m_batch_cb->Enable(!stream);
+	m_spill_cb->Enable(stream);
+}
+
 void RegressionDlg::OnStandardizeClick( wxCommandEvent& event )
 {
 	wxMessageBox("row standardization is by default");
@@ -26,6 +26,7 @@
 #include <wx/checkbox.h>
 #include <wx/textctrl.h>
 #include <wx/radiobut.h>
+#include <wx/spinctrl.h>
 #include <wx/gauge.h>
 #include <wx/stattext.h>
 #include "../FramesManagerObserver.h"
@@ -68,6 +69,8 @@ public:
 	void OnSaveToTxtFileClick( wxCommandEvent& event );
     void OnStandardizeClick( wxCommandEvent& event );
 	void OnPredValCbClick( wxCommandEvent& event );
+	void OnApproxMlCbClick( wxCommandEvent& event );
+	void OnStreamCbClick( wxCommandEvent& event );
 	void OnCoefVarMatrixCbClick( wxCommandEvent& event );
     void OnCListVarinDoubleClicked( wxCommandEvent& event );
     void OnCListVaroutDoubleClicked( wxCommandEvent& event );
@@ -127,6 +130,12 @@ public:
 	wxCheckBox* m_pred_val_cb;
 	wxCheckBox* m_coef_var_matrix_cb;
 	wxCheckBox* m_white_test_cb;
+	wxCheckBox* m_approx_ml_cb;
+	wxSpinCtrl* m_approx_probes_spin; // probe budget of Approx. ML
+	wxCheckBox* m_sparse_chol_cb;
+	wxCheckBox* m_batch_cb;
+	wxCheckBox* m_stream_cb;
+	wxCheckBox* m_spill_cb;
 	int			lastSelection;
 	int			nVarName;
 	double		*m_resid1, *m_yhat1;
@@ -149,6 +158,7 @@ public:
 	
 	void InitVariableList();
 	void EnablingItems();
+	void UpdateStreamItems();
 	void InitWeightsList();
 	boost::uuids::uuid GetWeightsId();
 
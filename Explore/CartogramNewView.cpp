@@ -22,6 +22,7 @@
 #include <iostream>
 #include <set>
 #include <sstream>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <wx/msgdlg.h>
 #include <wx/splitter.h>
@@ -40,47 +41,6 @@
 #include "../ShapeOperations/VoronoiUtils.h"
 #include "CartogramNewView.h"
 
-DorlingCartWorkerThread::DorlingCartWorkerThread(int iters_s,
-								DorlingCartogram* cart_s,
-								wxMutex* worker_list_mutex_s,
-								wxCondition* worker_list_empty_cond_s,
-								std::list<wxThread*> *worker_list_s,
-								int thread_id_s)
-: wxThread(),
-iters(iters_s), cart(cart_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-DorlingCartWorkerThread::~DorlingCartWorkerThread()
-{
-}
-
-wxThread::ExitCode DorlingCartWorkerThread::Entry()
-{
-	LOG_MSG(wxString::Format("DorlingCartWorkerThread %d started", thread_id));
-	
-	// improve by given number iterations
-	cart->improve(iters);
-	
-	wxMutexLocker lock(*worker_list_mutex);
-	// remove ourself from the list
-	worker_list->remove(this);
-	// if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	LOG_MSG(wxString::Format("DorlingCartWorkerThread %d finished", thread_id));
-	if (worker_list->empty()) {
-		LOG_MSG("worker_list is empty, so signaling main thread");
-		worker_list_empty_cond->Signal();
-	}
-	
-	return NULL;
-}
-
-
 IMPLEMENT_CLASS(CartogramNewCanvas, TemplateCanvas)
 BEGIN_EVENT_TABLE(CartogramNewCanvas, TemplateCanvas)
 	EVT_PAINT(TemplateCanvas::OnPaint)
@@ -862,7 +822,8 @@ void CartogramNewCanvas::ImproveAll(double max_seconds, int max_iters)
 	
 	// must decide on work-batch units for available CPUs.
 	// if num_time_periods <= nCPUs then each cpu gets one job
-	// otherwise, we have to spawn multiple rounds of multiple threads
+	// otherwise, the task pool works through about GetNumBatches()
+	// cartograms per cpu
 	
 	// We must first pre-calculate time estimate to do max_iters
 	// if time_max_iters > max_seconds, then linearly scale back
@@ -892,68 +853,14 @@ void CartogramNewCanvas::ImproveAll(double max_seconds, int max_iters)
 	LOG(iters);
 	for (int r=0; r<update_rounds; r++) {
 		LOG_MSG(wxString::Format("update round %d of %d", r+1, update_rounds));
-		int num_carts_rem = GetCurNumCartTms();
-		int crt_min_tm = var_info[RAD_VAR].time_min;		
-		for (int i=0; i<num_batches && num_carts_rem > 0; i++) {
-			LOG_MSG(wxString::Format("batch %d of %d:", i+1, num_batches));
-			int num_in_batch = GenUtils::min<int>(num_cpus, num_carts_rem);
-			LOG_MSG(wxString::Format("  improving carts %d to %d",
-									 crt_min_tm, crt_min_tm + (num_in_batch-1)));
-		
-			if (num_in_batch > 1) {
-				// mutext protects access to the worker_list
-				wxMutex worker_list_mutex;
-				// signals that worker_list is empty
-				wxCondition worker_list_empty_cond(worker_list_mutex);
-				worker_list_mutex.Lock(); // mutex should be initially locked
-			
-				// List of all the threads currently alive.  As soon as the
-				// thread terminates, it removes itself from the list.
-				std::list<wxThread*> worker_list;
-				int thread_id = 0;
-				for (int t=crt_min_tm; t<crt_min_tm+num_in_batch; t++) {
-					LOG_MSG(wxString::Format("    creating thread for cart %d",
-											 t)); 
-					DorlingCartWorkerThread* thread =
-						new DorlingCartWorkerThread(iters, carts[t],
-													&worker_list_mutex,
-													&worker_list_empty_cond,
-													&worker_list, thread_id++);
-					if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-						LOG_MSG("Error: Can't create thread, switching to "
-								"single thread mode!");
-						delete thread;
-						num_cpus = 1;
-						ImproveAll(max_seconds, max_iters);
-						return;
-					} else {
-						worker_list.push_front(thread);
-					}
-					num_improvement_iters[t] += iters;
-				}
-			
-				LOG_MSG("Starting all worker threads");
-				std::list<wxThread*>::iterator it;
-				for (it = worker_list.begin(); it != worker_list.end(); it++) {
-					(*it)->Run();
-				}
-			
-				while (!worker_list.empty()) {
-					// wait until thread_list might be empty
-					worker_list_empty_cond.Wait();
-					// We have been woken up. If this was not a false
-					// alarm (spurious signal), the loop will exit.
-					LOG_MSG("work_list_empty_cond signaled");
-				}
-				LOG_MSG("All worker threads exited");
-			
-			} else {
-				carts[crt_min_tm]->improve(iters);
-				num_improvement_iters[crt_min_tm] += iters;
-			}
-		
-			num_carts_rem -= num_in_batch;
-			crt_min_tm += num_in_batch;
+		int crt_min_tm = var_info[RAD_VAR].time_min;
+		int num_carts = GetCurNumCartTms();
+		// one task per cartogram, shared out over the task pool
+		GenUtils::RunTasks(num_carts,
+						   boost::bind(&CartogramNewCanvas::ImproveRange, this,
+									   crt_min_tm, iters, _1, _2), 1);
+		for (int t=crt_min_tm; t<crt_min_tm+num_carts; t++) {
+			num_improvement_iters[t] += iters;
 		}
 		if (update_rounds > 1 && realtime_updates) {
 			full_map_redraw_needed = true;
@@ -972,6 +879,14 @@ void CartogramNewCanvas::ImproveAll(double max_seconds, int max_iters)
 	LOG_MSG("Exiting CartogramNewCanvas::ImproveAll");
 }
 
+/** Improve the cartograms of time periods tm_min+first to tm_min+last by
+ iters iterations each. */
+void CartogramNewCanvas::ImproveRange(int tm_min, int iters,
+									  size_t first, size_t last)
+{
+	for (size_t i=first; i<=last; i++) carts[tm_min+i]->improve(iters);
+}
+
 int CartogramNewCanvas::GetCurNumCartTms()
 {
 	return 1 + var_info[RAD_VAR].time_max - var_info[RAD_VAR].time_min;
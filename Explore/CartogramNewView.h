@@ -38,27 +38,6 @@ class TableInterface;
 class GalWeight;
 typedef boost::multi_array<double, 2> d_array_type;
 
-class DorlingCartWorkerThread : public wxThread
-{
-public:
-	DorlingCartWorkerThread(int iters, DorlingCartogram* cart,
-							wxMutex* worker_list_mutex,
-							wxCondition* worker_list_empty_cond,
-							std::list<wxThread*> *worker_list,
-							int thread_id);
-	virtual ~DorlingCartWorkerThread();
-	virtual void* Entry();  // thread execution starts here
-	
-	int thread_id;
-	
-	int iters;
-	DorlingCartogram* cart;
-	
-	wxMutex* worker_list_mutex;
-	wxCondition* worker_list_empty_cond;
-	std::list<wxThread*> *worker_list;
-};
-
 class CartogramNewCanvas : public TemplateCanvas, public CatClassifStateObserver
 {
 	DECLARE_CLASS(CartogramNewCanvas)
@@ -116,6 +95,7 @@ protected:
 	// Data and functions for individual cartogram maps
 	
 	void ImproveAll(double max_seconds, int max_iters);
+	void ImproveRange(int tm_min, int iters, size_t first, size_t last);
 	int EstItersGivenTime(double max_seconds);
 	double EstSecondsGivenIters(int max_iters);
 	bool realtime_updates;
@@ -22,12 +22,14 @@
 #include <algorithm>
 #include <functional>
 #include <map>
+#include <boost/bind.hpp>
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
 #include "../DataViewer/TableInterface.h"
 #include "../ShapeOperations/Randik.h"
 #include "../ShapeOperations/WeightsManState.h"
 #include "../VarCalc/WeightsManInterface.h"
+#include "../GenUtils.h"
 #include "../logger.h"
 #include "../Project.h"
 #include "GetisOrdMapNewView.h"
@@ -80,66 +82,27 @@
  */
 
 
-GStatWorkerThread::GStatWorkerThread(int obs_start_s, int obs_end_s,
-									 uint64_t	seed_start_s,
-									 GStatCoordinator* gstat_coord_s,
-									 wxMutex* worker_list_mutex_s,
-									 wxCondition* worker_list_empty_cond_s,
-									 std::list<wxThread*> *worker_list_s,
-									 int thread_id_s)
-: wxThread(),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
-gstat_coord(gstat_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-GStatWorkerThread::~GStatWorkerThread()
-{
-}
-
-wxThread::ExitCode GStatWorkerThread::Entry()
-{
-	LOG_MSG(wxString::Format("GStatWorkerThread %d started", thread_id));
-	
-	// call work for assigned range of observations
-	gstat_coord->CalcPseudoP_range(obs_start, obs_end, seed_start);
-	
-	wxMutexLocker lock(*worker_list_mutex);
-	// remove ourself from the list
-	worker_list->remove(this);
-	// if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	LOG_MSG(wxString::Format("GStatWorkerThread %d finished", thread_id));
-	if (worker_list->empty()) {
-		LOG_MSG("worker_list is empty, so signaling main thread");
-		worker_list_empty_cond->Signal();
-	}
-	
-	return NULL;
-}
-
-
 GStatCoordinator::GStatCoordinator(boost::uuids::uuid weights_id,
 								   Project* project,
 								   const std::vector<GdaVarTools::VarInfo>& var_info_s,
 								   const std::vector<int>& col_ids,
-								   bool row_standardize_weights)
+								   bool row_standardize_weights,
+								   bool calc_significances_s)
 : w_man_state(project->GetWManState()),
 w_man_int(project->GetWManInt()),
+project(project),
 w_id(weights_id),
 num_obs(project->GetNumRecords()),
 row_standardize(row_standardize_weights),
+calc_significances(calc_significances_s),
 permutations(999),
 var_info(var_info_s),
 data(var_info_s.size()),
-last_seed_used(0), reuse_last_seed(false)
+last_seed_used(0), reuse_last_seed(false), early_stop_perms(false)
 {
 	GalWeight* gw = w_man_int->GetGal(w_id);
 	W = (gw ? gw->gal : 0);
+	W_csr = (gw ? &gw->GetCsr() : 0);
 	weight_name = w_man_int->GetLongDispName(w_id);
 	SetSignificanceFilter(1);
 	TableInterface* table_int = project->GetTableInt();
@@ -155,6 +118,26 @@ last_seed_used(0), reuse_last_seed(false)
 	w_man_state->registerObserver(this);
 }
 
+std::vector<GStatCoordinator*> GStatCoordinator::CreateBatch(
+					boost::uuids::uuid weights_id, Project* project,
+					const std::vector<std::vector<GdaVarTools::VarInfo> >& var_infos,
+					const std::vector<std::vector<int> >& col_ids,
+					bool row_standardize_weights)
+{
+	std::vector<GStatCoordinator*> batch(var_infos.size());
+	std::vector<GStatCoordinator*> not_cached;
+	for (size_t i=0; i<var_infos.size(); i++) {
+		// significances are left to CalcPseudoPBatch below
+		batch[i] = new GStatCoordinator(weights_id, project, var_infos[i],
+										col_ids[i], row_standardize_weights,
+										false);
+		batch[i]->calc_significances = true;
+		if (!batch[i]->LoadFromCache()) not_cached.push_back(batch[i]);
+	}
+	CalcPseudoPBatch(not_cached);
+	return batch;
+}
+
 GStatCoordinator::~GStatCoordinator()
 {
 	LOG_MSG("In GStatCoordinator::~GStatCoordinator");
@@ -203,6 +186,11 @@ void GStatCoordinator::DeallocateVectors()
 	}
 	pseudo_p_star_vecs.clear();
 	
+	for (int i=0; i<perms_used_vecs.size(); i++) {
+		if (perms_used_vecs[i]) delete [] perms_used_vecs[i];
+	}
+	perms_used_vecs.clear();
+	
 	for (int i=0; i<x_vecs.size(); i++) if (x_vecs[i]) delete [] x_vecs[i];
 	x_vecs.clear();
 }
@@ -220,6 +208,7 @@ void GStatCoordinator::AllocateVectors()
 	p_star_vecs.resize(tms);
 	pseudo_p_vecs.resize(tms);
 	pseudo_p_star_vecs.resize(tms);
+	perms_used_vecs.resize(tms);
 	x_vecs.resize(tms);
 	
 	n.resize(tms, 0);
@@ -247,6 +236,8 @@ void GStatCoordinator::AllocateVectors()
 		p_star_vecs[i] = new double[num_obs];
 		pseudo_p_vecs[i] = new double[num_obs];
 		pseudo_p_star_vecs[i] = new double[num_obs];
+		perms_used_vecs[i] = new int[num_obs];
+		for (int j=0; j<num_obs; j++) perms_used_vecs[i][j] = 0;
 		x_vecs[i] = new double[num_obs];
 		
 		map_valid[i] = true;
@@ -282,7 +273,7 @@ void GStatCoordinator::InitFromVarInfo()
 	for (int t=0; t<num_time_vals; t++) {
 		x = x_vecs[t];
 		for (int i=0; i<num_obs; i++) {
-			if ( W[i].Size() > 0 ) {
+			if ( W_csr->Size(i) > 0 ) {
 				n[t]++;
 				x_star[t] += x[i];
 				x_sstar[t] += x[i] * x[i];
@@ -300,8 +291,99 @@ void GStatCoordinator::InitFromVarInfo()
 		sdGstar[t] = sqrt(VarGstar[t]);		
 	}
 	
+	// results of an earlier session on the same data are read back
+	if (calc_significances && LoadFromCache()) return;
 	CalcGs();
-	CalcPseudoP();
+	if (calc_significances) CalcPseudoP();
+}
+
+uint64_t GStatCoordinator::CacheKey() const
+{
+	int params[] = { row_standardize, permutations, early_stop_perms,
+		reuse_last_seed, num_obs, num_time_vals };
+	uint64_t h = Gda::HashBytes("GStatCoordinator", 16);
+	h = Gda::HashBytes(params, sizeof(params), h);
+	if (reuse_last_seed) {
+		h = Gda::HashBytes(&last_seed_used, sizeof(last_seed_used), h);
+	}
+	uint64_t w_hash = W_csr->Hash();
+	h = Gda::HashBytes(&w_hash, sizeof(w_hash), h);
+	for (int t=0; t<x_vecs.size(); t++) {
+		h = Gda::HashBytes(x_vecs[t], num_obs*sizeof(double), h);
+	}
+	return h;
+}
+
+bool GStatCoordinator::LoadFromCache()
+{
+	Gda::ResultCache cache(project->GetProjectFullPath(), CacheKey());
+	if (!cache.Load()) return false;
+	const size_t d_sz = num_obs*sizeof(double);
+	const size_t b_sz = num_obs*sizeof(bool);
+	const size_t i_sz = num_obs*sizeof(int);
+	uint64_t seed = 0;
+	std::vector<char> flags(2*num_time_vals);
+	// the layout of SaveToCache is checked first, so that a damaged file
+	// leaves all arrays as they were
+	std::vector<size_t> sizes;
+	sizes.push_back(sizeof(seed));
+	sizes.push_back(flags.size());
+	for (int t=0; t<num_time_vals; t++) {
+		size_t t_sizes[] = { d_sz, b_sz, d_sz, d_sz, d_sz, d_sz, d_sz, d_sz,
+			d_sz, i_sz };
+		sizes.insert(sizes.end(), t_sizes, t_sizes+10);
+	}
+	if (!cache.Fits(sizes)) return false;
+	cache.Get(&seed, sizeof(seed));
+	cache.Get(&flags[0], flags.size());
+	for (int t=0; t<num_time_vals; t++) {
+		cache.Get(G_vecs[t], d_sz);
+		cache.Get(G_defined_vecs[t], b_sz);
+		cache.Get(G_star_vecs[t], d_sz);
+		cache.Get(z_vecs[t], d_sz);
+		cache.Get(p_vecs[t], d_sz);
+		cache.Get(z_star_vecs[t], d_sz);
+		cache.Get(p_star_vecs[t], d_sz);
+		cache.Get(pseudo_p_vecs[t], d_sz);
+		cache.Get(pseudo_p_star_vecs[t], d_sz);
+		cache.Get(perms_used_vecs[t], i_sz);
+	}
+	last_seed_used = seed;
+	for (int t=0; t<num_time_vals; t++) {
+		has_isolates[t] = flags[2*t];
+		has_undefined[t] = flags[2*t+1];
+	}
+	wxString m;
+	m << "GStat results restored from cache. Last seed used: " << seed;
+	LOG_MSG(m);
+	return true;
+}
+
+void GStatCoordinator::SaveToCache()
+{
+	Gda::ResultCache cache(project->GetProjectFullPath(), CacheKey());
+	if (!cache.IsOk()) return;
+	const size_t d_sz = num_obs*sizeof(double);
+	std::vector<char> flags(2*num_time_vals);
+	for (int t=0; t<num_time_vals; t++) {
+		flags[2*t] = has_isolates[t];
+		flags[2*t+1] = has_undefined[t];
+	}
+	cache.Put(&last_seed_used, sizeof(last_seed_used));
+	cache.Put(&flags[0], flags.size());
+	for (int t=0; t<num_time_vals; t++) {
+		cache.Put(G_vecs[t], d_sz);
+		cache.Put(G_defined_vecs[t], num_obs*sizeof(bool));
+		cache.Put(G_star_vecs[t], d_sz);
+		cache.Put(z_vecs[t], d_sz);
+		cache.Put(p_vecs[t], d_sz);
+		cache.Put(z_star_vecs[t], d_sz);
+		cache.Put(p_star_vecs[t], d_sz);
+		cache.Put(pseudo_p_vecs[t], d_sz);
+		cache.Put(pseudo_p_star_vecs[t], d_sz);
+		cache.Put(perms_used_vecs[t], num_obs*sizeof(int));
+	}
+	if (!cache.Save()) LOG_MSG("Could not save GStat results to the cache");
 }
 
 /** Update Secondary Attributes based on Primary Attributes.
@@ -347,7 +429,7 @@ void GStatCoordinator::FillClusterCats(int canvas_time,
 	
 	c_val.resize(num_obs);
 	for (int i=0; i<num_obs; i++) {
-		if (W[i].Size() == 0) {
+		if (W_csr->Size(i) == 0) {
 			c_val[i] = 3; // isolate
 		} else if (!G_defined_vecs[t][i]) {
 			c_val[i] = 4; // undefined
@@ -360,14 +442,20 @@ void GStatCoordinator::FillClusterCats(int canvas_time,
 }
 
 
-/** Initialize Gi and Gi_star.  We handle either binary or row-standardized
- binary weights.  Weights with self-neighbors are handled correctly. */
+/** Initialize Gi and Gi_star.  Binary or row-standardized binary weights
+ use the formulas below.  Other weights, such as inverse distance or kernel
+ weights, use the general moments of Getis and Ord (1992), in which
+ W_i*(n-1-W_i) becomes (n-1)*S1_i - W_i^2 with S1_i the sum of the squared
+ weights.  Weights with self-neighbors are handled correctly. */
 void GStatCoordinator::CalcGs()
 {
 	using boost::math::normal; // typedef provides default type is double.
 	// Construct a standard normal distribution std_norm_dist
 	normal std_norm_dist; // default mean = zero, and s.d. = unity
 	
+	const bool weighted = !W_csr->IsBinary();
+	std::vector<long> nbr_buf(GenUtils::max<long>(W_csr->MaxSize(), 1));
+	std::vector<double> w_buf(nbr_buf.size());
 	for (int t=0; t<num_time_vals; t++) {
 		G = G_vecs[t];
 		G_defined = G_defined_vecs[t];
@@ -385,21 +473,37 @@ void GStatCoordinator::CalcGs()
 
 		double n_expr = sqrt((n[t]-1)*(n[t]-1)*(n[t]-2));
 		for (long i=0; i<num_obs; i++) {
-			const GalElement& elm_i = W[i];
-			if ( elm_i.Size() > 0 ) {
+			const long* nbr_i = W_csr->Nbrs(i);
+			const long sz_i = W_csr->Size(i);
+			if ( sz_i > 0 ) {
 				double lag = 0;
-				bool self_neighbor = false;
-				for (size_t j=0, sz=W[i].Size(); j<sz; j++) {
-					if (elm_i[j] != i) {
-						lag += x[elm_i[j]];
-					} else {
-						self_neighbor = true;
+				double Wi = 0;
+				double var_w = 0; // Wi*(n-1-Wi) for binary weights
+				if (weighted) {
+					double star_scale, self_w, S1i = 0;
+					int k = GiWeights(i, &nbr_buf[0], &w_buf[0], star_scale,
+									  self_w);
+					for (int j=0; j<k; j++) {
+						lag += x[nbr_buf[j]] * w_buf[j];
+						Wi += w_buf[j];
+						S1i += w_buf[j] * w_buf[j];
 					}
-				}
-				double Wi = self_neighbor ? W[i].Size()-1 : W[i].Size();
-				if (row_standardize) {
-					lag /= elm_i.Size();
-					Wi /= elm_i.Size();
+					var_w = (n[t]-1)*S1i - Wi*Wi;
+				} else {
+					bool self_neighbor = false;
+					for (long j=0; j<sz_i; j++) {
+						if (nbr_i[j] != i) {
+							lag += x[nbr_i[j]];
+						} else {
+							self_neighbor = true;
+						}
+					}
+					Wi = self_neighbor ? sz_i-1 : sz_i;
+					if (row_standardize) {
+						lag /= sz_i;
+						Wi /= sz_i;
+					}
+					var_w = Wi*(n[t]-1-Wi);
 				}
 				double xd_i = x_star[t] - x[i];
 				if (xd_i != 0) {
@@ -413,7 +517,7 @@ void GStatCoordinator::CalcGs()
 				// location-specific variance
 				double ss_i = ((x_sstar[t] - x[i]*x[i])/(n[t]-1)
 							   - x_hat_i*x_hat_i);
-				double sdG_i = sqrt(Wi*(n[t]-1-Wi)*ss_i)/(n_expr * x_hat_i);
+				double sdG_i = sqrt(var_w*ss_i)/(n_expr * x_hat_i);
 				
 				// compute z and one-sided p-val from standard-normal table
 				if (G_defined[i]) {
@@ -437,15 +541,35 @@ void GStatCoordinator::CalcGs()
 			break;
 		}
 	
-		if (row_standardize) {
+		if (weighted) {
+			double n_expr_mean_x = n[t] * sqrt(n[t]-1) * mean_x[t];
 			for (long i=0; i<num_obs; i++) {
-				const GalElement& elm_i = W[i];
+				double star_scale, self_w;
+				int k = GiWeights(i, &nbr_buf[0], &w_buf[0], star_scale,
+								  self_w);
+				double lag = 0, Wi = 0, S1i = 0;
+				for (int j=0; j<k; j++) {
+					lag += x[nbr_buf[j]] * w_buf[j];
+					Wi += w_buf[j];
+					S1i += w_buf[j] * w_buf[j];
+				}
+				G_star[i] = (lag*star_scale + x[i]*self_w) / x_star[t];
+				double Wi_star = Wi*star_scale + self_w;
+				double S1i_star = S1i*star_scale*star_scale + self_w*self_w;
+				double ExGi_star = Wi_star/n[t];
+				double sdG_i_star = sqrt((n[t]*S1i_star - Wi_star*Wi_star)
+										 * var_x[t])/n_expr_mean_x;
+				z_star[i] = (G_star[i] - ExGi_star)/sdG_i_star;
+			}
+		} else if (row_standardize) {
+			for (long i=0; i<num_obs; i++) {
+				const long* nbr_i = W_csr->Nbrs(i);
 				double lag = 0;
 				bool self_neighbor = false;
-				int sz_i=W[i].Size();
+				int sz_i=W_csr->Size(i);
 				for (int j=0; j<sz_i; j++) {
-					if (elm_i[j] == i) self_neighbor = true;
-					lag += x[elm_i[j]];
+					if (nbr_i[j] == i) self_neighbor = true;
+					lag += x[nbr_i[j]];
 				}
 				G_star[i] = self_neighbor ? lag/(sz_i * x_star[t]) :
 					(lag+x[i])/((sz_i+1) * x_star[t]);
@@ -454,16 +578,16 @@ void GStatCoordinator::CalcGs()
 		} else { // binary weights
 			double n_expr_mean_x = n[t] * sqrt(n[t]-1) * mean_x[t];
 			for (long i=0; i<num_obs; i++) {
-				const GalElement& elm_i = W[i];
+				const long* nbr_i = W_csr->Nbrs(i);
 				double lag = 0;
 				bool self_neighbor = false;
-				for (int j=0, sz=elm_i.Size(); j<sz; j++) {
-					if (elm_i[j] == i) self_neighbor = true;
-					lag += x[elm_i[j]];
+				for (int j=0, sz=W_csr->Size(i); j<sz; j++) {
+					if (nbr_i[j] == i) self_neighbor = true;
+					lag += x[nbr_i[j]];
 				}
 				if (!self_neighbor) lag += x[i];
 				G_star[i] = lag / x_star[t];
-				double Wi = self_neighbor ? W[i].Size() : W[i].Size()+1;
+				double Wi = self_neighbor ? W_csr->Size(i) : W_csr->Size(i)+1;
 				// location-specific mean
 				double ExGi_star = Wi/n[t];
 				// location-specific variance
@@ -483,188 +607,181 @@ void GStatCoordinator::CalcGs()
 	}
 }
 
+int GStatCoordinator::GiWeights(long i, long* nbrs, double* w,
+								double& star_scale, double& self_w) const
+{
+	const long* nbr_i = W_csr->Nbrs(i);
+	const double* w_i = W_csr->Weights(i);
+	int k = 0;
+	double sum_w = 0;
+	double max_w = 0;
+	bool self_neighbor = false;
+	self_w = 0;
+	for (long j=0, sz=W_csr->Size(i); j<sz; j++) {
+		if (nbr_i[j] == i) {
+			self_neighbor = true;
+			self_w = w_i[j];
+			continue;
+		}
+		nbrs[k] = nbr_i[j];
+		w[k++] = w_i[j];
+		sum_w += w_i[j];
+		if (w_i[j] > max_w) max_w = w_i[j];
+	}
+	if (!self_neighbor) self_w = max_w;
+	star_scale = 1;
+	if (row_standardize) {
+		if (sum_w != 0) {
+			for (int j=0; j<k; j++) w[j] /= sum_w;
+		}
+		if (sum_w + self_w != 0) {
+			star_scale = sum_w / (sum_w + self_w);
+			self_w /= sum_w + self_w;
+		}
+	}
+	return k;
+}
+
 void GStatCoordinator::CalcPseudoP()
 {
 	LOG_MSG("Entering GStatCoordinator::CalcPseudoP");
+	if (!calc_significances) return;
 	wxStopWatch sw;
-	int nCPUs = wxThread::GetCPUCount();
 	
-	// To ensure thread safety, only work on one time slice of data
-	// at a time.  For each time period t:
-	// 1. copy data for time period t into data1 and data2 arrays
-	// 2. Perform multi-threaded computation
-	// 3. copy results into results array
-	
-	if (nCPUs <= 1) {
-		LOG_MSG(wxString::Format("%d threading cores detected "
-								 "so running single threaded", nCPUs));
-	} else {
-		LOG_MSG(wxString::Format("%d threading cores detected, "
-								 "running multi-threaded.", nCPUs));
-	}
-	
-	for (int t=0; t<num_time_vals; t++) {
-		LOG_MSG(wxString::Format("Calculating GStat significances for time "
-								 "period %d", t));
-
-		G = G_vecs[t];
-		G_defined = G_defined_vecs[t];
-		G_star = G_star_vecs[t];
-		z = z_vecs[t];
-		p = p_vecs[t];
-		z_star = z_star_vecs[t];
-		p_star = p_star_vecs[t];
-		pseudo_p = pseudo_p_vecs[t];
-		pseudo_p_star = pseudo_p_star_vecs[t];
-		x = x_vecs[t];
-		x_star_t = x_star[t];
-		
-		if (nCPUs <= 1) {
-			if (!reuse_last_seed) last_seed_used = time(0);
-			CalcPseudoP_range(0, num_obs-1, last_seed_used);
-		} else {
-			CalcPseudoP_threaded();
-		}
-	}
+	// All time periods in one pass of the shared task pool, as in
+	// LisaCoordinator::CalcPseudoP
+	if (!reuse_last_seed) last_seed_used = time(0);
+	perm_table.Init(num_obs, W_csr->MaxSize(), permutations, last_seed_used);
+	GenUtils::RunTasks((size_t) num_time_vals * num_obs,
+					   boost::bind(&GStatCoordinator::CalcPseudoP_tasks,
+								   this, _1, _2, last_seed_used));
+	perm_table.Clear();
+	SaveToCache();
 	{
 		wxString m;
 		m << "GStat on " << num_obs << " obs with " << permutations;
 		m << " perms over " << num_time_vals << " time periods took ";
 		m << sw.Time() << " ms. Last seed used: " << last_seed_used;
+		if (early_stop_perms) {
+			double tot_used = 0;
+			for (int t=0; t<num_time_vals; t++) {
+				for (int i=0; i<num_obs; i++) tot_used += perms_used_vecs[t][i];
+			}
+			m << ". Mean perms used: ";
+			m << tot_used / ((double) num_obs * num_time_vals);
+		}
 		LOG_MSG(m);
 	}
 	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP");
 }
 
-void GStatCoordinator::CalcPseudoP_threaded()
+/** Tasks first..last of CalcPseudoP, split at the time periods. */
+void GStatCoordinator::CalcPseudoP_tasks(size_t first, size_t last,
+										 uint64_t seed)
 {
-	LOG_MSG("Entering GStatCoordinator::CalcPseudoP_threaded");
-	int nCPUs = wxThread::GetCPUCount();
-	
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-	worker_list_mutex.Lock(); // mutex should be initially locked
-	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-	std::list<wxThread*> worker_list;
-	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
-	
-	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
-		wxString msg;
-		msg << "thread " << thread_id << ": " << a << "->" << b;
-		msg << ", seed: " << seed_start << "->" << seed_end;
-		LOG_MSG(msg);
-		
-		GStatWorkerThread* thread =
-			new GStatWorkerThread(a, b, seed_start, this,
-								  &worker_list_mutex,
-								  &worker_list_empty_cond,
-								  &worker_list, thread_id);
-		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-			LOG_MSG("Error: Can't create thread!");
-			delete thread;
-			is_thread_error = true;
-		} else {
-			worker_list.push_front(thread);
-		}
-	}
-	if (is_thread_error) {
-		LOG_MSG("Error: Could not spawn a worker thread, falling back "
-				"to single-threaded pseudo-p calculation.");
-		// fall back to single thread calculation mode
-		CalcPseudoP_range(0, num_obs-1, last_seed_used);
-	} else {
-		LOG_MSG("Starting all worker threads");
-		std::list<wxThread*>::iterator it;
-		for (it = worker_list.begin(); it != worker_list.end(); it++) {
-			(*it)->Run();
-		}
-		
-		while (!worker_list.empty()) {
-			// wait until thread_list might be empty
-			worker_list_empty_cond.Wait();
-			// We have been woken up. If this was not a false
-			// alarm (spurious signal), the loop will exit.
-			LOG_MSG("work_list_empty_cond signaled");
-		}
-		LOG_MSG("All worker threads exited");
+	while (first <= last) {
+		int t = first / num_obs;
+		size_t period_last = GenUtils::min(last, (size_t) (t+1)*num_obs - 1);
+		CalcPseudoP_range(t, first - (size_t) t*num_obs,
+						  period_last - (size_t) t*num_obs, seed);
+		first = period_last+1;
 	}
-	
-	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP_threaded");
 }
 
 /** In the code that computes Gi and Gi*, we specifically checked for 
  self-neighbors and handled the situation appropriately.  For the
  permutation code, we will disallow self-neighbors. */
-void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
-										 uint64_t seed_start)
+void GStatCoordinator::CalcPseudoP_range(int t, int obs_start, int obs_end,
+										 uint64_t seed)
 {
-	GeoDaSet workPermutation(num_obs);
-	//Randik rng;
+	// arrays of period t, several periods can be in progress at once
+	const double* x = x_vecs[t];
+	const double x_star_t = x_star[t];
+	const double* G = G_vecs[t];
+	const double* G_star = G_star_vecs[t];
+	const bool* G_defined = G_defined_vecs[t];
+	double* pseudo_p = pseudo_p_vecs[t];
+	double* pseudo_p_star = pseudo_p_star_vecs[t];
+	int* perms_used = perms_used_vecs[t];
+	
+	// the shared draws of perm_table are used whenever they were made,
+	// otherwise each observation draws its own neighbors
+	const bool use_table = !perm_table.IsEmpty();
+	// weights that are not binary are applied to the drawn values, see
+	// GiWeights
+	const bool weighted = !W_csr->IsBinary();
+	std::vector<long> nbr_buf(weighted ? GenUtils::max<long>(W_csr->MaxSize(),
+															 1) : 1);
+	std::vector<double> w_buf(nbr_buf.size());
+	GeoDaSet workPermutation(use_table ? 1 : num_obs);
 	//const int DBGI = 4;
 	//std::map<int,int> freq;
 	//for (int j=0; j<num_obs; j++) freq[j] = 0;
 	int max_rand = num_obs-1;
 	for (long i=obs_start; i<=obs_end; i++) {
-		const int numNeighsI = W[i].Size();
-		const double numNeighsD = W[i].Size();
+		const int numNeighsI = W_csr->Size(i);
+		const double numNeighsD = W_csr->Size(i);
 		if ( numNeighsI > 0 && G_defined[i]) { //only compute for non-isolates
 			double xd_i = x_star_t - x[i]; // know != 0 since G_defined[i] true
+			int numDraws = numNeighsI;
+			const double* w = 0;
+			double star_scale = 1;
+			double self_w = 0;
+			if (weighted) {
+				numDraws = GiWeights(i, &nbr_buf[0], &w_buf[0], star_scale,
+									 self_w);
+				w = &w_buf[0];
+			}
 			
 			int countGLarger = 0;
 			int countGStarLarger = 0;
 			double permutedG = 0;
 			double permutedGStar = 0;
+			int used = permutations;
+			double lags[Gda::PermTable::block_size];
 			for (int perm=0; perm<permutations; perm++) {
-				int rand = 0;
-				while (rand < numNeighsI) {
-					// computing 'perfect' permutation of given size
-					//int newRandom = (int) (rng.fValue() * max_rand);
-					int newRandom = (int) (Gda::ThomasWangHashDouble(seed_start++)
-										   * max_rand);
-					//int newRandom = X(rng);
-					if (newRandom != i && !workPermutation.Belongs(newRandom))
-					{
-						//if (i == DBGI) freq[newRandom]++;
-						//if (i == DBGI && perm < 20) m << newRandom << " ";
-						workPermutation.Push(newRandom);
-						rand++;
-					}
-				}
-				
 				double lag_i=0;
 				// use permutation to compute the lags
-				for (int j=0; j<numNeighsI; j++) {
-					lag_i += x[workPermutation.Pop()];
+				if (use_table) {
+					// the lags of a whole block of permutations are
+					// gathered at once
+					const int b = perm % Gda::PermTable::block_size;
+					if (b == 0) {
+						perm_table.LagSums(x, i, numDraws, w, perm,
+										   GenUtils::min<int>(permutations-perm,
+												Gda::PermTable::block_size),
+										   lags);
+					}
+					lag_i = lags[b];
+				} else {
+					// random stream of this observation and permutation only
+					Gda::CounterRng rng(seed, i, perm);
+					int rand = 0;
+					while (rand < numDraws) {
+						// computing 'perfect' permutation of given size,
+						// skipping over i itself
+						int newRandom = Gda::PermTable::Shift(
+								(int) (rng.NextDouble() * max_rand), i);
+						if (!workPermutation.Belongs(newRandom)) {
+							//if (i == DBGI) freq[newRandom]++;
+							workPermutation.Push(newRandom);
+							rand++;
+						}
+					}
+					for (int j=0; j<numDraws; j++) {
+						if (w) {
+							lag_i += x[workPermutation.Pop()] * w[j];
+						} else {
+							lag_i += x[workPermutation.Pop()];
+						}
+					}
 				}
 				
-				if (row_standardize) {
+				if (w) {
+					// the weights are row-standardized already if need be
+					permutedG = lag_i / xd_i;
+					permutedGStar = (lag_i*star_scale + x[i]*self_w) / x_star_t;
+				} else if (row_standardize) {
 					permutedG = lag_i / (numNeighsD * xd_i);
 					permutedGStar = (lag_i+x[i]) / ((numNeighsD+1)*x_star_t);	
 				} else { // binary weights
@@ -684,6 +801,13 @@ void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
 				
 				if (permutedG >= G[i]) countGLarger++;
 				if (permutedGStar >= G_star[i]) countGStarLarger++;
+				if (early_stop_perms &&
+					Gda::PermTestDecided(countGLarger, perm+1, permutations) &&
+					Gda::PermTestDecided(countGStarLarger, perm+1,
+										 permutations)) {
+					used = perm+1;
+					break;
+				}
 			}
 			//if (i == DBGI) {
 			//	for (int j=0; j<num_obs; j++) LOG(freq[j]);
@@ -692,21 +816,221 @@ void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
 			//	LOG(permutations);
 			//}
 			// pick the smallest
-			if (permutations-countGLarger < countGLarger) { 
-				countGLarger=permutations-countGLarger;
+			if (used-countGLarger < countGLarger) {
+				countGLarger=used-countGLarger;
 			}
-			pseudo_p[i] = (countGLarger + 1.0)/(permutations+1.0);
+			pseudo_p[i] = (countGLarger + 1.0)/(used+1.0);
 			//if (i == DBGI) LOG(pseudo_p[i]);
 			
-			if (permutations-countGStarLarger < countGStarLarger) { 
-				countGStarLarger=permutations-countGStarLarger;
+			if (used-countGStarLarger < countGStarLarger) {
+				countGStarLarger=used-countGStarLarger;
 			}
-			pseudo_p_star[i] = (countGStarLarger + 1.0)/(permutations+1.0);
+			pseudo_p_star[i] = (countGStarLarger + 1.0)/(used+1.0);
 			//if (i == DBGI) LOG(pseudo_p_star[i]);
+			perms_used[i] = used;
 		}
 	}
 }
 
+namespace {
+/** One variable in one time period of a CalcPseudoPBatch pass. */
+struct GStatBatchCol {
+	const double* x;
+	double x_star_t;
+	const double* G;
+	const double* G_star;
+	const bool* G_defined;
+	double* pseudo_p;
+	double* pseudo_p_star;
+	int* perms_used;
+	bool row_standardize;
+	bool early_stop_perms;
+};
+
+/** The columns of one pass over the observations, with their values
+ interleaved in packed as for LisaCoordinator::CalcPseudoPBatch. */
+struct GStatBatch {
+	const CsrWeight* W_csr;
+	const Gda::PermTable* perm_table;
+	int permutations;
+	std::vector<GStatBatchCol> cols;
+	std::vector<double> packed;
+};
+
+/** GStatCoordinator::CalcPseudoP_range for all columns of b, with the
+ same arithmetic so that each column gets the same results. */
+void GStatBatchRange(GStatBatch* b, size_t obs_start, size_t obs_end)
+{
+	const int ncols = b->cols.size();
+	const int permutations = b->permutations;
+	std::vector<double> lags(Gda::PermTable::block_size * ncols);
+	std::vector<int> g_larger(ncols);
+	std::vector<int> g_star_larger(ncols);
+	std::vector<int> used(ncols);
+	std::vector<bool> decided(ncols);
+	for (long i=obs_start; i<=obs_end; i++) {
+		const int numNeighsI = b->W_csr->Size(i);
+		const double numNeighsD = b->W_csr->Size(i);
+		if (numNeighsI == 0) continue; // only compute for non-isolates
+		int open = 0; // columns still drawing permutations
+		for (int c=0; c<ncols; c++) {
+			g_larger[c] = 0;
+			g_star_larger[c] = 0;
+			used[c] = permutations;
+			decided[c] = !b->cols[c].G_defined[i];
+			if (!decided[c]) open++;
+		}
+		for (int first=0; first<permutations && open>0;
+			 first+=Gda::PermTable::block_size) {
+			const int n = GenUtils::min<int>(permutations-first,
+											 Gda::PermTable::block_size);
+			b->perm_table->LagSums(&b->packed[0], ncols, i, numNeighsI,
+								   first, n, &lags[0]);
+			for (int c=0; c<ncols; c++) {
+				if (decided[c]) continue;
+				const GStatBatchCol& col = b->cols[c];
+				const double x_i = col.x[i];
+				const double x_star_t = col.x_star_t;
+				double xd_i = x_star_t - x_i; // != 0 since G_defined[i]
+				const double G_i = col.G[i];
+				const double G_star_i = col.G_star[i];
+				int countGLarger = g_larger[c];
+				int countGStarLarger = g_star_larger[c];
+				double permutedG = 0;
+				double permutedGStar = 0;
+				for (int p=0; p<n; p++) {
+					const double lag_i = lags[p*ncols + c];
+					if (col.row_standardize) {
+						permutedG = lag_i / (numNeighsD * xd_i);
+						permutedGStar = (lag_i+x_i) / ((numNeighsD+1)*x_star_t);
+					} else { // binary weights
+						permutedG = lag_i / xd_i;
+						permutedGStar = (lag_i+x_i) / x_star_t;
+					}
+					if (permutedG >= G_i) countGLarger++;
+					if (permutedGStar >= G_star_i) countGStarLarger++;
+					if (col.early_stop_perms &&
+						Gda::PermTestDecided(countGLarger, first+p+1,
+											 permutations) &&
+						Gda::PermTestDecided(countGStarLarger, first+p+1,
+											 permutations)) {
+						used[c] = first+p+1;
+						decided[c] = true;
+						open--;
+						break;
+					}
+				}
+				g_larger[c] = countGLarger;
+				g_star_larger[c] = countGStarLarger;
+			}
+		}
+		for (int c=0; c<ncols; c++) {
+			const GStatBatchCol& col = b->cols[c];
+			if (!col.G_defined[i]) continue;
+			// pick the smallest
+			int countGLarger = g_larger[c];
+			if (used[c]-countGLarger < countGLarger) {
+				countGLarger = used[c]-countGLarger;
+			}
+			col.pseudo_p[i] = (countGLarger + 1.0)/(used[c]+1.0);
+			int countGStarLarger = g_star_larger[c];
+			if (used[c]-countGStarLarger < countGStarLarger) {
+				countGStarLarger = used[c]-countGStarLarger;
+			}
+			col.pseudo_p_star[i] = (countGStarLarger + 1.0)/(used[c]+1.0);
+			col.perms_used[i] = used[c];
+		}
+	}
+}
+} // end anonymous namespace
+
+void GStatCoordinator::CalcPseudoPBatch(
+							const std::vector<GStatCoordinator*>& batch)
+{
+	LOG_MSG("Entering GStatCoordinator::CalcPseudoPBatch");
+	wxStopWatch sw;
+	GStatCoordinator* gc0 = 0;
+	for (size_t i=0; i<batch.size() && !gc0; i++) {
+		if (batch[i]->calc_significances) gc0 = batch[i];
+	}
+	if (!gc0) return;
+	if (!gc0->reuse_last_seed) gc0->last_seed_used = time(0);
+	const uint64_t seed = gc0->last_seed_used;
+	
+	std::vector<GStatCoordinator*> same;
+	for (size_t i=0; i<batch.size(); i++) {
+		GStatCoordinator* gc = batch[i];
+		if (!gc->calc_significances) continue;
+		if (gc->W_csr == gc0->W_csr && gc->permutations == gc0->permutations) {
+			gc->last_seed_used = seed;
+			same.push_back(gc);
+		} else {
+			gc->CalcPseudoP();
+		}
+	}
+	
+	// weighted lags are left to CalcPseudoP, as in
+	// LisaCoordinator::CalcPseudoPBatch
+	Gda::PermTable perm_table;
+	if (!gc0->W_csr->IsBinary() ||
+		!perm_table.Init(gc0->num_obs, gc0->W_csr->MaxSize(),
+						 gc0->permutations, seed)) {
+		// no shared draws to batch, so each coordinator runs on its own
+		// with its own seed setting, and saves its results under the key
+		// CreateBatch looks up
+		for (size_t i=0; i<same.size(); i++) same[i]->CalcPseudoP();
+		return;
+	}
+	
+	std::vector<GStatBatchCol> cols;
+	for (size_t i=0; i<same.size(); i++) {
+		GStatCoordinator* gc = same[i];
+		for (int t=0; t<gc->num_time_vals; t++) {
+			GStatBatchCol col;
+			col.x = gc->x_vecs[t];
+			col.x_star_t = gc->x_star[t];
+			col.G = gc->G_vecs[t];
+			col.G_star = gc->G_star_vecs[t];
+			col.G_defined = gc->G_defined_vecs[t];
+			col.pseudo_p = gc->pseudo_p_vecs[t];
+			col.pseudo_p_star = gc->pseudo_p_star_vecs[t];
+			col.perms_used = gc->perms_used_vecs[t];
+			col.row_standardize = gc->row_standardize;
+			col.early_stop_perms = gc->early_stop_perms;
+			cols.push_back(col);
+		}
+	}
+	
+	// at most 16 columns per pass, see LisaCoordinator::CalcPseudoPBatch
+	const int num_obs = gc0->num_obs;
+	const size_t cols_per_pass = 16;
+	for (size_t c0=0; c0<cols.size(); c0+=cols_per_pass) {
+		GStatBatch b;
+		b.W_csr = gc0->W_csr;
+		b.perm_table = &perm_table;
+		b.permutations = gc0->permutations;
+		b.cols.assign(cols.begin()+c0,
+					  cols.begin()+GenUtils::min(c0+cols_per_pass,
+												 cols.size()));
+		const int ncols = b.cols.size();
+		b.packed.resize((size_t) num_obs*ncols);
+		for (int j=0; j<num_obs; j++) {
+			for (int c=0; c<ncols; c++) {
+				b.packed[(size_t) j*ncols + c] = b.cols[c].x[j];
+			}
+		}
+		GenUtils::RunTasks(num_obs, boost::bind(&GStatBatchRange, &b, _1, _2));
+	}
+	
+	for (size_t i=0; i<same.size(); i++) same[i]->SaveToCache();
+	
+	wxString m;
+	m << "GStat batch of " << same.size() << " variables, " << cols.size();
+	m << " maps on " << num_obs << " obs with " << gc0->permutations;
+	m << " perms took " << sw.Time() << " ms. Seed used: " << seed;
+	LOG_MSG(m);
+}
+
 void GStatCoordinator::SetSignificanceFilter(int filter_id)
 {
 	// 0: >0.05 1: 0.05, 2: 0.01, 3: 0.001, 4: 0.0001
@@ -36,6 +36,7 @@
 #include <boost/multi_array.hpp>
 #include <wx/string.h>
 #include <wx/thread.h>
+#include "../GenUtils.h"
 #include "../VarTools.h"
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
@@ -46,38 +47,30 @@ class Project;
 class WeightsManState;
 typedef boost::multi_array<double, 2> d_array_type;
 
-class GStatWorkerThread : public wxThread
-{
-public:
-	GStatWorkerThread(int obs_start, int obs_end, uint64_t seed_start,
-					 GStatCoordinator* gstat_coord,
-					 wxMutex* worker_list_mutex,
-					 wxCondition* worker_list_empty_cond,
-					 std::list<wxThread*> *worker_list,
-					 int thread_id);
-	virtual ~GStatWorkerThread();
-	virtual void* Entry();  // thread execution starts here
-
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
-	int thread_id;
-	
-	GStatCoordinator* gstat_coord;
-	wxMutex* worker_list_mutex;
-	wxCondition* worker_list_empty_cond;
-	std::list<wxThread*> *worker_list;
-};
-
 class GStatCoordinator : public WeightsManStateObserver
 {
 public:
 	GStatCoordinator(boost::uuids::uuid weights_id, Project* project,
 					 const std::vector<GdaVarTools::VarInfo>& var_info,
 					 const std::vector<int>& col_ids,
-					 bool row_standardize_weights);
+					 bool row_standardize_weights,
+					 bool calc_significances = true);
 	virtual ~GStatCoordinator();
 	
+	/** One coordinator for each entry of var_infos and col_ids, all on
+	 weights weights_id, with significances computed together by
+	 CalcPseudoPBatch.  The caller owns the coordinators. */
+	static std::vector<GStatCoordinator*> CreateBatch(
+					boost::uuids::uuid weights_id, Project* project,
+					const std::vector<std::vector<GdaVarTools::VarInfo> >& var_infos,
+					const std::vector<std::vector<int> >& col_ids,
+					bool row_standardize_weights);
+	
+	/** CalcPseudoP for all time periods of all coordinators in batch in
+	 one pass over the observations, as LisaCoordinator::CalcPseudoPBatch
+	 does for LISA. */
+	static void CalcPseudoPBatch(const std::vector<GStatCoordinator*>& batch);
+	
 	bool IsOk() { return true; }
 	wxString GetErrorMessage() { return "Error Message"; }
 		
@@ -91,6 +84,12 @@ public:
 	void SetLastUsedSeed(uint64_t seed) { last_seed_used = seed; }
 	bool IsReuseLastSeed() { return reuse_last_seed; }
 	void SetReuseLastSeed(bool reuse) { reuse_last_seed = reuse; }
+	bool IsEarlyStopPerms() { return early_stop_perms; }
+	/** When set, the permutations of an observation stop as soon as the
+	 significance categories of both G and G* are decided, see
+	 Gda::PermTestDecided.  Categories are the same as for the full run
+	 with the same seed. */
+	void SetEarlyStopPerms(bool stop) { early_stop_perms = stop; }
 	
 	/** Implementation of WeightsManStateObserver interface */
 	virtual void update(WeightsManState* o);
@@ -99,7 +98,6 @@ public:
 	
 	std::vector<double> n; // # non-neighborless observations
 	
-	double x_star_t; // temporary x_star for use in worker threads
 	std::vector<double> x_star; // sum of all x_i // threaded
 	std::vector<double> x_sstar; // sum of all (x_i)^2
 		
@@ -129,6 +127,7 @@ protected:
 	double* p_star;
 	double* pseudo_p; //threaded
 	double* pseudo_p_star; //threaded
+	int* perms_used; // permutations drawn for each obs //threaded
 	double* x; //threaded
 	
 public:
@@ -145,10 +144,12 @@ public:
 	std::vector<double*> p_star_vecs;
 	std::vector<double*> pseudo_p_vecs; //threaded
 	std::vector<double*> pseudo_p_star_vecs; //threaded
+	std::vector<int*> perms_used_vecs; //threaded
 	std::vector<double*> x_vecs; //threaded
 
 	boost::uuids::uuid w_id;
 	const GalElement* W;
+	const CsrWeight* W_csr; // CSR copy of W used for all computations
 	wxString weight_name;
 
 	int num_obs; // total # obs including neighborless obs
@@ -176,7 +177,7 @@ public:
 	std::vector<GetisOrdMapFrame*> maps;
 	
 	void CalcPseudoP();
-	void CalcPseudoP_range(int obs_start, int obs_end, uint64_t seed_start);
+	void CalcPseudoP_range(int t, int obs_start, int obs_end, uint64_t seed);
 	
 	void InitFromVarInfo();
 	void VarInfoAttributeChange();
@@ -187,16 +188,36 @@ protected:
 	void DeallocateVectors();
 	void AllocateVectors();
 	
-	void CalcPseudoP_threaded();
+	void CalcPseudoP_tasks(size_t first, size_t last, uint64_t seed);
+	/** Key of the results in the project's Gda::ResultCache, as for
+	 LisaCoordinator::CacheKey. */
+	uint64_t CacheKey() const;
+	/** Restores the results and the seed of an earlier run with the same
+	 CacheKey.  Returns false when there are none. */
+	bool LoadFromCache();
+	void SaveToCache();
 	void CalcGs();
+	/** Weights of observation i in Gi and Gi* when W is not binary.  The
+	 neighbors other than i and their weights go to nbrs and w, which need
+	 W_csr->Size(i) entries, and their number is returned.  With
+	 row_standardize the weights sum to one.  Gi* scales them by
+	 star_scale and weighs x[i] by self_w, which is the weight of i in its
+	 own neighbor list if it is there and the largest weight of the row
+	 otherwise, so 1 for binary weights. */
+	int GiWeights(long i, long* nbrs, double* w, double& star_scale,
+				  double& self_w) const;
 	std::vector<bool> has_undefined;
 	std::vector<bool> has_isolates;
 	bool row_standardize;
+	bool calc_significances; // if false, then p-vals will never be needed
 	uint64_t last_seed_used;
 	bool reuse_last_seed;
+	bool early_stop_perms;
+	Gda::PermTable perm_table; // draws shared by CalcPseudoP_range calls
 	
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
+	Project* project;
 };
 
 #endif
@@ -153,6 +153,8 @@ void GetisOrdMapCanvas::SetCheckMarks(wxMenu* menu)
 	
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_SPECIFIED_SEED"),
 								  gs_coord->IsReuseLastSeed());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_EARLY_STOP_PERMUTATIONS"),
+								  gs_coord->IsEarlyStopPerms());
 }
 
 void GetisOrdMapCanvas::TimeChange()
@@ -527,6 +529,18 @@ void GetisOrdMapFrame::OnUseSpecifiedSeed(wxCommandEvent& event)
 	gs_coord->SetReuseLastSeed(!gs_coord->IsReuseLastSeed());
 }
 
+void GetisOrdMapFrame::OnEarlyStopPermutations(wxCommandEvent& event)
+{
+	gs_coord->SetEarlyStopPerms(!gs_coord->IsEarlyStopPerms());
+	// rerun with the seed of the current run, so that only the stopping
+	// rule changes and the categories can be compared
+	bool reuse = gs_coord->IsReuseLastSeed();
+	gs_coord->SetReuseLastSeed(true);
+	gs_coord->CalcPseudoP();
+	gs_coord->SetReuseLastSeed(reuse);
+	gs_coord->notifyObservers();
+}
+
 void GetisOrdMapFrame::OnSpecifySeedDlg(wxCommandEvent& event)
 {
 	uint64_t last_seed = gs_coord->GetLastUsedSeed();
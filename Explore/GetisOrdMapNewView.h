@@ -96,6 +96,7 @@ public:
 	
 	void OnUseSpecifiedSeed(wxCommandEvent& event);
 	void OnSpecifySeedDlg(wxCommandEvent& event);
+	void OnEarlyStopPermutations(wxCommandEvent& event);
 	
 	void SetSigFilterX(int filter);
 	void OnSigFilter05(wxCommandEvent& event);
@@ -18,6 +18,7 @@
  */
 
 #include <time.h>
+#include <boost/bind.hpp>
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
 #include "../DataViewer/TableInterface.h"
@@ -25,53 +26,12 @@
 #include "../ShapeOperations/Randik.h"
 #include "../ShapeOperations/WeightsManState.h"
 #include "../VarCalc/WeightsManInterface.h"
+#include "../GenUtils.h"
 #include "../logger.h"
 #include "../Project.h"
 #include "LisaCoordinatorObserver.h"
 #include "LisaCoordinator.h"
 
-LisaWorkerThread::LisaWorkerThread(int obs_start_s, int obs_end_s,
-								   uint64_t	seed_start_s,
-								   LisaCoordinator* lisa_coord_s,
-								   wxMutex* worker_list_mutex_s,
-								   wxCondition* worker_list_empty_cond_s,
-								   std::list<wxThread*> *worker_list_s,
-								   int thread_id_s)
-: wxThread(),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
-lisa_coord(lisa_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-LisaWorkerThread::~LisaWorkerThread()
-{
-}
-
-wxThread::ExitCode LisaWorkerThread::Entry()
-{
-	LOG_MSG(wxString::Format("LisaWorkerThread %d started", thread_id));
-
-	// call work for assigned range of observations
-	lisa_coord->CalcPseudoP_range(obs_start, obs_end, seed_start);
-	
-	wxMutexLocker lock(*worker_list_mutex);
-	// remove ourself from the list
-	worker_list->remove(this);
-	// if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	LOG_MSG(wxString::Format("LisaWorkerThread %d finished", thread_id));
-	if (worker_list->empty()) {
-		LOG_MSG("worker_list is empty, so signaling main thread");
-		worker_list_empty_cond->Signal();
-	}
-	
-	return NULL;
-}
-
 /** 
  Since the user has the ability to synchronise either variable over time,
  we must be able to reapply weights and recalculate lisa values as needed.
@@ -107,6 +67,7 @@ LisaCoordinator::LisaCoordinator(boost::uuids::uuid weights_id,
                          bool row_standardize_s)
 : w_man_state(project->GetWManState()),
 w_man_int(project->GetWManInt()),
+project(project),
 w_id(weights_id),
 num_obs(project->GetNumRecords()),
 permutations(999),
@@ -115,13 +76,14 @@ calc_significances(calc_significances_s),
 isBivariate(lisa_type_s == bivariate),
 var_info(var_info_s),
 data(var_info_s.size()),
-last_seed_used(0), reuse_last_seed(false),
+last_seed_used(0), reuse_last_seed(false), early_stop_perms(false),
 row_standardize(row_standardize_s)
 {
     
     LOG_MSG("Entering LisaCoordinator::LisaCoordinator(..)");
 	GalWeight* gw = w_man_int->GetGal(w_id);
 	W = (gw ? gw->gal : 0);
+	W_csr = (gw ? &gw->GetCsr() : 0);
 	weight_name = w_man_int->GetLongDispName(w_id);
 	SetSignificanceFilter(1);
     
@@ -143,6 +105,26 @@ LisaCoordinator::~LisaCoordinator()
 	DeallocateVectors();
 }
 
+std::vector<LisaCoordinator*> LisaCoordinator::CreateBatch(
+					boost::uuids::uuid weights_id, Project* project,
+					const std::vector<std::vector<GdaVarTools::VarInfo> >& var_infos,
+					const std::vector<std::vector<int> >& col_ids,
+					LisaType lisa_type, bool row_standardize_s)
+{
+	std::vector<LisaCoordinator*> batch(var_infos.size());
+	std::vector<LisaCoordinator*> not_cached;
+	for (size_t i=0; i<var_infos.size(); i++) {
+		// significances are left to CalcPseudoPBatch below
+		batch[i] = new LisaCoordinator(weights_id, project, var_infos[i],
+									   col_ids[i], lisa_type, false,
+									   row_standardize_s);
+		batch[i]->EnableSignificances();
+		if (!batch[i]->LoadFromCache()) not_cached.push_back(batch[i]);
+	}
+	CalcPseudoPBatch(not_cached);
+	return batch;
+}
+
 void LisaCoordinator::DeallocateVectors()
 {
 	for (int i=0; i<lags_vecs.size(); i++) {
@@ -161,6 +143,10 @@ void LisaCoordinator::DeallocateVectors()
 		if (sig_cat_vecs[i]) delete [] sig_cat_vecs[i];
 	}
 	sig_cat_vecs.clear();
+	for (int i=0; i<perms_used_vecs.size(); i++) {
+		if (perms_used_vecs[i]) delete [] perms_used_vecs[i];
+	}
+	perms_used_vecs.clear();
 	for (int i=0; i<cluster_vecs.size(); i++) {
 		if (cluster_vecs[i]) delete [] cluster_vecs[i];
 	}
@@ -183,6 +169,7 @@ void LisaCoordinator::AllocateVectors()
 	local_moran_vecs.resize(tms);
 	sig_local_moran_vecs.resize(tms);
 	sig_cat_vecs.resize(tms);
+	perms_used_vecs.resize(tms);
 	cluster_vecs.resize(tms);
 	data1_vecs.resize(tms);
 	map_valid.resize(tms);
@@ -195,6 +182,7 @@ void LisaCoordinator::AllocateVectors()
 		if (calc_significances) {
 			sig_local_moran_vecs[i] = new double[num_obs];
 			sig_cat_vecs[i] = new int[num_obs];
+			perms_used_vecs[i] = new int[num_obs];
 		}
 		cluster_vecs[i] = new int[num_obs];
 		data1_vecs[i] = new double[num_obs];
@@ -210,6 +198,19 @@ void LisaCoordinator::AllocateVectors()
 	}
 }
 
+/** Allocate the significance arrays of a coordinator created with
+ calc_significances false.  They are filled by the next CalcPseudoP. */
+void LisaCoordinator::EnableSignificances()
+{
+	if (calc_significances) return;
+	calc_significances = true;
+	for (int i=0; i<num_time_vals; i++) {
+		sig_local_moran_vecs[i] = new double[num_obs];
+		sig_cat_vecs[i] = new int[num_obs];
+		perms_used_vecs[i] = new int[num_obs];
+	}
+}
+
 /** We assume only that var_info is initialized correctly.
  ref_var_index, is_any_time_variant, is_any_sync_with_global_time and
  num_time_vals are first updated based on var_info */ 
@@ -303,10 +304,98 @@ void LisaCoordinator::InitFromVarInfo()
 	}
 	
 	StandardizeData();
+	// results of an earlier session on the same data are read back
+	if (calc_significances && LoadFromCache()) return;
 	CalcLisa();
 	if (calc_significances) CalcPseudoP();
 }
 
+uint64_t LisaCoordinator::CacheKey() const
+{
+	const bool data2_sync = (isBivariate && var_info[1].is_time_variant &&
+							 var_info[1].sync_with_global_time);
+	int params[] = { lisa_type, row_standardize, data2_sync, permutations,
+		early_stop_perms, reuse_last_seed, num_obs, num_time_vals,
+		(int) data2_vecs.size() };
+	uint64_t h = Gda::HashBytes("LisaCoordinator", 15);
+	h = Gda::HashBytes(params, sizeof(params), h);
+	if (reuse_last_seed) {
+		h = Gda::HashBytes(&last_seed_used, sizeof(last_seed_used), h);
+	}
+	uint64_t w_hash = W_csr->Hash();
+	h = Gda::HashBytes(&w_hash, sizeof(w_hash), h);
+	for (int t=0; t<data1_vecs.size(); t++) {
+		h = Gda::HashBytes(data1_vecs[t], num_obs*sizeof(double), h);
+	}
+	for (int t=0; t<data2_vecs.size(); t++) {
+		h = Gda::HashBytes(data2_vecs[t], num_obs*sizeof(double), h);
+	}
+	return h;
+}
+
+bool LisaCoordinator::LoadFromCache()
+{
+	Gda::ResultCache cache(project->GetProjectFullPath(), CacheKey());
+	if (!cache.Load()) return false;
+	const size_t d_sz = num_obs*sizeof(double);
+	const size_t i_sz = num_obs*sizeof(int);
+	uint64_t seed = 0;
+	std::vector<char> flags(2*num_time_vals);
+	// the layout of SaveToCache is checked first, so that a damaged file
+	// leaves all arrays as they were
+	std::vector<size_t> sizes;
+	sizes.push_back(sizeof(seed));
+	sizes.push_back(flags.size());
+	for (int t=0; t<num_time_vals; t++) {
+		size_t t_sizes[] = { d_sz, d_sz, i_sz, d_sz, i_sz, i_sz };
+		sizes.insert(sizes.end(), t_sizes, t_sizes+6);
+	}
+	if (!cache.Fits(sizes)) return false;
+	cache.Get(&seed, sizeof(seed));
+	cache.Get(&flags[0], flags.size());
+	for (int t=0; t<num_time_vals; t++) {
+		cache.Get(lags_vecs[t], d_sz);
+		cache.Get(local_moran_vecs[t], d_sz);
+		cache.Get(cluster_vecs[t], i_sz);
+		cache.Get(sig_local_moran_vecs[t], d_sz);
+		cache.Get(sig_cat_vecs[t], i_sz);
+		cache.Get(perms_used_vecs[t], i_sz);
+	}
+	last_seed_used = seed;
+	for (int t=0; t<num_time_vals; t++) {
+		has_isolates[t] = flags[2*t];
+		has_undefined[t] = flags[2*t+1];
+	}
+	wxString m;
+	m << "LISA results restored from cache. Last seed used: " << seed;
+	LOG_MSG(m);
+	return true;
+}
+
+void LisaCoordinator::SaveToCache()
+{
+	Gda::ResultCache cache(project->GetProjectFullPath(), CacheKey());
+	if (!cache.IsOk()) return;
+	const size_t d_sz = num_obs*sizeof(double);
+	const size_t i_sz = num_obs*sizeof(int);
+	std::vector<char> flags(2*num_time_vals);
+	for (int t=0; t<num_time_vals; t++) {
+		flags[2*t] = has_isolates[t];
+		flags[2*t+1] = has_undefined[t];
+	}
+	cache.Put(&last_seed_used, sizeof(last_seed_used));
+	cache.Put(&flags[0], flags.size());
+	for (int t=0; t<num_time_vals; t++) {
+		cache.Put(lags_vecs[t], d_sz);
+		cache.Put(local_moran_vecs[t], d_sz);
+		cache.Put(cluster_vecs[t], i_sz);
+		cache.Put(sig_local_moran_vecs[t], d_sz);
+		cache.Put(sig_cat_vecs[t], i_sz);
+		cache.Put(perms_used_vecs[t], i_sz);
+	}
+	if (!cache.Save()) LOG_MSG("Could not save LISA results to the cache");
+}
+
 /** Update Secondary Attributes based on Primary Attributes.
  Update num_time_vals and ref_var_index based on Secondary Attributes. */
 void LisaCoordinator::VarInfoAttributeChange()
@@ -362,18 +451,21 @@ void LisaCoordinator::CalcLisa()
 		has_undefined[t] = false;
 		has_isolates[t] = false;
 	
+		// the lag uses the same weights as the permuted lags of
+		// CalcPseudoP_range, row-standardized or as stored
+		const double* lag_data = isBivariate ? data2 : data1;
 		for (int i=0; i<num_obs; i++) {
 			double Wdata = 0;
-			if (isBivariate) {
-				Wdata = W[i].SpatialLag(data2);
+			if (row_standardize) {
+				Wdata = W_csr->SpatialLag(i, lag_data);
 			} else {
-				Wdata = W[i].SpatialLag(data1);
+				Wdata = W_csr->WeightedSum(i, lag_data);
 			}
 			lags[i] = Wdata;
 			localMoran[i] = data1[i] * Wdata;
 					
 			// assign the cluster
-			if (W[i].Size() > 0) {
+			if (W_csr->Size(i) > 0) {
 				if (data1[i] > 0 && Wdata < 0) cluster[i] = 4;
 				else if (data1[i] < 0 && Wdata > 0) cluster[i] = 3;
 				else if (data1[i] < 0 && Wdata < 0) cluster[i] = 2;
@@ -391,194 +483,147 @@ void LisaCoordinator::CalcPseudoP()
 	LOG_MSG("Entering LisaCoordinator::CalcPseudoP");
 	if (!calc_significances) return;
 	wxStopWatch sw;
-	int nCPUs = wxThread::GetCPUCount();
-	
-	// To ensure thread safety, only work on one time slice of data
-	// at a time.  For each time period t:
-	// 1. copy data for time period t into data1 and data2 arrays
-	// 2. Perform multi-threaded computation
-	// 3. copy results into results array
-	
-	if (nCPUs <= 1) {
-		LOG_MSG(wxString::Format("%d threading cores detected "
-								 "so running single threaded", nCPUs));
-	} else {
-		LOG_MSG(wxString::Format("%d threading cores detected, "
-								 "running multi-threaded.", nCPUs));
-	}
 	
-	for (int t=0; t<num_time_vals; t++) {
-		LOG_MSG(wxString::Format("Calculating LISA significances for time "
-								 "period %d", t));
-		
-		data1 = data1_vecs[t];
-		if (isBivariate) {
-			data2 = data2_vecs[0];
-			if (var_info[1].is_time_variant &&
-				var_info[1].sync_with_global_time)
-                data2 = data2_vecs[t];
-		}
-		lags = lags_vecs[t];
-		localMoran = local_moran_vecs[t];
-		sigLocalMoran = sig_local_moran_vecs[t];
-		sigCat = sig_cat_vecs[t];
-		cluster = cluster_vecs[t];
-		
-		if (nCPUs <= 1) {
-			if (!reuse_last_seed) last_seed_used = time(0);
-			CalcPseudoP_range(0, num_obs-1, last_seed_used);
-		} else {
-			CalcPseudoP_threaded();
-		}
-	}
+	// The periods are tested in one pass of the shared task pool, task
+	// t*num_obs+i being observation i of period t, so that short periods
+	// do not leave workers idle.  The neighbor draws come from a
+	// Gda::PermTable shared by all observations and periods, or, when the
+	// table would be too large, from counter-based streams of each
+	// observation.  Either way the results do not depend on how the pool
+	// splits up the tasks.
+	if (!reuse_last_seed) last_seed_used = time(0);
+	perm_table.Init(num_obs, W_csr->MaxSize(), permutations, last_seed_used);
+	GenUtils::RunTasks((size_t) num_time_vals * num_obs,
+					   boost::bind(&LisaCoordinator::CalcPseudoP_tasks,
+								   this, _1, _2, last_seed_used));
+	perm_table.Clear();
+	SaveToCache();
 	{
 		wxString m;
 		m << "LISA on " << num_obs << " obs with " << permutations;
 		m << " perms over " << num_time_vals << " time periods took ";
 		m << sw.Time() << " ms. Last seed used: " << last_seed_used;
+		if (early_stop_perms) {
+			double tot_used = 0;
+			for (int t=0; t<num_time_vals; t++) {
+				for (int i=0; i<num_obs; i++) tot_used += perms_used_vecs[t][i];
+			}
+			m << ". Mean perms used: ";
+			m << tot_used / ((double) num_obs * num_time_vals);
+		}
 		LOG_MSG(m);
 	}
 	LOG_MSG("Exiting LisaCoordinator::CalcPseudoP");
 }
 
-void LisaCoordinator::CalcPseudoP_threaded()
+/** Tasks first..last of CalcPseudoP, split at the time periods. */
+void LisaCoordinator::CalcPseudoP_tasks(size_t first, size_t last,
+										uint64_t seed)
 {
-	LOG_MSG("Entering LisaCoordinator::CalcPseudoP_threaded");
-	int nCPUs = wxThread::GetCPUCount();
-	
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-	worker_list_mutex.Lock(); // mutex should be initially locked
-	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-	std::list<wxThread*> worker_list;
-	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
-	
-	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
-		wxString msg;
-		msg << "thread " << thread_id << ": " << a << "->" << b;
-		msg << ", seed: " << seed_start << "->" << seed_end;
-		LOG_MSG(msg);
-		
-		LisaWorkerThread* thread =
-			new LisaWorkerThread(a, b, seed_start, this,
-								 &worker_list_mutex,
-								 &worker_list_empty_cond,
-								 &worker_list, thread_id);
-		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-			LOG_MSG("Error: Can't create thread!");
-			delete thread;
-			is_thread_error = true;
-		} else {
-			worker_list.push_front(thread);
-		}
-	}
-	if (is_thread_error) {
-		LOG_MSG("Error: Could not spawn a worker thread, falling back "
-				"to single-threaded pseudo-p calculation.");
-		// fall back to single thread calculation mode
-		CalcPseudoP_range(0, num_obs-1, last_seed_used);
-	} else {
-		LOG_MSG("Starting all worker threads");
-		std::list<wxThread*>::iterator it;
-		for (it = worker_list.begin(); it != worker_list.end(); it++) {
-			(*it)->Run();
-		}
-	
-		while (!worker_list.empty()) {
-			// wait until thread_list might be empty
-			worker_list_empty_cond.Wait();
-			// We have been woken up. If this was not a false
-			// alarm (sprious signal), the loop will exit.
-			LOG_MSG("work_list_empty_cond signaled");
-		}
-		LOG_MSG("All worker threads exited");
+	while (first <= last) {
+		int t = first / num_obs;
+		size_t period_last = GenUtils::min(last, (size_t) (t+1)*num_obs - 1);
+		CalcPseudoP_range(t, first - (size_t) t*num_obs,
+						  period_last - (size_t) t*num_obs, seed);
+		first = period_last+1;
 	}
-
-	LOG_MSG("Exiting LisaCoordinator::CalcPseudoP_threaded");
 }
 
-void LisaCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
-										uint64_t seed_start)
+void LisaCoordinator::CalcPseudoP_range(int t, int obs_start, int obs_end,
+										uint64_t seed)
 {
-	GeoDaSet workPermutation(num_obs);
-	//Randik rng;
+	// arrays of period t, several periods can be in progress at once
+	const double* data1 = data1_vecs[t];
+	const double* perm_data = data1; // the lagged variable
+	if (isBivariate) {
+		perm_data = data2_vecs[0];
+		if (var_info[1].is_time_variant && var_info[1].sync_with_global_time)
+			perm_data = data2_vecs[t];
+	}
+	const double* localMoran = local_moran_vecs[t];
+	double* sigLocalMoran = sig_local_moran_vecs[t];
+	int* sigCat = sig_cat_vecs[t];
+	int* permsUsed = perms_used_vecs[t];
+	
+	// the shared draws of perm_table are used whenever they were made,
+	// otherwise each observation draws its own neighbors
+	const bool use_table = !perm_table.IsEmpty();
+	// distance and kernel weights are applied to the drawn values in the
+	// order of the neighbor list, binary weights just add them up
+	const bool weighted = !W_csr->IsBinary();
+	GeoDaSet workPermutation(use_table ? 1 : num_obs);
 	int max_rand = num_obs-1;
 	for (int cnt=obs_start; cnt<=obs_end; cnt++) {
-		const int numNeighbors = W[cnt].Size();
+		const int numNeighbors = W_csr->Size(cnt);
+		const double* w = 0;
+		if (weighted) {
+			w = row_standardize ? W_csr->RowStdWeights(cnt)
+								: W_csr->Weights(cnt);
+		}
 		
 		uint64_t countLarger = 0;
+		int perms_used = permutations;
+		double lags[Gda::PermTable::block_size];
 		for (int perm=0; perm<permutations; perm++) {
-			int rand=0;
-			while (rand < numNeighbors) {
-				// computing 'perfect' permutation of given size
-				//int newRandom = (int) (rng.fValue() * max_rand);
-				int newRandom = (int) (Gda::ThomasWangHashDouble(seed_start++)
-									   * max_rand);
-				//int newRandom = X(rng);
-				if (newRandom != cnt && !workPermutation.Belongs(newRandom))
-				{
-					workPermutation.Push(newRandom);
-					rand++;
-				}
-			}
 			double permutedLag=0;
 			// use permutation to compute the lag
 			// compute the lag for binary weights
-			if (isBivariate) {
-				for (int cp=0; cp<numNeighbors; cp++) {
-					permutedLag += data2[workPermutation.Pop()];
+			if (use_table) {
+				// the lags of a whole block of permutations are gathered
+				// at once
+				const int b = perm % Gda::PermTable::block_size;
+				if (b == 0) {
+					perm_table.LagSums(perm_data, cnt, numNeighbors, w, perm,
+									   GenUtils::min<int>(permutations-perm,
+												Gda::PermTable::block_size),
+									   lags);
 				}
+				permutedLag = lags[b];
 			} else {
+				// random stream of this observation and permutation only
+				Gda::CounterRng rng(seed, cnt, perm);
+				int rand=0;
+				while (rand < numNeighbors) {
+					// computing 'perfect' permutation of given size,
+					// skipping over cnt itself
+					int newRandom = Gda::PermTable::Shift(
+							(int) (rng.NextDouble() * max_rand), cnt);
+					if (!workPermutation.Belongs(newRandom)) {
+						workPermutation.Push(newRandom);
+						rand++;
+					}
+				}
 				for (int cp=0; cp<numNeighbors; cp++) {
-					permutedLag += data1[workPermutation.Pop()];
+					if (w) {
+						permutedLag += perm_data[workPermutation.Pop()] * w[cp];
+					} else {
+						permutedLag += perm_data[workPermutation.Pop()];
+					}
 				}
 			}
 			
 			//NOTE: we shouldn't have to row-standardize or
 			// multiply by data1[cnt]
-			if (numNeighbors && row_standardize) permutedLag /= numNeighbors;
+			if (numNeighbors && row_standardize && !w) {
+				permutedLag /= numNeighbors;
+			}
 			const double localMoranPermuted = permutedLag * data1[cnt];
 			if (localMoranPermuted >= localMoran[cnt]) countLarger++;
+			if (early_stop_perms &&
+				Gda::PermTestDecided(countLarger, perm+1, permutations)) {
+				perms_used = perm+1;
+				break;
+			}
 		}
 		// pick the smallest
-		if (permutations-countLarger <= countLarger) { 
-			countLarger = permutations-countLarger;
+		if (perms_used-countLarger <= countLarger) {
+			countLarger = perms_used-countLarger;
 		}
 		
-		sigLocalMoran[cnt] = (countLarger+1.0)/(permutations+1);
+		sigLocalMoran[cnt] = (countLarger+1.0)/(perms_used+1);
+		permsUsed[cnt] = perms_used;
 		// 'significance' of local Moran
-		if (sigLocalMoran[cnt] <= 0.0001) sigCat[cnt] = 4;
-		else if (sigLocalMoran[cnt] <= 0.001) sigCat[cnt] = 3;
-		else if (sigLocalMoran[cnt] <= 0.01) sigCat[cnt] = 2;
-		else if (sigLocalMoran[cnt] <= 0.05) sigCat[cnt]= 1;
-		else sigCat[cnt]= 0;
+		sigCat[cnt] = Gda::PseudoPCategory(sigLocalMoran[cnt]);
 		
 		// observations with no neighbors get marked as isolates
 		if (numNeighbors == 0) {
@@ -587,6 +632,188 @@ void LisaCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
 	}
 }
 
+namespace {
+/** One variable in one time period of a CalcPseudoPBatch pass. */
+struct LisaBatchCol {
+	const double* data1;
+	const double* perm_data;
+	const double* localMoran;
+	double* sigLocalMoran;
+	int* sigCat;
+	int* permsUsed;
+	bool row_standardize;
+	bool early_stop_perms;
+};
+
+/** The columns of one pass over the observations.  Their permuted values
+ are interleaved in packed, values of observation j from packed[j*ncols],
+ for Gda::PermTable::LagSums. */
+struct LisaBatch {
+	const CsrWeight* W_csr;
+	const Gda::PermTable* perm_table;
+	int permutations;
+	std::vector<LisaBatchCol> cols;
+	std::vector<double> packed;
+};
+
+/** LisaCoordinator::CalcPseudoP_range for all columns of b, with the
+ same arithmetic so that each column gets the same results. */
+void LisaBatchRange(LisaBatch* b, size_t obs_start, size_t obs_end)
+{
+	const int ncols = b->cols.size();
+	const int permutations = b->permutations;
+	std::vector<double> lags(Gda::PermTable::block_size * ncols);
+	std::vector<uint64_t> larger(ncols);
+	std::vector<int> used(ncols);
+	std::vector<bool> decided(ncols);
+	for (int cnt=obs_start; cnt<=obs_end; cnt++) {
+		const int numNeighbors = b->W_csr->Size(cnt);
+		for (int c=0; c<ncols; c++) {
+			larger[c] = 0;
+			used[c] = permutations;
+			decided[c] = false;
+		}
+		int open = ncols; // columns still drawing permutations
+		for (int first=0; first<permutations && open>0;
+			 first+=Gda::PermTable::block_size) {
+			const int n = GenUtils::min<int>(permutations-first,
+											 Gda::PermTable::block_size);
+			b->perm_table->LagSums(&b->packed[0], ncols, cnt, numNeighbors,
+								   first, n, &lags[0]);
+			for (int c=0; c<ncols; c++) {
+				if (decided[c]) continue;
+				const LisaBatchCol& col = b->cols[c];
+				const bool divide = numNeighbors && col.row_standardize;
+				const double data1_cnt = col.data1[cnt];
+				const double localMoran_cnt = col.localMoran[cnt];
+				uint64_t countLarger = larger[c];
+				for (int p=0; p<n; p++) {
+					double permutedLag = lags[p*ncols + c];
+					if (divide) permutedLag /= numNeighbors;
+					const double localMoranPermuted = permutedLag*data1_cnt;
+					if (localMoranPermuted >= localMoran_cnt) countLarger++;
+					if (col.early_stop_perms &&
+						Gda::PermTestDecided(countLarger, first+p+1,
+											 permutations)) {
+						used[c] = first+p+1;
+						decided[c] = true;
+						open--;
+						break;
+					}
+				}
+				larger[c] = countLarger;
+			}
+		}
+		for (int c=0; c<ncols; c++) {
+			const LisaBatchCol& col = b->cols[c];
+			uint64_t countLarger = larger[c];
+			// pick the smallest
+			if (used[c]-countLarger <= countLarger) {
+				countLarger = used[c]-countLarger;
+			}
+			col.sigLocalMoran[cnt] = (countLarger+1.0)/(used[c]+1);
+			col.permsUsed[cnt] = used[c];
+			col.sigCat[cnt] = Gda::PseudoPCategory(col.sigLocalMoran[cnt]);
+			// observations with no neighbors get marked as isolates
+			if (numNeighbors == 0) col.sigCat[cnt] = 5;
+		}
+	}
+}
+} // end anonymous namespace
+
+void LisaCoordinator::CalcPseudoPBatch(
+							const std::vector<LisaCoordinator*>& batch)
+{
+	LOG_MSG("Entering LisaCoordinator::CalcPseudoPBatch");
+	wxStopWatch sw;
+	LisaCoordinator* lc0 = 0;
+	for (size_t i=0; i<batch.size() && !lc0; i++) {
+		if (batch[i]->calc_significances) lc0 = batch[i];
+	}
+	if (!lc0) return;
+	if (!lc0->reuse_last_seed) lc0->last_seed_used = time(0);
+	const uint64_t seed = lc0->last_seed_used;
+	
+	std::vector<LisaCoordinator*> same;
+	for (size_t i=0; i<batch.size(); i++) {
+		LisaCoordinator* lc = batch[i];
+		if (!lc->calc_significances) continue;
+		if (lc->W_csr == lc0->W_csr && lc->permutations == lc0->permutations) {
+			lc->last_seed_used = seed;
+			same.push_back(lc);
+		} else {
+			lc->CalcPseudoP();
+		}
+	}
+	
+	// weighted lags are left to CalcPseudoP, whose kernel applies the
+	// weights of one variable at a time
+	Gda::PermTable perm_table;
+	if (!lc0->W_csr->IsBinary() ||
+		!perm_table.Init(lc0->num_obs, lc0->W_csr->MaxSize(),
+						 lc0->permutations, seed)) {
+		// no shared draws to batch, so each coordinator runs on its own
+		// with its own seed setting, and saves its results under the key
+		// CreateBatch looks up
+		for (size_t i=0; i<same.size(); i++) same[i]->CalcPseudoP();
+		return;
+	}
+	
+	std::vector<LisaBatchCol> cols;
+	for (size_t i=0; i<same.size(); i++) {
+		LisaCoordinator* lc = same[i];
+		for (int t=0; t<lc->num_time_vals; t++) {
+			LisaBatchCol col;
+			col.data1 = lc->data1_vecs[t];
+			col.perm_data = col.data1;
+			if (lc->isBivariate) {
+				col.perm_data = lc->data2_vecs[0];
+				if (lc->var_info[1].is_time_variant &&
+					lc->var_info[1].sync_with_global_time)
+					col.perm_data = lc->data2_vecs[t];
+			}
+			col.localMoran = lc->local_moran_vecs[t];
+			col.sigLocalMoran = lc->sig_local_moran_vecs[t];
+			col.sigCat = lc->sig_cat_vecs[t];
+			col.permsUsed = lc->perms_used_vecs[t];
+			col.row_standardize = lc->row_standardize;
+			col.early_stop_perms = lc->early_stop_perms;
+			cols.push_back(col);
+		}
+	}
+	
+	// at most 16 columns per pass, which keeps the values of a drawn
+	// neighbor within two cache lines and the packed copy of the data at
+	// 16 doubles per observation
+	const int num_obs = lc0->num_obs;
+	const size_t cols_per_pass = 16;
+	for (size_t c0=0; c0<cols.size(); c0+=cols_per_pass) {
+		LisaBatch b;
+		b.W_csr = lc0->W_csr;
+		b.perm_table = &perm_table;
+		b.permutations = lc0->permutations;
+		b.cols.assign(cols.begin()+c0,
+					  cols.begin()+GenUtils::min(c0+cols_per_pass,
+												 cols.size()));
+		const int ncols = b.cols.size();
+		b.packed.resize((size_t) num_obs*ncols);
+		for (int j=0; j<num_obs; j++) {
+			for (int c=0; c<ncols; c++) {
+				b.packed[(size_t) j*ncols + c] = b.cols[c].perm_data[j];
+			}
+		}
+		GenUtils::RunTasks(num_obs, boost::bind(&LisaBatchRange, &b, _1, _2));
+	}
+	
+	for (size_t i=0; i<same.size(); i++) same[i]->SaveToCache();
+	
+	wxString m;
+	m << "LISA batch of " << same.size() << " variables, " << cols.size();
+	m << " maps on " << num_obs << " obs with " << lc0->permutations;
+	m << " perms took " << sw.Time() << " ms. Seed used: " << seed;
+	LOG_MSG(m);
+}
+
 void LisaCoordinator::SetSignificanceFilter(int filter_id)
 {
 	// 0: >0.05 1: 0.05, 2: 0.01, 3: 0.001, 4: 0.0001
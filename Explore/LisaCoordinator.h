@@ -25,6 +25,7 @@
 #include <boost/multi_array.hpp>
 #include <wx/string.h>
 #include <wx/thread.h>
+#include "../GenUtils.h"
 #include "../VarTools.h"
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
@@ -35,29 +36,6 @@ class Project;
 class WeightsManState;
 typedef boost::multi_array<double, 2> d_array_type;
 
-class LisaWorkerThread : public wxThread
-{
-public:
-	LisaWorkerThread(int obs_start, int obs_end, uint64_t seed_start,
-					 LisaCoordinator* lisa_coord,
-					 wxMutex* worker_list_mutex,
-					 wxCondition* worker_list_empty_cond,
-					 std::list<wxThread*> *worker_list,
-					 int thread_id);
-	virtual ~LisaWorkerThread();
-	virtual void* Entry();  // thread execution starts here
-
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
-	int thread_id;
-	
-	LisaCoordinator* lisa_coord;
-	wxMutex* worker_list_mutex;
-	wxCondition* worker_list_empty_cond;
-	std::list<wxThread*> *worker_list;
-};
-
 class LisaCoordinator : public WeightsManStateObserver
 {
 public:
@@ -72,6 +50,23 @@ public:
     
 	virtual ~LisaCoordinator();
 	
+	/** One coordinator for each entry of var_infos and col_ids, all on
+	 weights weights_id, with significances computed together by
+	 CalcPseudoPBatch.  The caller owns the coordinators. */
+	static std::vector<LisaCoordinator*> CreateBatch(
+					boost::uuids::uuid weights_id, Project* project,
+					const std::vector<std::vector<GdaVarTools::VarInfo> >& var_infos,
+					const std::vector<std::vector<int> >& col_ids,
+					LisaType lisa_type, bool row_standardize_s = true);
+	
+	/** CalcPseudoP for all time periods of all coordinators in batch in
+	 one pass over the observations.  The neighbor draws of a permutation
+	 are made once and applied to every variable, with the seed of the
+	 first coordinator.  Coordinators on other weights or with another
+	 number of permutations are computed on their own.  The results are
+	 the same as those of CalcPseudoP with the same seed. */
+	static void CalcPseudoPBatch(const std::vector<LisaCoordinator*>& batch);
+	
 	bool IsOk() { return true; }
 	wxString GetErrorMessage() { return "Error Message"; }
 
@@ -92,6 +87,13 @@ public:
 	bool IsReuseLastSeed() { return reuse_last_seed; }
     
 	void SetReuseLastSeed(bool reuse) { reuse_last_seed = reuse; }
+	
+	bool IsEarlyStopPerms() { return early_stop_perms; }
+	
+	/** When set, the permutations of an observation stop as soon as its
+	 significance category can no longer change, see Gda::PermTestDecided.
+	 Categories are the same as for the full run with the same seed. */
+	void SetEarlyStopPerms(bool stop) { early_stop_perms = stop; }
 
 	/** Implementation of WeightsManStateObserver interface */
 	virtual void update(WeightsManState* o);
@@ -112,6 +114,9 @@ protected:
 	// results themeslves never change.
 	//0: >0.05 1: 0.05, 2: 0.01, 3: 0.001, 4: 0.0001
 	int* sigCat;
+	// number of permutations actually drawn for each observation.  Less
+	// than permutations only when early_stop_perms is set.
+	int* permsUsed;
 	// not-sig=0 HH=1, LL=2, HL=3, LH=4, isolate=5, undef=6.  Note: value of
 	// 0 never appears in cluster itself, it only appears when
 	// saving results to the Table and indirectly in the map legend
@@ -124,12 +129,14 @@ public:
 	std::vector<double*> local_moran_vecs;
 	std::vector<double*> sig_local_moran_vecs;
 	std::vector<int*> sig_cat_vecs;
+	std::vector<int*> perms_used_vecs;
 	std::vector<int*> cluster_vecs;
 	std::vector<double*> data1_vecs;
 	std::vector<double*> data2_vecs;
 	
 	boost::uuids::uuid w_id;
 	const GalElement* W;
+	const CsrWeight* W_csr; // CSR copy of W used for all computations
 	wxString weight_name;
 	bool isBivariate;
 	LisaType lisa_type;
@@ -159,7 +166,7 @@ public:
 	std::list<LisaCoordinatorObserver*> observers;
 	
 	void CalcPseudoP();
-	void CalcPseudoP_range(int obs_start, int obs_end, uint64_t seed_start);
+	void CalcPseudoP_range(int t, int obs_start, int obs_end, uint64_t seed);
 
 	void InitFromVarInfo();
 	void VarInfoAttributeChange();
@@ -167,8 +174,18 @@ public:
 protected:
 	void DeallocateVectors();
 	void AllocateVectors();
+	void EnableSignificances();
+	/** Key of the results in the project's Gda::ResultCache: a hash of
+	 the standardized data, the weights and the permutation parameters.
+	 The seed only counts when it is reused, since otherwise any earlier
+	 seed is as good as a new one. */
+	uint64_t CacheKey() const;
+	/** Restores the results and the seed of an earlier run with the same
+	 CacheKey.  Returns false when there are none. */
+	bool LoadFromCache();
+	void SaveToCache();
 	
-	void CalcPseudoP_threaded();
+	void CalcPseudoP_tasks(size_t first, size_t last, uint64_t seed);
 	void CalcLisa();
 	void StandardizeData();
 	std::vector<bool> has_undefined;
@@ -177,9 +194,12 @@ protected:
 	bool calc_significances; // if false, then p-vals will never be needed
 	uint64_t last_seed_used;
 	bool reuse_last_seed;
+	bool early_stop_perms;
+	Gda::PermTable perm_table; // draws shared by CalcPseudoP_range calls
 	
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
+	Project* project;
 };
 
 #endif
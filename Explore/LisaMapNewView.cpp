@@ -159,6 +159,8 @@ void LisaMapCanvas::SetCheckMarks(wxMenu* menu)
 	
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_SPECIFIED_SEED"),
 								  lisa_coord->IsReuseLastSeed());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_EARLY_STOP_PERMUTATIONS"),
+								  lisa_coord->IsEarlyStopPerms());
 }
 
 void LisaMapCanvas::TimeChange()
@@ -534,6 +536,18 @@ void LisaMapFrame::OnUseSpecifiedSeed(wxCommandEvent& event)
 	lisa_coord->SetReuseLastSeed(!lisa_coord->IsReuseLastSeed());
 }
 
+void LisaMapFrame::OnEarlyStopPermutations(wxCommandEvent& event)
+{
+	lisa_coord->SetEarlyStopPerms(!lisa_coord->IsEarlyStopPerms());
+	// rerun with the seed of the current run, so that only the stopping
+	// rule changes and the categories can be compared
+	bool reuse = lisa_coord->IsReuseLastSeed();
+	lisa_coord->SetReuseLastSeed(true);
+	lisa_coord->CalcPseudoP();
+	lisa_coord->SetReuseLastSeed(reuse);
+	lisa_coord->notifyObservers();
+}
+
 void LisaMapFrame::OnSpecifySeedDlg(wxCommandEvent& event)
 {
 	uint64_t last_seed = lisa_coord->GetLastUsedSeed();
@@ -455,7 +455,7 @@ void LisaScatterPlotCanvas::ShowRandomizationDialog(int permutation)
             rand_dlg = 0;
         }
 		rand_dlg = new RandomizationDlg(raw_data1, raw_data2,
-                             lisa_coord->W, permutation,
+                             lisa_coord->W_csr, permutation,
                              lisa_coord->IsReuseLastSeed(),
                              lisa_coord->GetLastUsedSeed(), this);
         rand_dlg->Connect(wxEVT_DESTROY, wxWindowDestroyEventHandler(LisaScatterPlotCanvas::OnRandDlgClose), NULL, this);
@@ -466,7 +466,7 @@ void LisaScatterPlotCanvas::ShowRandomizationDialog(int permutation)
             rand_dlg->Destroy();
             rand_dlg = 0;
         }
-    	rand_dlg = new RandomizationDlg(raw_data1, lisa_coord->W, permutation,
+    	rand_dlg = new RandomizationDlg(raw_data1, lisa_coord->W_csr, permutation,
                                  lisa_coord->IsReuseLastSeed(),
                                  lisa_coord->GetLastUsedSeed(), this);
         rand_dlg->Connect(wxEVT_DESTROY, wxWindowDestroyEventHandler(LisaScatterPlotCanvas::OnRandDlgClose), NULL, this);
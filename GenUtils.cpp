@@ -17,19 +17,56 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cfloat>
+#include <cstring>
 #include <iomanip>
 #include <limits>
 #include <math.h>
 #include <sstream>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
 #include <boost/math/distributions/students_t.hpp>
+#include <boost/thread.hpp>
 #include <wx/dc.h>
+#include <wx/dir.h>
+#include <wx/file.h>
+#include <wx/filefn.h>
 #include <wx/msgdlg.h>
 #include <wx/stdpaths.h>
+#include <wx/stopwatch.h>
 #include "GdaConst.h"
 #include "logger.h"
 #include "GenUtils.h"
 
+// GCC contracts a multiply and an add into an FMA by default whenever the
+// target has one (-ffp-contract=fast), which would make the weighted
+// LagSums kernels round differently from each other; MSVC may do the same
+// for scalar code built with /arch:AVX2
+#if defined(__GNUC__) && !defined(__clang__)
+#define GDA_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define GDA_NO_CONTRACT
+#endif
+#if defined(_MSC_VER)
+#pragma fp_contract (off)
+#endif
+
+// gather kernels for Gda::PermTable::LagSums, chosen at run time;
+// __builtin_cpu_supports knows "avx512f" from GCC 5 on
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+	__GNUC__ >= 5
+#define GDA_PERM_SIMD
+#define GDA_TARGET(t) __attribute__((target(t))) GDA_NO_CONTRACT
+#include <immintrin.h>
+#elif defined(_MSC_VER) && _MSC_VER >= 1700 && \
+	(defined(_M_X64) || defined(_M_IX86))
+#define GDA_PERM_SIMD
+#define GDA_TARGET(t)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
 using namespace std;
 
 
@@ -71,6 +108,389 @@ double Gda::ThomasWangHashDouble(uint64_t key) {
 	return 5.42101086242752217E-20 * key;
 }
 
+Gda::CounterRng::CounterRng(uint64_t seed, uint64_t obs, uint64_t perm)
+: used(4)
+{
+	key[0] = (uint32_t) seed;
+	key[1] = (uint32_t) (seed >> 32);
+	ctr[0] = 0; // block of the stream
+	ctr[1] = (uint32_t) perm;
+	ctr[2] = (uint32_t) obs;
+	ctr[3] = (uint32_t) (obs >> 32);
+}
+
+/** Ten Philox rounds on the current counter, then advance the block. */
+void Gda::CounterRng::Generate()
+{
+	uint32_t k0 = key[0], k1 = key[1];
+	uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+	for (int r=0; r<10; r++) {
+		if (r > 0) {
+			k0 += 0x9E3779B9;
+			k1 += 0xBB67AE85;
+		}
+		uint64_t p0 = (uint64_t) 0xD2511F53 * c0;
+		uint64_t p1 = (uint64_t) 0xCD9E8D57 * c2;
+		uint32_t n0 = ((uint32_t) (p1 >> 32)) ^ c1 ^ k0;
+		uint32_t n2 = ((uint32_t) (p0 >> 32)) ^ c3 ^ k1;
+		c1 = (uint32_t) p1;
+		c3 = (uint32_t) p0;
+		c0 = n0;
+		c2 = n2;
+	}
+	out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+	ctr[0]++;
+	used = 0;
+}
+
+double Gda::CounterRng::NextDouble()
+{
+	if (used >= 4) Generate();
+	// 53 random bits from two 32-bit words
+	uint64_t hi = out[used++] >> 5;
+	uint64_t lo = out[used++] >> 6;
+	return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
+}
+
+bool Gda::PermTable::Init(int num_obs_, int width_, int perms_,
+						  uint64_t seed, size_t max_entries)
+{
+	Clear();
+	if (width_ <= 0 || perms_ <= 0 || width_ > num_obs_-1) return false;
+	if ((size_t) perms_ * width_ > max_entries) return false;
+	num_obs = num_obs_;
+	width = width_;
+	perms = perms_;
+	simd = SimdLevel();
+	table.resize((size_t) perms * width);
+	GenUtils::RunTasks(perms, boost::bind(&PermTable::FillPerms, this, seed,
+										  _1, _2));
+	LOG_MSG(wxString::Format("Permutation table %d x %d, %s lag kernel",
+							 perms, width, SimdName(simd)));
+	return true;
+}
+
+/** Permutations first..last, each from its own stream, so the table does
+ not depend on the number of threads.  The stream id num_obs is not used by
+ any observation. */
+void Gda::PermTable::FillPerms(uint64_t seed, size_t first, size_t last)
+{
+	GeoDaSet drawn(num_obs-1);
+	int max_rand = num_obs-1;
+	for (size_t perm=first; perm<=last; perm++) {
+		CounterRng rng(seed, num_obs, perm);
+		int k = 0;
+		while (k < width) {
+			int r = (int) (rng.NextDouble() * max_rand);
+			if (!drawn.Belongs(r)) {
+				drawn.Push(r);
+				table[k*perms + perm] = r;
+				k++;
+			}
+		}
+		while (drawn.Pop() >= 0) {}
+	}
+}
+
+namespace {
+/** Portable LagSums kernel.  col0 points at entry 0 of the first
+ permutation, and entry j is stride ints further on.  Entry j is scaled by
+ w[j] unless w is 0. */
+GDA_NO_CONTRACT
+void LagSumsScalar(const int* col0, size_t stride, const double* x, int obs,
+				   int k, const double* w, int n, double* lag)
+{
+	for (int p=0; p<n; p++) lag[p] = 0;
+	for (int j=0; j<k; j++) {
+		const int* col = col0 + j*stride;
+		if (w) {
+			const double wj = w[j];
+			for (int p=0; p<n; p++) {
+				lag[p] += x[Gda::PermTable::Shift(col[p], obs)] * wj;
+			}
+		} else {
+			for (int p=0; p<n; p++) {
+				lag[p] += x[Gda::PermTable::Shift(col[p], obs)];
+			}
+		}
+	}
+}
+
+#ifdef GDA_PERM_SIMD
+/** Four permutations per gather.  r >= obs is tested as r > obs-1, and the
+ all-ones compare mask is subtracted to add one. */
+GDA_TARGET("avx2")
+void LagSumsAvx2(const int* col0, size_t stride, const double* x, int obs,
+				 int k, const double* w, int n, double* lag)
+{
+	const __m128i o = _mm_set1_epi32(obs-1);
+	int p = 0;
+	for (; p+8 <= n; p += 8) {
+		__m256d s0 = _mm256_setzero_pd();
+		__m256d s1 = _mm256_setzero_pd();
+		for (int j=0; j<k; j++) {
+			const int* col = col0 + j*stride + p;
+			__m128i r0 = _mm_loadu_si128((const __m128i*) col);
+			__m128i r1 = _mm_loadu_si128((const __m128i*) (col+4));
+			r0 = _mm_sub_epi32(r0, _mm_cmpgt_epi32(r0, o));
+			r1 = _mm_sub_epi32(r1, _mm_cmpgt_epi32(r1, o));
+			__m256d g0 = _mm256_i32gather_pd(x, r0, 8);
+			__m256d g1 = _mm256_i32gather_pd(x, r1, 8);
+			if (w) {
+				// multiply and add separately, as the scalar kernel does
+				const __m256d wj = _mm256_set1_pd(w[j]);
+				g0 = _mm256_mul_pd(g0, wj);
+				g1 = _mm256_mul_pd(g1, wj);
+			}
+			s0 = _mm256_add_pd(s0, g0);
+			s1 = _mm256_add_pd(s1, g1);
+		}
+		_mm256_storeu_pd(lag+p, s0);
+		_mm256_storeu_pd(lag+p+4, s1);
+	}
+	if (p < n) LagSumsScalar(col0+p, stride, x, obs, k, w, n-p, lag+p);
+}
+
+/** Eight permutations per gather. */
+GDA_TARGET("avx512f")
+void LagSumsAvx512(const int* col0, size_t stride, const double* x, int obs,
+				   int k, const double* w, int n, double* lag)
+{
+	const __m256i o = _mm256_set1_epi32(obs-1);
+	int p = 0;
+	for (; p+16 <= n; p += 16) {
+		__m512d s0 = _mm512_setzero_pd();
+		__m512d s1 = _mm512_setzero_pd();
+		for (int j=0; j<k; j++) {
+			const int* col = col0 + j*stride + p;
+			__m256i r0 = _mm256_loadu_si256((const __m256i*) col);
+			__m256i r1 = _mm256_loadu_si256((const __m256i*) (col+8));
+			r0 = _mm256_sub_epi32(r0, _mm256_cmpgt_epi32(r0, o));
+			r1 = _mm256_sub_epi32(r1, _mm256_cmpgt_epi32(r1, o));
+			__m512d g0 = _mm512_i32gather_pd(r0, x, 8);
+			__m512d g1 = _mm512_i32gather_pd(r1, x, 8);
+			if (w) {
+				// not fused, see GDA_NO_CONTRACT
+				const __m512d wj = _mm512_set1_pd(w[j]);
+				g0 = _mm512_mul_pd(g0, wj);
+				g1 = _mm512_mul_pd(g1, wj);
+			}
+			s0 = _mm512_add_pd(s0, g0);
+			s1 = _mm512_add_pd(s1, g1);
+		}
+		_mm512_storeu_pd(lag+p, s0);
+		_mm512_storeu_pd(lag+p+8, s1);
+	}
+	if (p < n) LagSumsAvx2(col0+p, stride, x, obs, k, w, n-p, lag+p);
+}
+#endif
+} // end anonymous namespace
+
+void Gda::PermTable::LagSums(const double* x, int obs, int k,
+							 const double* w, int first, int n,
+							 double* lag) const
+{
+	const int* col0 = table.empty() ? 0 : &table[first];
+#ifdef GDA_PERM_SIMD
+	if (simd == 2) { LagSumsAvx512(col0, perms, x, obs, k, w, n, lag); return; }
+	if (simd == 1) { LagSumsAvx2(col0, perms, x, obs, k, w, n, lag); return; }
+#endif
+	LagSumsScalar(col0, perms, x, obs, k, w, n, lag);
+}
+
+void Gda::PermTable::LagSums(const double* xs, int ncols, int obs, int k,
+							 int first, int n, double* lag) const
+{
+	for (int i=0, iend=n*ncols; i<iend; i++) lag[i] = 0;
+	for (int j=0; j<k; j++) {
+		const int* col = &table[j*perms + first];
+		for (int p=0; p<n; p++) {
+			const double* xj = xs + (size_t) Shift(col[p], obs)*ncols;
+			double* lag_p = lag + p*ncols;
+			for (int c=0; c<ncols; c++) lag_p[c] += xj[c];
+		}
+	}
+}
+
+const char* Gda::PermTable::SimdName(int level)
+{
+	if (level == 2) return "AVX-512";
+	if (level == 1) return "AVX2";
+	return "scalar";
+}
+
+int Gda::PermTable::SimdLevel()
+{
+#if defined(GDA_PERM_SIMD) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return 2;
+	if (__builtin_cpu_supports("avx2")) return 1;
+#elif defined(GDA_PERM_SIMD) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return 0;
+	__cpuid(info, 1);
+	// the OS must save the AVX state, see XGETBV
+	if (!(info[2] & (1<<27)) || !(info[2] & (1<<28))) return 0;
+	unsigned __int64 xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6) return 0;
+	__cpuidex(info, 7, 0);
+	if ((info[1] & (1<<16)) && (xcr0 & 0xe6) == 0xe6) return 2;
+	if (info[1] & (1<<5)) return 1;
+#endif
+	return 0;
+}
+
+int Gda::PseudoPCategory(double p)
+{
+	if (p <= 0.0001) return 4;
+	if (p <= 0.001) return 3;
+	if (p <= 0.01) return 2;
+	if (p <= 0.05) return 1;
+	return 0;
+}
+
+/** The final smaller count lies between the current smaller count and the
+ current smaller count plus the number of draws left. */
+bool Gda::PermTestDecided(uint64_t larger, uint64_t used, uint64_t perms)
+{
+	uint64_t smaller = used - larger;
+	uint64_t lo = larger < smaller ? larger : smaller;
+	double denom = perms + 1.0;
+	return (PseudoPCategory((lo + 1.0) / denom) ==
+			PseudoPCategory((lo + (perms - used) + 1.0) / denom));
+}
+
+uint64_t Gda::HashBytes(const void* data, size_t n, uint64_t h)
+{
+	const unsigned char* b = (const unsigned char*) data;
+	for (size_t i=0; i<n; i++) {
+		h ^= b[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+namespace {
+// file layout: magic, key, payload size, payload, HashBytes of payload
+const char cache_magic[8] = { 'G', 'd', 'a', 'C', 'a', 'c', 'h', '1' };
+}
+
+Gda::ResultCache::ResultCache(const wxString& proj_full_path, uint64_t key_)
+: key(key_), pos(0)
+{
+	if (proj_full_path.IsEmpty()) return;
+	wxFileName proj(proj_full_path);
+	wxString name;
+	name.Printf(wxT("%016") wxT(wxLongLongFmtSpec) wxT("x.res"),
+				(wxLongLong_t) key);
+	wxFileName f(proj.GetPath(), name);
+	f.AppendDir(proj.GetName() + ".cache");
+	fname = f.GetFullPath();
+}
+
+bool Gda::ResultCache::Load()
+{
+	buf.clear();
+	pos = 0;
+	if (!IsOk() || !wxFileExists(fname)) return false;
+	wxFile file(fname);
+	if (!file.IsOpened()) return false;
+	char magic[8];
+	uint64_t file_key = 0, size = 0, hash = 0;
+	if (file.Read(magic, 8) != 8 || memcmp(magic, cache_magic, 8) != 0 ||
+		file.Read(&file_key, 8) != 8 || file_key != key ||
+		file.Read(&size, 8) != 8 || size+32 != (uint64_t) file.Length()) {
+		return false;
+	}
+	buf.resize(size);
+	if ((size && file.Read(&buf[0], size) != (ssize_t) size) ||
+		file.Read(&hash, 8) != 8 ||
+		hash != HashBytes(buf.empty() ? 0 : &buf[0], size)) {
+		buf.clear();
+		return false;
+	}
+	return true;
+}
+
+bool Gda::ResultCache::Save(size_t max_files)
+{
+	if (!IsOk()) return false;
+	wxFileName f(fname);
+	if (!wxFileName::Mkdir(f.GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+		return false;
+	}
+	// written under another name first so that a file of the key is
+	// always complete
+	wxString tmp_name = fname + ".tmp";
+	{
+		wxFile file;
+		if (!file.Create(tmp_name, true)) return false;
+		uint64_t size = buf.size();
+		uint64_t hash = HashBytes(buf.empty() ? 0 : &buf[0], size);
+		bool ok = (file.Write(cache_magic, 8) == 8 &&
+				   file.Write(&key, 8) == 8 &&
+				   file.Write(&size, 8) == 8 &&
+				   (!size || file.Write(&buf[0], size) == size) &&
+				   file.Write(&hash, 8) == 8);
+		if (!ok) {
+			file.Close();
+			wxRemoveFile(tmp_name);
+			return false;
+		}
+	}
+	if (!wxRenameFile(tmp_name, fname, true)) return false;
+	
+	wxArrayString files;
+	wxDir::GetAllFiles(f.GetPath(), &files, "*.res", wxDIR_FILES);
+	if (files.size() > max_files) {
+		std::vector<std::pair<time_t, wxString> > by_age;
+		for (size_t i=0; i<files.size(); i++) {
+			time_t t = wxFileModificationTime(files[i]);
+			by_age.push_back(std::make_pair(t, files[i]));
+		}
+		std::sort(by_age.begin(), by_age.end());
+		for (size_t i=0, iend=files.size()-max_files; i<iend; i++) {
+			if (by_age[i].second != fname) wxRemoveFile(by_age[i].second);
+		}
+	}
+	return true;
+}
+
+void Gda::ResultCache::Put(const void* data, size_t bytes)
+{
+	uint64_t size = bytes;
+	const char* b = (const char*) &size;
+	buf.insert(buf.end(), b, b+8);
+	b = (const char*) data;
+	buf.insert(buf.end(), b, b+bytes);
+}
+
+bool Gda::ResultCache::Get(void* data, size_t bytes)
+{
+	uint64_t size = 0;
+	if (pos+8 > buf.size()) return false;
+	memcpy(&size, &buf[pos], 8);
+	if (size != bytes || pos+8+size > buf.size()) return false;
+	pos += 8;
+	if (bytes) memcpy(data, &buf[pos], bytes);
+	pos += bytes;
+	return true;
+}
+
+bool Gda::ResultCache::Fits(const std::vector<size_t>& bytes) const
+{
+	size_t p = pos;
+	for (size_t i=0; i<bytes.size(); i++) {
+		uint64_t size = 0;
+		if (p+8 > buf.size()) return false;
+		memcpy(&size, &buf[p], 8);
+		if (size != bytes[i] || p+8+size > buf.size()) return false;
+		p += 8 + size;
+	}
+	return p == buf.size();
+}
+
 /** Use with std::sort for sorting in ascending order */
 bool Gda::dbl_int_pair_cmp_less(const dbl_int_pair_type& ind1,
 								  const dbl_int_pair_type& ind2)
@@ -1165,4 +1585,293 @@ std::string GenUtils::GetBasemapCacheDir()
 	wxFileName exeFile(exePath);
 	wxString exeDir = exeFile.GetPathWithSep();
 	return std::string(exeDir.mb_str());
-}
\ No newline at end of file
+}
+
+int GenUtils::NumThreads(size_t nobs, int nthreads)
+{
+	if (nthreads <= 0) nthreads = boost::thread::hardware_concurrency();
+	if (nthreads <= 0) nthreads = 1;
+	if ((size_t) nthreads > nobs) nthreads = (int) nobs;
+	return nthreads;
+}
+
+namespace {
+/** One job of the task pool: the tasks still to be done are held as one
+ range per worker.  A worker takes grain sized pieces from the front of its
+ own range and, once that is empty, moves the back half of the largest
+ other range into its own. */
+struct TaskJob {
+	struct Share {
+		boost::mutex mtx;
+		// changed under mtx only, atomic so that thieves can peek at sizes
+		boost::atomic<size_t> first; // next task
+		boost::atomic<size_t> last; // one past the last task
+	};
+	
+	TaskJob(size_t ntasks_, size_t grain_, int nworkers_,
+			const boost::function<void (size_t, size_t, int)>& work_,
+			const boost::function<bool (size_t, size_t)>& progress_)
+	: ntasks(ntasks_), grain(grain_), nworkers(nworkers_), work(work_),
+	progress(progress_), shares(new Share[nworkers_]), done(0),
+	cancelled(false), active(0), caller(boost::this_thread::get_id()),
+	last_report(0)
+	{
+		size_t quotient = ntasks / nworkers;
+		size_t remainder = ntasks % nworkers;
+		for (int i=0; i<nworkers; i++) {
+			if ((size_t) i < remainder) {
+				shares[i].first = i*(quotient+1);
+				shares[i].last = shares[i].first+quotient+1;
+			} else {
+				shares[i].first = remainder*(quotient+1)+(i-remainder)*quotient;
+				shares[i].last = shares[i].first+quotient;
+			}
+		}
+	}
+	~TaskJob() { delete [] shares; }
+	
+	bool Take(int id, size_t& a, size_t& b);
+	bool Steal(int id);
+	bool Report();
+	void Run(int id);
+	
+	size_t ntasks;
+	size_t grain;
+	int nworkers;
+	boost::function<void (size_t, size_t, int)> work;
+	boost::function<bool (size_t, size_t)> progress;
+	Share* shares;
+	boost::atomic<size_t> done;
+	boost::atomic<bool> cancelled;
+	int active; // pool threads still working, guarded by the pool mutex
+	boost::thread::id caller; // the thread that called RunTasks
+	wxStopWatch sw;
+	long last_report;
+};
+
+bool TaskJob::Take(int id, size_t& a, size_t& b)
+{
+	Share& s = shares[id];
+	boost::mutex::scoped_lock lock(s.mtx);
+	a = s.first;
+	size_t l = s.last;
+	if (a >= l) return false;
+	b = l - a > grain ? a + grain : l;
+	s.first = b;
+	return true;
+}
+
+bool TaskJob::Steal(int id)
+{
+	for (;;) {
+		// unlocked sizes are only a hint for picking the victim
+		int victim = -1;
+		size_t most = 0;
+		for (int i=1; i<nworkers; i++) {
+			int v = (id+i) % nworkers;
+			size_t f = shares[v].first, l = shares[v].last;
+			if (l > f && l-f > most) { most = l-f; victim = v; }
+		}
+		if (victim < 0) return false;
+		size_t a = 0, b = 0;
+		{
+			boost::mutex::scoped_lock lock(shares[victim].mtx);
+			Share& s = shares[victim];
+			size_t f = s.first;
+			b = s.last;
+			if (f >= b) continue;
+			a = f + (b - f)/2;
+			s.last = a;
+		}
+		boost::mutex::scoped_lock lock(shares[id].mtx);
+		shares[id].first = a;
+		shares[id].last = b;
+		return true;
+	}
+}
+
+/** Called on the thread that called RunTasks only, whichever worker it
+ is.  Returns false once cancelled. */
+bool TaskJob::Report()
+{
+	if (cancelled) return false;
+	if (progress.empty()) return true;
+	long t = sw.Time();
+	if (t - last_report < 100) return true;
+	last_report = t;
+	if (!progress(done, ntasks)) cancelled = true;
+	return !cancelled;
+}
+
+void TaskJob::Run(int id)
+{
+	size_t a = 0, b = 0;
+	while (!cancelled) {
+		if (!Take(id, a, b)) {
+			if (!Steal(id)) break;
+			continue;
+		}
+		work(a, b-1, id);
+		done += b-a;
+		if (boost::this_thread::get_id() == caller) Report();
+	}
+}
+
+/** Process-wide pool of worker threads shared by RunTasks.  The threads are
+ started on first use and wait for jobs until Shutdown, after which jobs
+ run on the calling thread alone.  One job runs at a time; the submitting
+ thread works as worker 0. */
+class TaskPool {
+public:
+	static TaskPool& Get() {
+		static TaskPool* pool = new TaskPool();
+		return *pool;
+	}
+	static bool Started() { return started; }
+	int Size() const { return stopped ? 1 : (int) threads.size() + 1; }
+	bool InTask() const { return in_task.get() != 0; }
+	void Run(TaskJob& job);
+	void Shutdown();
+	
+private:
+	TaskPool();
+	void Loop(int id);
+	
+	static boost::atomic<bool> started;
+	boost::mutex submit_mtx; // one job at a time
+	boost::mutex mtx;
+	boost::condition_variable job_cond;
+	boost::condition_variable done_cond;
+	TaskJob* job;
+	unsigned long generation;
+	boost::atomic<bool> stopped; // set under mtx by Shutdown
+	boost::thread_group threads;
+	boost::thread_specific_ptr<bool> in_task;
+};
+
+boost::atomic<bool> TaskPool::started(false);
+
+TaskPool::TaskPool() : job(0), generation(0), stopped(false)
+{
+	int n = boost::thread::hardware_concurrency();
+	for (int i=1; i<n; i++) {
+		threads.create_thread(boost::bind(&TaskPool::Loop, this, i));
+	}
+	started = true;
+	LOG_MSG(wxString::Format("Task pool started with %d workers", Size()));
+}
+
+/** Stops and joins the pool threads once the job in progress, if any, is
+ done. */
+void TaskPool::Shutdown()
+{
+	boost::mutex::scoped_lock submit_lock(submit_mtx);
+	{
+		boost::mutex::scoped_lock lock(mtx);
+		if (stopped) return;
+		stopped = true;
+		++generation;
+		job_cond.notify_all();
+	}
+	threads.join_all();
+	LOG_MSG("Task pool stopped");
+}
+
+void TaskPool::Loop(int id)
+{
+	in_task.reset(new bool(true));
+	unsigned long seen = 0;
+	for (;;) {
+		TaskJob* j = 0;
+		{
+			boost::mutex::scoped_lock lock(mtx);
+			while (generation == seen) job_cond.wait(lock);
+			if (stopped) return;
+			seen = generation;
+			// job is reset once finished, so a late wake up sees no job
+			if (job && id < job->nworkers) j = job;
+		}
+		if (!j) continue;
+		j->Run(id);
+		boost::mutex::scoped_lock lock(mtx);
+		if (--j->active == 0) done_cond.notify_all();
+	}
+}
+
+void TaskPool::Run(TaskJob& j)
+{
+	boost::mutex::scoped_lock submit_lock(submit_mtx);
+	if (stopped) {
+		// worker 0 steals the shares of the others
+		in_task.reset(new bool(true));
+		j.Run(0);
+		in_task.reset();
+		return;
+	}
+	{
+		boost::mutex::scoped_lock lock(mtx);
+		j.active = j.nworkers - 1;
+		job = &j;
+		++generation;
+		job_cond.notify_all();
+	}
+	in_task.reset(new bool(true));
+	j.Run(0);
+	in_task.reset();
+	boost::mutex::scoped_lock lock(mtx);
+	while (j.active > 0) {
+		done_cond.timed_wait(lock, boost::posix_time::milliseconds(100));
+		if (j.active > 0) {
+			lock.unlock();
+			j.Report();
+			lock.lock();
+		}
+	}
+	job = 0;
+}
+} // end anonymous namespace
+
+/** Run work on the shared task pool, limited to NumThreads(nobs, nthreads)
+ workers.  Ranges are handed out dynamically, so unlike the old static
+ split a range no longer corresponds to a fixed share of the
+ observations. */
+void GenUtils::RunThreaded(size_t nobs,
+						   boost::function<void (size_t, size_t, int)> work,
+						   int nthreads)
+{
+	RunTasks(nobs, work, 0, nthreads);
+}
+
+bool GenUtils::RunTasks(size_t ntasks,
+						boost::function<void (size_t, size_t, int)> work,
+						size_t grain, int nthreads,
+						boost::function<bool (size_t, size_t)> progress)
+{
+	if (ntasks == 0) return true;
+	TaskPool& pool = TaskPool::Get();
+	int nworkers = NumThreads(ntasks, nthreads);
+	if (nworkers > pool.Size()) nworkers = pool.Size();
+	if (pool.InTask()) nworkers = 1;
+	if (grain == 0) grain = ntasks / (16*nworkers);
+	if (grain == 0) grain = 1;
+	TaskJob job(ntasks, grain, nworkers, work, progress);
+	if (nworkers == 1) {
+		job.Run(0);
+	} else {
+		pool.Run(job);
+	}
+	return !job.cancelled;
+}
+
+void GenUtils::ShutdownTaskPool()
+{
+	if (TaskPool::Started()) TaskPool::Get().Shutdown();
+}
+
+bool GenUtils::RunTasks(size_t ntasks, TaskRangeFn work,
+						TaskProgressFn progress, void* ctx, size_t grain)
+{
+	boost::function<bool (size_t, size_t)> p;
+	if (progress) p = boost::bind(progress, ctx, _1, _2);
+	return RunTasks(ntasks, boost::bind(work, ctx, _1, _2, _3), grain, 0, p);
+}
@@ -24,11 +24,13 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <boost/function.hpp>
 #include <wx/colour.h>
 #include <wx/filename.h>
 #include <wx/string.h>
 #include <wx/gdicmn.h> // for wxPoint / wxRealPoint
 #include <wx/textwrapper.h>
+#include "TaskPool.h"
 
 // file name encodings
 // in windows, wxString.fn_str() will return a wchar*, which take care of 
@@ -72,6 +74,138 @@ namespace Gda {
 	 simulations with a common random seed for reproducibility. */
 	double ThomasWangHashDouble(uint64_t key);
 	
+	/** Counter-based random numbers in the style of Philox4x32-10
+	 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", 2011).
+	 The k-th value of the stream for (seed, obs, perm) is a function of
+	 those four numbers only, so the permutations drawn for an observation
+	 do not depend on which thread draws them or in what order. */
+	class CounterRng {
+	public:
+		CounterRng(uint64_t seed, uint64_t obs, uint64_t perm);
+		/** Next uniformly distributed double in [0,1) of the stream. */
+		double NextDouble();
+	private:
+		void Generate();
+		uint32_t key[2];
+		uint32_t ctr[4];
+		uint32_t out[4];
+		int used;
+	};
+	
+	/** Random neighbor draws shared by all observations of a local
+	 permutation test.  Permutation perm of the table holds width distinct
+	 indices drawn uniformly from 0..num_obs-2.  For a focal observation
+	 obs, an index r is read as Shift(r, obs), that is r+1 when r >= obs,
+	 which maps 0..num_obs-2 one to one onto the observations other than
+	 obs.  The first k entries of a permutation are then a uniform random
+	 k-subset of the other observations: the same distribution as drawing
+	 k distinct neighbors for obs directly, so one table serves every
+	 neighbor count k and every observation.  Each observation on its own
+	 is tested exactly as before; only the draws are shared between
+	 observations.
+	 
+	 Entry j of all permutations is stored contiguously, so that LagSums
+	 can gather the values of several permutations at once with AVX2 or
+	 AVX-512 when the CPU has them. */
+	class PermTable {
+	public:
+		/** Number of permutations LagSums is best called for at a time. */
+		enum { block_size = 64 };
+		
+		PermTable() : num_obs(0), width(0), perms(0), simd(0) {}
+		/** Draws perms permutations from CounterRng streams of seed.
+		 Returns false and leaves the table empty when there is nothing to
+		 draw, width exceeds num_obs-1, or perms*width exceeds
+		 max_entries. */
+		bool Init(int num_obs, int width, int perms, uint64_t seed,
+				  size_t max_entries=(1<<24));
+		void Clear() { table.clear(); num_obs = 0; width = 0; perms = 0; }
+		bool IsEmpty() const { return table.empty(); }
+		static int Shift(int r, int obs) { return r >= obs ? r+1 : r; }
+		/** lag[p] = sum of x[Shift(r, obs)] over the first k entries r of
+		 permutation first+p, for p = 0..n-1.  The terms are added in the
+		 same order by every kernel, and weighted terms are multiplied and
+		 added without fusing into an FMA, so with GCC and MSVC the sums do
+		 not depend on the instruction set used. */
+		void LagSums(const double* x, int obs, int k, int first, int n,
+					 double* lag) const { LagSums(x, obs, k, 0, first, n, lag); }
+		/** Weighted LagSums: lag[p] = sum of w[j]*x[Shift(r, obs)] over
+		 the first k entries r of permutation first+p, with entry j paired
+		 with weight j, or LagSums when w is 0.  The weights of an
+		 observation are contiguous in a CsrWeight, and entry j of the
+		 block is contiguous in the table, so both stream through the
+		 kernels. */
+		void LagSums(const double* x, int obs, int k, const double* w,
+					 int first, int n, double* lag) const;
+		/** LagSums for ncols variables at once, with the values of
+		 observation j at xs[j*ncols] to xs[j*ncols+ncols-1]:
+		 lag[p*ncols+c] is the sum for variable c and permutation first+p.
+		 Each drawn neighbor then brings the values of all variables in a
+		 cache line or two.  The terms are added in the same order as by
+		 LagSums. */
+		void LagSums(const double* xs, int ncols, int obs, int k, int first,
+					 int n, double* lag) const;
+		/** Kernel chosen by LagSums: "AVX-512", "AVX2" or "scalar". */
+		static const char* SimdName(int level);
+		/** Best kernel level supported by this CPU and OS: 2 for AVX-512,
+		 1 for AVX2 and 0 for the portable loop. */
+		static int SimdLevel();
+	private:
+		void FillPerms(uint64_t seed, size_t first, size_t last);
+		int num_obs;
+		int width;
+		int perms;
+		int simd;
+		std::vector<int> table; // entry j of perm p at table[j*perms+p]
+	};
+	
+	/** Significance category of a pseudo p-value as used by the local
+	 statistics: 0: >0.05 1: 0.05, 2: 0.01, 3: 0.001, 4: 0.0001 */
+	int PseudoPCategory(double p);
+	
+	/** Sequential stopping rule for a permutation test with perms planned
+	 draws whose pseudo p-value is (min(larger, perms-larger)+1)/(perms+1).
+	 After used draws of which larger were at least as extreme as the
+	 observed value, returns true once no outcome of the remaining draws
+	 can move the final pseudo p-value into another PseudoPCategory.  In
+	 the spirit of Besag and Clifford (1991), clearly non-significant
+	 observations are then decided after a small fraction of the draws,
+	 while the categories stay exactly those of the full run. */
+	bool PermTestDecided(uint64_t larger, uint64_t used, uint64_t perms);
+	
+	/** 64-bit FNV-1a hash of n bytes, continuing from hash h. */
+	uint64_t HashBytes(const void* data, size_t n,
+					   uint64_t h = 14695981039346656037ULL);
+	
+	/** Saved results of a computation, in a file of the directory
+	 <project name>.cache beside the project file.  The file is named by a
+	 key that hashes everything the results depend on, so results of
+	 changed data or parameters are never found.  Arrays added with Put
+	 are read back with Get in the same order and with the same sizes. */
+	class ResultCache {
+	public:
+		/** Disabled when proj_full_path is empty, i.e. for a project that
+		 has not been saved. */
+		ResultCache(const wxString& proj_full_path, uint64_t key);
+		bool IsOk() const { return !fname.IsEmpty(); }
+		/** Reads the file of the key.  Returns false if there is none or
+		 it is damaged. */
+		bool Load();
+		/** Writes the arrays added with Put.  The oldest files are
+		 removed when the directory holds more than max_files. */
+		bool Save(size_t max_files = 200);
+		void Put(const void* data, size_t bytes);
+		bool Get(void* data, size_t bytes);
+		/** True if the loaded file holds exactly arrays of the given sizes,
+		 in order, so that the Get calls for them cannot fail part way. */
+		bool Fits(const std::vector<size_t>& bytes) const;
+	private:
+		wxString fname;
+		uint64_t key;
+		std::vector<char> buf;
+		size_t pos;
+	};
+	
 	inline bool IsNaN(double x) { return x != x; }
 	inline bool IsFinite(double x) { return x-x == 0; }
 }
@@ -333,7 +467,40 @@ namespace GenUtils {
 	wxString WrapText(wxWindow *win, const wxString& text, int widthMax);
 
 	std::string GetBasemapCacheDir();
-    
+	
+	/** Number of worker threads RunThreaded will use for nobs observations.
+	 If nthreads is not positive, one thread per available core is used. */
+	int NumThreads(size_t nobs, int nthreads=0);
+	/** Split observations 0..nobs-1 into contiguous inclusive ranges and
+	 call work(obs_start, obs_end, thread_id) for each range on the shared
+	 task pool.  thread_id runs from 0 to NumThreads(nobs, nthreads)-1 and
+	 is never used by two calls at the same time.  Returns once all ranges
+	 have been processed. */
+	void RunThreaded(size_t nobs,
+					 boost::function<void (size_t, size_t, int)> work,
+					 int nthreads=0);
+	/** Run tasks 0..ntasks-1 on the process-wide work-stealing task pool.
+	 work(first, last, worker_id) is called for inclusive ranges of at most
+	 grain tasks (by default about sixteen ranges per worker).  Each worker
+	 starts with an even share of the tasks; a worker that runs out steals
+	 half of the largest remaining share of another worker.  worker_id runs
+	 from 0 to NumThreads(ntasks, nthreads)-1 and is never used by two calls
+	 at the same time, so it can index per-thread scratch space.  The
+	 calling thread works as worker 0 and, if progress is given, calls
+	 progress(tasks_done, ntasks) about ten times a second; progress is
+	 only ever called on the calling thread, so it may update the GUI when
+	 RunTasks is called from the GUI thread.  When progress returns false
+	 no further ranges are started.  Returns false if the run was
+	 cancelled.  Calls made from inside a task run serially. */
+	bool RunTasks(size_t ntasks,
+				  boost::function<void (size_t, size_t, int)> work,
+				  size_t grain=0, int nthreads=0,
+				  boost::function<bool (size_t, size_t)> progress=0);
+	/** Stop and join the threads of the task pool, if it was started.
+	 Called once at application exit; later RunTasks calls run on the
+	 calling thread alone. */
+	void ShutdownTaskPool();
+	// RunTasks with plain function pointers is declared in TaskPool.h
 }
 
 /** Old code used by LISA functions */
@@ -149,6 +149,7 @@
 #include "FramesManager.h"
 #include "GdaConst.h"
 #include "GeneralWxUtils.h"
+#include "GenUtils.h"
 #include "VarTools.h"
 #include "logger.h"
 #include "Project.h"
@@ -388,6 +389,7 @@ bool GdaApp::OnInit(void)
 int GdaApp::OnExit(void)
 {
 	LOG_MSG("In GdaApp::OnExit");
+	GenUtils::ShutdownTaskPool();
 	if (checker) delete checker;
 	return 0;
 }
@@ -690,6 +692,7 @@ EVT_TOOL(XRCID("ID_LISA_MENU"), GdaFrame::OnLisaMenuChoices)
 EVT_MENU(XRCID("IDM_UNI_LISA"), GdaFrame::OnOpenUniLisa)
 EVT_TOOL(XRCID("IDM_UNI_LISA"), GdaFrame::OnOpenUniLisa)
 EVT_BUTTON(XRCID("IDM_UNI_LISA"), GdaFrame::OnOpenUniLisa)
+EVT_MENU(XRCID("IDM_UNI_LISA_VARS"), GdaFrame::OnOpenUniLisaVars)
 EVT_MENU(XRCID("IDM_MULTI_LISA"), GdaFrame::OnOpenMultiLisa)
 EVT_TOOL(XRCID("IDM_MULTI_LISA"), GdaFrame::OnOpenMultiLisa)
 EVT_BUTTON(XRCID("IDM_MULTI_LISA"), GdaFrame::OnOpenMultiLisa)
@@ -702,6 +705,8 @@ EVT_BUTTON(XRCID("IDM_GETIS_ORD_MENU"), GdaFrame::OnGetisMenuChoices)
 
 EVT_MENU(XRCID("IDM_LOCAL_G"), GdaFrame::OnOpenGetisOrd)
 EVT_MENU(XRCID("IDM_LOCAL_G_STAR"), GdaFrame::OnOpenGetisOrdStar)
+EVT_MENU(XRCID("IDM_LOCAL_G_VARS"), GdaFrame::OnOpenGetisOrdVars)
+EVT_MENU(XRCID("IDM_LOCAL_G_STAR_VARS"), GdaFrame::OnOpenGetisOrdStarVars)
 
 EVT_MENU(XRCID("ID_HISTOGRAM_INTERVALS"), GdaFrame::OnHistogramIntervals)
 EVT_MENU(XRCID("ID_SAVE_CONNECTIVITY_TO_TABLE"),
@@ -721,6 +726,8 @@ EVT_MENU(XRCID("ID_OPTIONS_RANDOMIZATION_OTHER"),
 
 EVT_MENU(XRCID("ID_USE_SPECIFIED_SEED"), GdaFrame::OnUseSpecifiedSeed)
 EVT_MENU(XRCID("ID_SPECIFY_SEED_DLG"), GdaFrame::OnSpecifySeedDlg)
+EVT_MENU(XRCID("ID_EARLY_STOP_PERMUTATIONS"),
+		 GdaFrame::OnEarlyStopPermutations)
 
 EVT_MENU(XRCID("ID_SAVE_MORANI"), GdaFrame::OnSaveMoranI)
 
@@ -1334,6 +1341,7 @@ void GdaFrame::UpdateToolbarAndMenus()
 	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_MORAN_EBRATE"), proj_open);
 	EnableTool(XRCID("IDM_UNI_LISA"), shp_proj);
 	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_UNI_LISA"), shp_proj);
+	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_UNI_LISA_VARS"), shp_proj);
 	EnableTool(XRCID("IDM_MULTI_LISA"), shp_proj);
 	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_MULTI_LISA"), shp_proj);
 	EnableTool(XRCID("IDM_LISA_EBRATE"), shp_proj);
@@ -1342,6 +1350,9 @@ void GdaFrame::UpdateToolbarAndMenus()
 	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_LOCAL_G"), shp_proj);
 	EnableTool(XRCID("IDM_LOCAL_G_STAR"), shp_proj);
 	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_LOCAL_G_STAR"), shp_proj);
+	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_LOCAL_G_VARS"), shp_proj);
+	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_LOCAL_G_STAR_VARS"),
+								   shp_proj);
 	
 	
 	EnableTool(XRCID("IDM_CORRELOGRAM"), shp_proj);
@@ -3721,6 +3732,98 @@ void GdaFrame::OnOpenUniLisa(wxCommandEvent& event)
 	}
 }
 
+boost::uuids::uuid GdaFrame::GetSeveralVars(Project* p,
+				std::vector<std::vector<GdaVarTools::VarInfo> >& var_infos,
+				std::vector<std::vector<int> >& col_ids)
+{
+	WeightsManInterface* w_man_int = p->GetWManInt();
+	boost::uuids::uuid w_id = w_man_int->GetDefault();
+	if (w_id.is_nil()) {
+		wxMessageDialog dlg (this, "GeoDa could not find the required weights file. \nPlease specify weights in Tools > Weights Manager.", "No Weights Found", wxOK | wxICON_ERROR);
+		dlg.ShowModal();
+		return boost::uuids::nil_uuid();
+	}
+	if (w_man_int->GetGal(w_id) == NULL) {
+		wxMessageDialog dlg (this, "Invalid Weights Information:\n\n The default weights file is not valid.\n Please choose another weights file in Tools > Weights > Weights Manager.", "Warning", wxOK | wxICON_WARNING);
+		dlg.ShowModal();
+		return boost::uuids::nil_uuid();
+	}
+	
+	TableInterface* table_int = p->GetTableInt();
+	int time = p->GetTimeState()->GetCurrTime();
+	std::vector<int> col_id_map;
+	table_int->FillNumericColIdMap(col_id_map);
+	wxArrayString names;
+	for (size_t i=0; i<col_id_map.size(); i++) {
+		wxString name = table_int->GetColName(col_id_map[i]);
+		if (table_int->IsColTimeVariant(col_id_map[i])) {
+			name << " (" << table_int->GetTimeString(time) << ")";
+		}
+		names.Add(name);
+	}
+	wxString msg;
+	msg << "Weights: " << w_man_int->GetShortDispName(w_id);
+	msg << "\n(the default weights, set in Tools > Weights Manager)";
+	wxMultiChoiceDialog dlg(this, msg, "Variables", names);
+	if (dlg.ShowModal() != wxID_OK) return boost::uuids::nil_uuid();
+	wxArrayInt sel = dlg.GetSelections();
+	if (sel.IsEmpty()) return boost::uuids::nil_uuid();
+	
+	var_infos.resize(sel.size());
+	col_ids.resize(sel.size());
+	for (size_t i=0; i<sel.size(); i++) {
+		int col = col_id_map[sel[i]];
+		col_ids[i].assign(1, col);
+		var_infos[i].resize(1);
+		GdaVarTools::VarInfo& v = var_infos[i][0];
+		v.name = table_int->GetColName(col);
+		v.is_time_variant = table_int->IsColTimeVariant(col);
+		v.time = time;
+		table_int->GetMinMaxVals(col, v.min, v.max);
+		v.sync_with_global_time = v.is_time_variant;
+		v.fixed_scale = true;
+		GdaVarTools::UpdateVarInfoSecondaryAttribs(var_infos[i]);
+	}
+	return w_id;
+}
+
+/** Univariate LISA maps for several variables.  The permutations of all
+ variables are drawn once, see LisaCoordinator::CreateBatch. */
+void GdaFrame::OnOpenUniLisaVars(wxCommandEvent& event)
+{
+	Project* p = GetProject();
+	if (!p) return;
+	
+	std::vector<std::vector<GdaVarTools::VarInfo> > var_infos;
+	std::vector<std::vector<int> > col_ids;
+	boost::uuids::uuid w_id = GetSeveralVars(p, var_infos, col_ids);
+	if (w_id.is_nil()) return;
+	
+	LisaWhat2OpenDlg LWO(this);
+	if (LWO.ShowModal() != wxID_OK) return;
+	if (!LWO.m_ClustMap && !LWO.m_SigMap && !LWO.m_Moran) return;
+	
+	std::vector<LisaCoordinator*> lcs =
+		LisaCoordinator::CreateBatch(w_id, p, var_infos, col_ids,
+									 LisaCoordinator::univariate,
+									 LWO.m_RowStand);
+	for (size_t i=0; i<lcs.size(); i++) {
+		if (LWO.m_Moran) {
+			LisaScatterPlotFrame *sf = new LisaScatterPlotFrame(GdaFrame::gda_frame,
+																p, lcs[i]);
+		}
+		if (LWO.m_ClustMap) {
+			LisaMapFrame *sf = new LisaMapFrame(GdaFrame::gda_frame, p,
+												lcs[i], true, false, false);
+		}
+		if (LWO.m_SigMap) {
+			LisaMapFrame *sf = new LisaMapFrame(GdaFrame::gda_frame, p,
+												lcs[i], false, false, false,
+												wxDefaultPosition);
+		}
+	}
+}
+
 void GdaFrame::OnOpenMultiLisa(wxCommandEvent& event)
 {
     Project* p = GetProject();
@@ -3964,6 +4067,58 @@ void GdaFrame::OnOpenGetisOrd(wxCommandEvent& event)
     }
 }
 
+void GdaFrame::OnOpenGetisOrdVars(wxCommandEvent& event)
+{
+	OpenGetisOrdVars(false);
+}
+
+void GdaFrame::OnOpenGetisOrdStarVars(wxCommandEvent& event)
+{
+	OpenGetisOrdVars(true);
+}
+
+/** Local G or G* maps for several variables.  The permutations of all
+ variables are drawn once, see GStatCoordinator::CreateBatch. */
+void GdaFrame::OpenGetisOrdVars(bool gi_star)
+{
+	Project* p = GetProject();
+	if (!p) return;
+	
+	std::vector<std::vector<GdaVarTools::VarInfo> > var_infos;
+	std::vector<std::vector<int> > col_ids;
+	boost::uuids::uuid w_id = GetSeveralVars(p, var_infos, col_ids);
+	if (w_id.is_nil()) return;
+	
+	GetisWhat2OpenDlg LWO(this);
+	if (LWO.ShowModal() != wxID_OK) return;
+	if (!LWO.m_ClustMap && !LWO.m_SigMap) return;
+	
+	GetisOrdMapFrame::GMapType clus_type, sig_type;
+	if (gi_star) {
+		clus_type = (LWO.m_NormMap ? GetisOrdMapFrame::GiStar_clus_norm :
+					 GetisOrdMapFrame::GiStar_clus_perm);
+		sig_type = (LWO.m_NormMap ? GetisOrdMapFrame::GiStar_sig_norm :
+					GetisOrdMapFrame::GiStar_sig_perm);
+	} else {
+		clus_type = (LWO.m_NormMap ? GetisOrdMapFrame::Gi_clus_norm :
+					 GetisOrdMapFrame::Gi_clus_perm);
+		sig_type = (LWO.m_NormMap ? GetisOrdMapFrame::Gi_sig_norm :
+					GetisOrdMapFrame::Gi_sig_perm);
+	}
+	
+	std::vector<GStatCoordinator*> gcs =
+		GStatCoordinator::CreateBatch(w_id, p, var_infos, col_ids,
+									  LWO.m_RowStand);
+	for (size_t i=0; i<gcs.size(); i++) {
+		if (LWO.m_ClustMap) {
+			GetisOrdMapFrame* f = new GetisOrdMapFrame(this, p, gcs[i], clus_type, LWO.m_RowStand);
+		}
+		if (LWO.m_SigMap) {
+			GetisOrdMapFrame* f = new GetisOrdMapFrame(this, p, gcs[i], sig_type, LWO.m_RowStand);
+		}
+	}
+}
+
 void GdaFrame::OnNewCustomCatClassifA(wxCommandEvent& event)
 {
     Project* p = GetProject();
@@ -5139,6 +5294,17 @@ void GdaFrame::OnSpecifySeedDlg(wxCommandEvent& event)
     }
 }
 
+void GdaFrame::OnEarlyStopPermutations(wxCommandEvent& event)
+{
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	if (LisaMapFrame* f = dynamic_cast<LisaMapFrame*>(t)) {
+		f->OnEarlyStopPermutations(event);
+	} else if (GetisOrdMapFrame* f = dynamic_cast<GetisOrdMapFrame*>(t)) {
+		f->OnEarlyStopPermutations(event);
+	}
+}
+
 void GdaFrame::OnSaveMoranI(wxCommandEvent& event)
 {
 	TemplateFrame* t = TemplateFrame::GetActiveFrame();
@@ -48,6 +48,9 @@ class GdaServer;
 class GdaClient;
 class GdaConnection;
 class LineChartFrame;
+namespace GdaVarTools {
+	struct VarInfo;
+}
 
 /** Main appilcation class. */
 class GdaApp: public wxApp
@@ -236,10 +239,21 @@ public:
 	void OnLisaMenuChoices(wxCommandEvent& event);
 	void OnGetisMenuChoices(wxCommandEvent& event);
 	void OnOpenUniLisa(wxCommandEvent& event);
+	void OnOpenUniLisaVars(wxCommandEvent& event);
 	void OnOpenMultiLisa(wxCommandEvent& event);
 	void OnOpenLisaEB(wxCommandEvent& event);
 	void OnOpenGetisOrd(wxCommandEvent& event);
 	void OnOpenGetisOrdStar(wxCommandEvent& event);
+	void OnOpenGetisOrdVars(wxCommandEvent& event);
+	void OnOpenGetisOrdStarVars(wxCommandEvent& event);
+	/** Ask for the variables of LISA or Local G maps opened for several
+	 variables at once.  Fills var_infos and col_ids with one univariate
+	 entry per chosen variable and returns the default weights, or a nil
+	 id if there are no valid weights or the user cancelled. */
+	boost::uuids::uuid GetSeveralVars(Project* p,
+					std::vector<std::vector<GdaVarTools::VarInfo> >& var_infos,
+					std::vector<std::vector<int> >& col_ids);
+	void OpenGetisOrdVars(bool gi_star);
 
 	void OnNewCustomCatClassifA(wxCommandEvent& event);
 	void OnNewCustomCatClassifB(wxCommandEvent& event);
@@ -546,6 +560,7 @@ public:
 	
 	void OnUseSpecifiedSeed(wxCommandEvent& event);
 	void OnSpecifySeedDlg(wxCommandEvent& event);
+	void OnEarlyStopPermutations(wxCommandEvent& event);
 	
 	void OnSaveMoranI(wxCommandEvent& event);
 	
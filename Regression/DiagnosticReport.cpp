@@ -22,8 +22,13 @@
 #include "DiagnosticReport.h"
 
 DiagnosticReport::DiagnosticReport(long obs, int nvar,
-								   bool inclconst, bool w, int m)
-: nObs(obs), nVar(nvar), inclConstant(inclconst), model(m), hasWeight(w)
+								   bool inclconst, bool w, int m,
+								   bool keep_resid)
+: nObs(obs), nVar(nvar), inclConstant(inclconst), model(m), hasWeight(w),
+keepResid(keep_resid),
+approx_ld_probes(0), approx_tr_probes(0), approx_order(0),
+approx_lik_se(0), approx_lik_trunc(0), approx_tr_rse(0),
+approx_trunc_high(false), chol_nnz(0), chol_asym(false)
 {
 	if (Allocate()) {
 		SetDiagStatus(false);
@@ -52,11 +57,14 @@ bool DiagnosticReport::Allocate()
 	stats = new double[nVar+1];
 	probs = new double[nVar+1];
 	bptest= new double[6];
-	alloc(resid, nObs+1);
-	yhat	= new double[nObs+1];
+	resid = yhat = NULL;
+	if (keepResid) {
+		alloc(resid, nObs+1);
+		yhat	= new double[nObs+1];
+	}
 	eigval	= new double[nVar];
 
-	if (resid == NULL) {
+	if (keepResid && resid == NULL) {
 		wxMessageBox("Not enough memory!");
 		return false;
 	}
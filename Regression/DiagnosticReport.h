@@ -23,10 +23,31 @@
 #include <vector>
 #include <wx/string.h>
 
+/** Summary of one OLS specification of a batch run (see batchRegression).
+ vars are the columns of the candidate regressors used, coeff and probs
+ are in the same order.  The p-values are 0 for tests not computed. */
+struct RegressionSpecResult
+{
+	RegressionSpecResult() : ok(false), r2(0), r2_a(0), lik(0), aic(0), sc(0),
+	sig_sq(0), ftest(0), ftestP(0), condnumber(0), jb(0), jb_prob(0),
+	moranI(0), moranI_prob(0), lmlag_prob(0), lmlagr_prob(0), lmerr_prob(0),
+	lmerrr_prob(0), lmsarma_prob(0) {}
+	std::vector<int> vars;
+	std::vector<double> coeff, probs;
+	bool ok; // false if X'X of the specification could not be inverted
+	double r2, r2_a, lik, aic, sc, sig_sq, ftest, ftestP, condnumber;
+	double jb, jb_prob, moranI, moranI_prob;
+	double lmlag_prob, lmlagr_prob, lmerr_prob, lmerrr_prob, lmsarma_prob;
+};
+
 class DiagnosticReport  
 {
 public:
-	DiagnosticReport(long obs, int nvar, bool inclconst, bool w, int model);
+	/** With keep_resid false the residuals and predicted values are not
+	 stored (GetResidual and GetYHAT return NULL), for regressions that
+	 write them to the Table instead. */
+	DiagnosticReport(long obs, int nvar, bool inclconst, bool w, int model,
+					 bool keep_resid = true);
 	virtual ~DiagnosticReport();
 
 	long			GetNoObservation()				{return nObs;};
@@ -82,10 +103,31 @@ public:
 	double*			GetWaldTest()					{return wald_test;};
 	double			GetMeanY()						{return mean_Y;};
 	double			GetSDevY()						{return sdev_Y;};
+	/// Probes of the stochastic log-Jacobian, 0 when computed exactly
+	int				GetApproxLogDetProbes()			{return approx_ld_probes;};
+	int				GetApproxTraceProbes()			{return approx_tr_probes;};
+	int				GetApproxSeriesOrder()			{return approx_order;};
+	/// Std. error and truncation bound of the approximate log likelihood
+	double			GetApproxLIKStdError()			{return approx_lik_se;};
+	double			GetApproxLIKTruncation()		{return approx_lik_trunc;};
+	/// True if the truncation bound stayed too large at the maximum order
+	bool			IsApproxTruncationHigh()		{return approx_trunc_high;};
+	/// Largest relative std. error of the information matrix traces
+	double			GetApproxTraceRelError()		{return approx_tr_rse;};
+	/// Nonzeros of the sparse Cholesky factor, 0 if it was not used
+	long			GetCholeskyFactorSize()			{return chol_nnz;};
+	/// True if the Cholesky factor was skipped for asymmetric weights
+	bool			IsCholeskyAsymmetric()			{return chol_asym;};
+	/// Other specifications compared with this OLS model, if any
+	std::vector<RegressionSpecResult>& GetSpecifications() {return specs;};
+	/// Wall-clock time of each diagnostic test, in milliseconds
+	int				GetTimingCount()				{return timing_ms.size();};
+	wxString		GetTimingName(int i)			{return timing_names[i];};
+	long			GetTimingMs(int i)				{return timing_ms[i];};
 
 protected:
 	int	 model; // 1:OLS; 2:Lag; 3:Errror
-	bool inclConstant, diagStatus, hasWeight; 
+	bool inclConstant, diagStatus, hasWeight, keepResid; 
 	std::vector<wxString> varNames;
 	long nObs;
 	int	nVar;
@@ -100,6 +142,14 @@ protected:
 	double *lmlag, *lmerr, *lmlagr, *lmerrr, *lmsarma, *kelrob;
 	double *lr_test, *lm_test, *lrcf_test, *wald_test;
 	double mean_Y, sdev_Y;
+	int approx_ld_probes, approx_tr_probes, approx_order;
+	double approx_lik_se, approx_lik_trunc, approx_tr_rse;
+	bool approx_trunc_high;
+	long chol_nnz;
+	bool chol_asym;
+	std::vector<RegressionSpecResult> specs;
+	std::vector<wxString> timing_names;
+	std::vector<long> timing_ms;
 
 public:
 	void release_Var();
@@ -143,6 +193,16 @@ public:
 	void SetWaldTest(int i, double coef) { wald_test[i] = coef;};
 	void SetMeanY(double mY) { mean_Y = mY; };
 	void SetSDevY(double sdY) { sdev_Y = sdY; };
+	void SetApproximation(int ld_probes, int tr_probes, int order,
+						  double lik_se, double lik_trunc, double tr_rse) {
+		approx_ld_probes = ld_probes; approx_tr_probes = tr_probes;
+		approx_order = order; approx_lik_se = lik_se;
+		approx_lik_trunc = lik_trunc; approx_tr_rse = tr_rse; };
+	void SetApproxTruncationHigh(bool high) { approx_trunc_high = high; };
+	void SetCholeskyFactorSize(long nnz) { chol_nnz = nnz; };
+	void SetCholeskyAsymmetric(bool asym) { chol_asym = asym; };
+	void AddTiming(const wxString& name, long ms) {
+		timing_names.push_back(name); timing_ms.push_back(ms); };
 
 private:
 	void SetDiagStatus(bool status);
@@ -24,10 +24,12 @@ The IDE project should also include SLStream.cpp
  */
 
 #include <time.h>
+#include <algorithm>
 #include <wx/wxprec.h>
 #ifndef WX_PRECOMP
     #include <wx/wx.h>
 #endif
+#include <wx/stopwatch.h>
 #include "../ShapeOperations/GwtWeight.h"
 #include "mix.h"
 #include "Lite2.h"
@@ -36,6 +38,7 @@ The IDE project should also include SLStream.cpp
 #include "polym.h"
 #include "ML_im.h"
 #include "../logger.h"
+#include "../TaskPool.h"
 
 // use __WXMAC__ to call vecLib
 //#ifdef WORDS_BIGENDIAN
@@ -59,6 +62,19 @@ The IDE project should also include SLStream.cpp
     extern "C" int dgesv_(integer *n, integer *nrhs, doublereal *a,
         integer *lda, integer *ipiv, doublereal *b, integer *ldb,
         integer *info);
+    extern "C" int dpotrf_(char *uplo, integer *n, doublereal *a,
+        integer *lda, integer *info);
+    extern "C" int dpotri_(char *uplo, integer *n, doublereal *a,
+        integer *lda, integer *info);
+    extern "C" int dpocon_(char *uplo, integer *n, doublereal *a,
+        integer *lda, doublereal *anorm, doublereal *rcond, doublereal *work,
+        integer *iwork, integer *info);
+    extern "C" int dsyrk_(char *uplo, char *trans, integer *n, integer *k,
+        doublereal *alpha, doublereal *a, integer *lda, doublereal *beta,
+        doublereal *c__, integer *ldc);
+    extern "C" int dgemv_(char *trans, integer *m, integer *n,
+        doublereal *alpha, doublereal *a, integer *lda, doublereal *x,
+        integer *incx, doublereal *beta, doublereal *y, integer *incy);
 #endif
 
 #define tol 1e-14
@@ -763,15 +779,270 @@ VALUE norm(WIterator it)  {
     return scale * scale * ssq;
 }    
 
+/* Rademacher probes
+* xorshift32 generator used for the probe vectors of the stochastic trace
+* and log-Jacobian estimates.  The state must not be zero.
+*/
+static wxUint32 RademacherSeed(const unsigned int seed)  {
+    wxUint32 state = (wxUint32) seed * 2654435761u + 1013904223u;
+    return state == 0 ? 1 : state;
+}
+
+static double Rademacher(wxUint32 &state)  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state & 0x80000000u) ? 1.0 : -1.0;
+}
+
+/* MeanStdError
+* sample mean of v and the standard error of that mean.
+*/
+static void MeanStdError(const std::vector<double> &v, double &mean, double &se)  {
+    const int n = v.size();
+    mean = 0;
+    se = 0;
+    if (n == 0) return;
+    for (int i = 0; i < n; ++i) mean += v[i];
+    mean /= n;
+    if (n < 2) return;
+    double ss = 0;
+    for (int i = 0; i < n; ++i) ss += geoda_sqr(v[i] - mean);
+    se = sqrt(ss / (n - 1) / n);
+}
+
+/* RelStdError
+* standard error se relative to max(|est|, 1).
+*/
+static double RelStdError(const double se, const double est)  {
+    const double a = fabs(est);
+    return se / (a > 1 ? a : 1);
+}
+
+/* Martin series for the log-Jacobian
+* approx->lj_moments holds z'W^k z, k = 1..lj_order, for each of lj_probes
+* probes.  While lj_probes > 0, LogJacobian evaluates
+*   ln|I - rho W| = -sum_k rho^k tr(W^k) / k
+* from these moments instead of the characteristic polynomial in Poly.
+*/
+static void LogDetSeries(const VALUE rho, const TraceApprox *approx,
+                         double &mean, double &se)  {
+    const int lj_order = approx->lj_order, lj_probes = approx->lj_probes;
+    std::vector<double> s(lj_probes);
+    for (int p = 0; p < lj_probes; ++p)  {
+        const double *m = &approx->lj_moments[p * lj_order];
+        double pw = 1, acc = 0;
+        for (int k = 1; k <= lj_order; ++k)  {
+            pw *= rho;
+            acc -= pw * m[k-1] / k;
+        }
+        s[p] = acc;
+    }
+    MeanStdError(s, mean, se);
+}
+
+/* InitLogDetSeries
+* estimates the moments of the Martin series for the symmetric form of the
+* row-standardized weights w (see SparseMatrix::makeStdSymmetric), which
+* has the traces of W even when W is not symmetric.  tr(W) is computed
+* exactly, and so is tr(W^2) for symmetric weights; higher powers use
+* Hutchinson's estimator.  Probes are drawn in blocks of ten until the
+* relative standard error of the log-Jacobian at rho = 0.9 is below
+* approx->rel_tol or the probe budget is spent.
+*/
+static void InitLogDetSeries(const SparseMatrix &w, bool symmetric,
+                             TraceApprox *approx)  {
+    wxStopWatch sw;
+    const int dim = w.dim(), block = 10;
+    const int lj_order = approx->series_order < 2 ? 2 : approx->series_order;
+    int &lj_probes = approx->lj_probes;
+    std::vector<double> &lj_moments = approx->lj_moments;
+    approx->lj_order = lj_order;
+    approx->lj_dim = dim;
+    lj_probes = 0;
+    lj_moments.clear();
+
+    double tr1 = 0, tr2 = 0;
+    for (int r = 0; r < dim; ++r)  {
+        const SparseRow &row = w.getRow(r);
+        for (int cnt = 0; cnt < row.getSize(); ++cnt)  {
+            if (row.getIx(cnt) == r) tr1 += row.getWeight(cnt);
+            tr2 += geoda_sqr(row.getWeight(cnt));	// symmetric: w_ij == w_ji
+        }
+    }
+
+    wxUint32 state = RademacherSeed(approx->seed);
+    DenseVector z(dim), v(dim), wv(dim);
+    double mean = 0, se = 0;
+    while (lj_probes < approx->num_probes)  {
+        for (int b = 0; b < block && lj_probes < approx->num_probes; ++b)  {
+            for (int i = 0; i < dim; ++i) z.setAt(i, Rademacher(state));
+            lj_moments.resize((lj_probes + 1) * lj_order);
+            double *m = &lj_moments[lj_probes * lj_order];
+            m[0] = tr1;
+            w.matrixColumn(wv, z);
+            w.matrixColumn(v, wv);		// v = W^2 z
+            m[1] = symmetric ? tr2 : z.product(v);
+            for (int k = 3; k <= lj_order; ++k)  {
+                w.matrixColumn(wv, v);
+                v.copy(wv);
+                m[k-1] = z.product(v);
+            }
+            ++lj_probes;
+        }
+        LogDetSeries(0.9, approx, mean, se);
+        if (se <= approx->rel_tol * fabs(mean)) break;
+    }
+    approx->logdet_probes = lj_probes;
+    LOG_MSG(wxString::Format("log-Jacobian series: %d terms, %d probes, "
+                             "%ld ms", lj_order, lj_probes, sw.Time()));
+}
+
+/* LogDetTruncation
+* bound n |rho|^(m+1) / ((m+1)(1-|rho|)) on the error of the Martin series
+* truncated after m terms; it holds for eigenvalues in [-1, 1].
+*/
+static double LogDetTruncation(const VALUE rho, const TraceApprox *approx)  {
+    const double a = fabs(rho);
+    const int m = approx->lj_order;
+    return a < 1 ? approx->lj_dim * pow(a, m + 1) / ((m + 1) * (1 - a)) : 0;
+}
+
+/* FinishLogDetSeries
+* records the accuracy of the log-Jacobian at the estimate rho and switches
+* LogJacobian back to the characteristic polynomial.
+*/
+static void FinishLogDetSeries(const VALUE rho, TraceApprox *approx)  {
+    double mean = 0, se = 0;
+    LogDetSeries(rho, approx, mean, se);
+    approx->logdet_se = se;
+    approx->logdet_trunc = LogDetTruncation(rho, approx);
+    approx->lj_probes = 0;
+    approx->lj_moments.clear();
+}
+
+/* IsSymmetric
+* true if i is a neighbor of j whenever j is a neighbor of i in my_gal.
+* SparseMatrix gives every neighbor the weight one, so only then is the
+* matrix built by makeStdSymmetric actually symmetric.
+*/
+static bool IsSymmetric(const GalElement *my_gal, int num_obs)  {
+    std::vector< std::vector<long> > nbrs(num_obs);
+    for (int i = 0; i < num_obs; ++i)  {
+        nbrs[i] = my_gal[i].GetNbrs();
+        std::sort(nbrs[i].begin(), nbrs[i].end());
+    }
+    for (int i = 0; i < num_obs; ++i)  {
+        for (size_t k = 0; k < nbrs[i].size(); ++k)  {
+            const std::vector<long> &nj = nbrs[nbrs[i][k]];
+            if (!std::binary_search(nj.begin(), nj.end(), (long) i))
+                return false;
+        }
+    }
+    return true;
+}
+
+/* InitLogJacobian
+* sets up the sparse Cholesky factor or the Martin series for the weights
+* my_gal if approx asks for one of them.  The Cholesky factor needs
+* symmetric weights; for others, such as k-nearest neighbors, approx->
+* cholesky is cleared, approx->asymmetric set, and the Martin series or
+* the characteristic polynomial used instead.  Returns false if the
+* characteristic polynomial should be used.
+*/
+static bool InitLogJacobian(const GalElement *my_gal, int num_obs,
+                            TraceApprox *approx)  {
+    if (!approx || (!approx->cholesky && approx->num_probes <= 0))
+        return false;
+    const bool symmetric = IsSymmetric(my_gal, num_obs);
+    if (approx->cholesky && !symmetric)  {
+        LOG_MSG("weights are not symmetric: no sparse Cholesky factor");
+        approx->cholesky = false;
+        approx->asymmetric = true;
+        if (approx->num_probes <= 0) return false;
+    }
+    SparseMatrix sm(my_gal, num_obs);
+    sm.rowStandardize();
+    sm.makeStdSymmetric();
+    if (approx->cholesky)  {
+        wxStopWatch sw;
+        approx->lj_chol = new SparseCholesky(sm);
+        approx->factor_size = approx->lj_chol->factorSize();
+        LOG_MSG(wxString::Format("sparse Cholesky pattern: %ld nonzeros, "
+                                 "%ld ms", approx->factor_size, sw.Time()));
+    } else  {
+        InitLogDetSeries(sm, symmetric, approx);
+    }
+    return true;
+}
+
+/* FinishLogJacobian
+* releases what InitLogJacobian set up, recording the accuracy of the
+* Martin series at the estimate rho.
+*/
+static void FinishLogJacobian(const VALUE rho, TraceApprox *approx)  {
+    if (approx->lj_chol)  {
+        delete approx->lj_chol;
+        approx->lj_chol = 0;
+    } else  {
+        FinishLogDetSeries(rho, approx);
+    }
+}
+
+/* RaiseSeriesOrder
+* checks the truncation bound of the Martin series at the estimate rho.  If
+* it exceeds both approx->rel_tol relative to the log-Jacobian and the
+* standard error of the series, the series is set up again with twice the
+* terms and true is returned so that the caller estimates again.  At
+* TraceApprox::max_series_order approx->logdet_trunc_high is set instead.
+*/
+static bool RaiseSeriesOrder(const VALUE rho, const GalElement *my_gal,
+                             int num_obs, TraceApprox *approx)  {
+    if (approx->lj_chol || approx->lj_probes <= 0) return false;
+    double mean = 0, se = 0;
+    LogDetSeries(rho, approx, mean, se);
+    const double trunc = LogDetTruncation(rho, approx);
+    if (trunc <= se || RelStdError(trunc, mean) <= approx->rel_tol)
+        return false;
+    const int max_order = TraceApprox::max_series_order;
+    if (approx->lj_order >= max_order)  {
+        approx->logdet_trunc_high = true;
+        LOG_MSG(wxString::Format("log-Jacobian series: truncation bound %g "
+                                 "at rho = %g with %d terms",
+                                 trunc, rho, approx->lj_order));
+        return false;
+    }
+    const int order = 2 * approx->lj_order;
+    approx->series_order = order < max_order ? order : max_order;
+    return InitLogJacobian(my_gal, num_obs, approx);
+}
+
+/*   LogJacobian
+* ln|I - rho W| from the sparse Cholesky factor or the Martin series in
+* approx when one is active, otherwise from the characteristic polynomial.
+*/
+static VALUE LogJacobian(const VALUE rho, const TraceApprox *approx)  {
+    if (approx && approx->lj_chol) return approx->lj_chol->logDet(rho);
+    if (approx && approx->lj_probes > 0)  {
+        double mean = 0, se = 0;
+        LogDetSeries(rho, approx, mean, se);
+        return mean;
+    }
+    return MakeEstimate(Poly(), rho, SL_Max_Precision);
+}
+
 /*   CL
 * function to compute log-likelihood function for the spatial lag model
 resid -- vector of residuals in regression y on X;
 residW -- vector or residulas in regression of Wy on X;
-rho -- value of the coefficient of spatial association.
-Note: function uses static variables Poly and SL_Max_Precision.
+rho -- value of the coefficient of spatial association;
+approx -- Martin series set up by InitLogDetSeries, or 0.
+Note: function uses static variables Poly and SL_Max_Precision unless
+approx holds the series.
 */
-VALUE   CL(WVector & resid, WVector & residW, const VALUE rho)  {
-    VALUE     lj = MakeEstimate(Poly(), rho, SL_Max_Precision);	// compute log-Jacobian
+VALUE   CL(WVector & resid, WVector & residW, const VALUE rho,
+           const TraceApprox *approx = 0)  {
+    VALUE     lj = LogJacobian(rho, approx);	// compute log-Jacobian
     WVector   tmp;
     tmp.reset();
     tmp.copy(residW());       // copy residiual of wy on X
@@ -829,9 +1100,9 @@ inline void SHFT(double &a, double &b, double &c, const double d)  {
 	c = d;
 }
 
-VALUE ErrorLogLikelihood(Iterator<WVector> X, Iterator<WVector> lagX, WIterator y, WIterator lagY, Iterator<WMap> W, const VALUE lambda, WVector &egls)  {
+VALUE ErrorLogLikelihood(Iterator<WVector> X, Iterator<WVector> lagX, WIterator y, WIterator lagY, Iterator<WMap> W, const VALUE lambda, WVector &egls, const TraceApprox *approx = 0)  {
     // compute log-Jacobian: SIGMA(ln(1 - lambda * eigenval(i)) ...
-    VALUE accum = MakeEstimate(Poly(), lambda, SL_Max_Precision);
+    VALUE accum = LogJacobian(lambda, approx);
 
     // compute sse (sum-squared error)
     WMatrix XminusLambdaLagX(X.count());
@@ -896,7 +1167,8 @@ VALUE GoldenSectionError(const VALUE left,
 												 const WVector &y,
                          Iterator<WMap> W, 
 												 double * &beta,
-												 double * LogLik)  
+												 double * LogLik,
+												 const TraceApprox *approx = 0)  
 {
     const VALUE   GoldenRatio = (sqrt((double)5)-1)/2, GoldenToo = 1 - GoldenRatio;
     VALUE     x0, x1, x2, x3, f0, f1, f2, f3;
@@ -914,8 +1186,8 @@ VALUE GoldenSectionError(const VALUE left,
     SpatialLag(W, y(), lagY);
 
     // maximizing
-    f2 = ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls);
-    f1 = ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls);
+    f2 = ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls, approx);
+    f1 = ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls, approx);
     
 
 //  this is 'classic' golden section
@@ -924,10 +1196,10 @@ VALUE GoldenSectionError(const VALUE left,
 	{
   	if (f1 < f2)  {
   		SHFT(x0, x1, x2, GoldenRatio*x2+GoldenToo*x3);
-  		SHFT(f0, f1, f2, ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls));
+  		SHFT(f0, f1, f2, ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls, approx));
   	}  else  {
   		SHFT(x3, x2, x1, GoldenRatio*x1+GoldenToo*x0);
-  		SHFT(f3, f2, f1, ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls));
+  		SHFT(f3, f2, f1, ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls, approx));
   	}
   	++Counter;
   }
@@ -951,7 +1223,8 @@ VALUE GoldenSectionLag(const VALUE left,
 											 const VALUE right, 
 											 WVector &resid, 
 											 WVector &residW,
-											 double* LogLik)  
+											 double* LogLik,
+											 const TraceApprox *approx = 0)  
 {
     const VALUE   GoldenRatio = (sqrt((double)5)-1)/2, GoldenToo = 1 - GoldenRatio;
     VALUE     x0, x1, x2, x3, f0, f1, f2, f3;
@@ -963,16 +1236,16 @@ VALUE GoldenSectionLag(const VALUE left,
     else
   	x1 -= GoldenToo * (middle - left);
     int   Counter = 2;
-    f2 = CL(resid, residW, x2);
-    f1 = CL(resid, residW, x1);
+    f2 = CL(resid, residW, x2, approx);
+    f1 = CL(resid, residW, x1, approx);
   while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)))  
 	{
   	if (f1 < f2)  {
   		SHFT(x0, x1, x2, GoldenRatio*x2+GoldenToo*x3);
-  		SHFT(f0, f1, f2, CL(resid, residW, x2));
+  		SHFT(f0, f1, f2, CL(resid, residW, x2, approx));
   	}  else  {
   		SHFT(x3, x2, x1, GoldenRatio*x1+GoldenToo*x0);
-  		SHFT(f3, f2, f1, CL(resid, residW, x1));
+  		SHFT(f3, f2, f1, CL(resid, residW, x1, approx));
   	};
   	++Counter;
   };
@@ -1258,67 +1531,42 @@ void product2(int start, double v1[], double v2[], int first, double diag[], int
 // SymMatInverse --
 // Inverts a symmetric matrix of any size in situ.
 // Returns false if fails (matrix is not a full rank matrix and true if success.
-// Uses analog of Choleski decomposition: L-D-L' decomposition.
+// Positive definite matrices, such as cross-product and information
+// matrices, are inverted from their Cholesky factor (dpotrf, dpotri), and
+// others from an LU factorization (dgesv).
 bool SymMatInverse(double ** mt, const int dim)  
 {
-	long int n = dim, nrhs = dim;
-	long int lda = dim, ldb = dim;
-	long int *ipiv = new long int [dim], info = 0;
+	integer n = dim, nrhs = dim;
+	integer lda = dim, ldb = dim, info = 0;
 	int i = 0, j = 0;
-	double *a = new double [dim * dim];
-	double *b = new double [dim * dim];
+	std::vector<double> a(dim * dim);
 	for (i = 0; i < dim; i++) {
 		for (j = 0; j < dim; j++) {
 			a[i + dim * j] = mt[i][j];
-			b[i + dim * j] = 0.0;
 		}
-		b[i + dim * i] = 1.0;
 	}
-
-// use __WXMAC__ to call vecLib format
-//#ifdef WORDS_BIGENDIAN
-//#ifdef __WXMAC__
-	dgesv_(&n, &nrhs, a, &lda, ipiv, b, &ldb, &info);
-//#else
-//	dgesv_((integer*)&n, (integer*)&nrhs, (doublereal*)a, (integer*)&lda, (integer*)ipiv, (doublereal*)b, (integer*)&ldb, (integer*)&info);
-//#endif
-
+	char uplo = 'U';
+	dpotrf_(&uplo, &n, &a[0], &lda, &info);
+	if (!info) dpotri_(&uplo, &n, &a[0], &lda, &info);
 	if (!info) {
 		for (i = 0; i < dim; i++) {
 			for (j = 0; j < dim; j++) {
-				mt[i][j] = b[i + dim * j];
+				mt[i][j] = (i <= j) ? a[i + dim * j] : a[j + dim * i];
 			}
 		}
 		return true;
-	} else {
-		return false;
 	}
-}
-
-bool SymMatInverse(double ** mt, const int dim, double ** &cov)  
-{
-		CopyMatrix(mt, cov, dim,dim);
-	long int n = dim, nrhs = dim;
-	long int lda = dim, ldb = dim;
-	long int *ipiv = new long int [dim], info = 0;
-	int i = 0, j = 0;
-	double *a = new double [dim * dim];
-	double *b = new double [dim * dim];
+	
+	std::vector<integer> ipiv(dim);
+	std::vector<double> b(dim * dim, 0.0);
 	for (i = 0; i < dim; i++) {
 		for (j = 0; j < dim; j++) {
 			a[i + dim * j] = mt[i][j];
-			b[i + dim * j] = 0.0;
 		}
 		b[i + dim * i] = 1.0;
 	}
-
-// use __WXMAC__ to call vecLib
-//#ifdef WORDS_BIGENDIAN
-#ifdef __WXMAC__MMM
-	dgesv_(&n, &nrhs, a, &lda, ipiv, b, &ldb, &info);
-#else
-	dgesv_((integer*)&n, (integer*)&nrhs, (doublereal*)a, (integer*)&lda, (integer*)ipiv, (doublereal*)b, (integer*)&ldb, (integer*)&info);
-#endif
+	info = 0;
+	dgesv_(&n, &nrhs, &a[0], &lda, &ipiv[0], &b[0], &ldb, &info);
 
 	if (!info) {
 		for (i = 0; i < dim; i++) {
@@ -1332,6 +1580,108 @@ bool SymMatInverse(double ** mt, const int dim, double ** &cov)
 	}
 }
 
+bool SymMatInverse(double ** mt, const int dim, double ** &cov)  
+{
+	CopyMatrix(mt, cov, dim,dim);
+	return SymMatInverse(mt, dim);
+}
+
+// CrossProducts --
+// X'X of the vars columns X into the upper triangle of xtx (vars by vars,
+// column-major) and, if y is given, X'y into xty.  Blocks of rows are
+// copied into one column-major array and passed to the BLAS routines dsyrk
+// and dgemv, so that an optimized BLAS runs its cache-blocked SIMD kernels
+// on them, while the bundled CLAPACK runs its plain loops.
+void CrossProducts(const DenseVector * X, const int vars, const int obs,
+				   const DenseVector * y, double * xtx, double * xty)
+{
+	const int block = CrossProductsBlock(vars, obs);
+	std::vector<double> a((size_t) max(block, 1) * vars);
+	for (int i = 0; i < vars * vars; i++) xtx[i] = 0;
+	if (y) for (int i = 0; i < vars; i++) xty[i] = 0;
+	for (int first = 0; first < obs; first += block) {
+		const int k = min(block, obs - first);
+		for (int c = 0; c < vars; c++) {
+			const double * col = X[c].getThis() + first;
+			std::copy(col, col + k, a.begin() + (size_t) c * k);
+		}
+		CrossProductsAdd(&a[0], k, vars, y ? y->getThis() + first : 0,
+						 xtx, xty);
+	}
+}
+
+// CrossProductsBlock --
+// Rows per block for CrossProductsAdd, about 512 KB of vars columns.
+int CrossProductsBlock(const int vars, const int obs)
+{
+	return min(obs, max(64, 65536 / max(vars, 1)));
+}
+
+// CrossProductsAdd --
+// Adds A'A of the rows by vars column-major block A to the upper triangle
+// of xtx and, if y is given, A'y to xty (dsyrk and dgemv).
+void CrossProductsAdd(const double * a, const int rows, const int vars,
+					  const double * y, double * xtx, double * xty)
+{
+	integer n = vars, k = rows, inc = 1;
+	double one = 1.0;
+	char uplo = 'U', trans = 'T';
+	double * pa = const_cast<double*>(a);
+	dsyrk_(&uplo, &trans, &n, &k, &one, pa, &k, &one, xtx, &n);
+	if (y) {
+		dgemv_(&trans, &k, &n, &one, pa, &k, const_cast<double*>(y),
+			   &inc, &one, xty, &inc);
+	}
+}
+
+// CrossProductInverse --
+// Inverse of the cross-product matrix computed by CrossProducts into inv,
+// overwriting xtx.  The matrix is first scaled to a unit diagonal, which
+// leaves the inverse unchanged but lets the Cholesky factor and the
+// condition estimate of dpocon ignore the units of the variables.  Returns
+// false when the scaled matrix is not positive definite or its reciprocal
+// condition number is below 1e-8, which would leave fewer than about eight
+// correct digits; the SVD of X is needed then.
+bool CrossProductInverse(double * xtx, const int vars, double ** inv)
+{
+	if (vars == 0) return false;
+	integer n = vars, info = 0;
+	std::vector<double> d(vars);
+	int i = 0, j = 0;
+	for (j = 0; j < vars; j++) {
+		if (!(xtx[j + vars * j] > 0)) return false;
+		d[j] = 1.0 / sqrt(xtx[j + vars * j]);
+	}
+	double anorm = 0;
+	for (j = 0; j < vars; j++) {
+		for (i = 0; i <= j; i++) xtx[i + vars * j] *= d[i] * d[j];
+	}
+	for (j = 0; j < vars; j++) {
+		double col = 0;
+		for (i = 0; i < vars; i++) {
+			col += fabs((i <= j) ? xtx[i + vars * j] : xtx[j + vars * i]);
+		}
+		if (col > anorm) anorm = col;
+	}
+	char uplo = 'U';
+	dpotrf_(&uplo, &n, xtx, &n, &info);
+	if (info) return false;
+	double rcond = 0;
+	std::vector<double> work(3 * vars);
+	std::vector<integer> iwork(vars);
+	dpocon_(&uplo, &n, xtx, &n, &anorm, &rcond, &work[0], &iwork[0], &info);
+	if (info || rcond < 1.0e-8) return false;
+	dpotri_(&uplo, &n, xtx, &n, &info);
+	if (info) return false;
+	for (i = 0; i < vars; i++) {
+		for (j = 0; j < vars; j++) {
+			inv[i][j] = ((i <= j) ? xtx[i + vars * j] : xtx[j + vars * i])
+				* d[i] * d[j];
+		}
+	}
+	return true;
+}
+
 void residual(const DenseVector &rhs, const DenseVector * X, const DenseVector &ols, DenseVector &resid)  
 {
     const int dim = rhs.getSize(), vars = ols.getSize();
@@ -1425,78 +1775,62 @@ bool ordinaryLS(DenseVector &y,
 	int row = 0, column = 0;
 	double val = 0.0;
 
-	for (row = 0; row < vars; row++) {
-		for (column = 0; column < vars; column++) {
-			cov[row][column] = 0;
+	// X'X and X'y by blocks of rows, then inv(X'X) from its Cholesky factor
+	std::vector<double> xtx(vars * vars), temp(vars);
+	CrossProducts(X, vars, obs, &y, &xtx[0], &temp[0]);
+	if (!CrossProductInverse(&xtx[0], vars, cov)) {
+		// too ill-conditioned for the normal equations: SVD of X
+		for (row = 0; row < vars; row++) {
+			for (column = 0; column < vars; column++) {
+				cov[row][column] = 0;
+			}
 		}
-	}
 
-	// use SVD to calculate matrix inversion
-	// use dgesvd_
-
-	double *temp = new double [vars];
-	for (row = 0; row < vars; row++)
-		temp[row] = y.product(X[row]);
-
-	char jobu = 'S', jobvt = 'S';
-	long int m = obs, n = vars;
-	long int lda = obs, ldu = obs, ldvt = vars, lwork = 5 * obs, info = 0;
-	double *a = new double [obs * vars];
-	double *s = new double [vars];
-	double *u = new double [ldu * vars];
-	double *vt = new double [ldvt * vars];
-	double *work = new double [lwork];
-	for (row = 0; row < obs; row++) {
+		// use SVD to calculate matrix inversion
+		// use dgesvd_, U is not needed
+
+		char jobu = 'N', jobvt = 'S';
+		integer m = obs, n = vars;
+		integer lda = obs, ldu = 1, ldvt = vars, lwork = 5 * obs, info = 0;
+		std::vector<double> a((size_t) obs * vars), s(vars), vt(ldvt * vars);
+		std::vector<double> work(lwork);
+		double u = 0;
 		for (column = 0; column < vars; column++) {
-			a[row + obs * column] = X[column].getValue(row);
+			std::copy(X[column].getThis(), X[column].getThis() + obs,
+					  a.begin() + (size_t) obs * column);
 		}
-	}
 
-// use __WXMAC__ to call vecLib
-//#ifdef WORDS_BIGENDIAN
-#ifdef __WXMAC__MMM
-	dgesvd_(&jobu, &jobvt, &m, &n, a,
-			&lda, s, u, &ldu,
-			vt, &ldvt, work,
-			&lwork, &info);
-#else
-	dgesvd_(&jobu, &jobvt, (integer*)&m, (integer*)&n, (doublereal*)a,
-			(integer*)&lda, (doublereal*)s, (doublereal*)u, (integer*)&ldu,
-			(doublereal*)vt, (integer*)&ldvt, (doublereal*)work,
-			(integer*)&lwork, (integer*)&info);
-#endif
+		dgesvd_(&jobu, &jobvt, &m, &n, &a[0], &lda, &s[0], &u, &ldu,
+				&vt[0], &ldvt, &work[0], &lwork, &info);
 
-	if (!info) {
+		if (info) return false;
 		// (X'X)^(-1) = VW^(-2)V'
 		for (row = 0; row < vars; row++) {
 			for (column = 0; column < vars; column++) {
-				for (m = 0; m < vars; m++) {
-					cov[row][column] += (vt[row * vars + m] * vt[m + column * vars]) / (s[m] * s[m]);
+				for (int k = 0; k < vars; k++) {
+					cov[row][column] += (vt[row * vars + k] * vt[k + column * vars]) / (s[k] * s[k]);
 				}
 			}
 		}
+	}
 
-		for (row = 0; row < vars; row++) {
-			val = 0.0;
-			for (column = 0; column < vars; column++) {
-				val += cov[row][column] * temp[column];
-			}
-			ols.setAt(row, val);
+	for (row = 0; row < vars; row++) {
+		val = 0.0;
+		for (column = 0; column < vars; column++) {
+			val += cov[row][column] * temp[column];
 		}
-	} else {
-		release(&temp);
-		return false;
+		ols.setAt(row, val);
 	}
 
-	for (column = 0; column < obs; column++) {
-		double tempr = y.getValue(column);
-		for (row = 0; row < vars; row++) {
-			tempr -= ols.getValue(row) * X[row].getValue(column);
-		}
-		resid[column] = tempr; // compute residuals
+	// compute residuals, one column of X at a time
+	const double * yv = y.getThis();
+	for (column = 0; column < obs; column++) resid[column] = yv[column];
+	for (row = 0; row < vars; row++) {
+		const double b = ols.getValue(row);
+		const double * x = X[row].getThis();
+		for (column = 0; column < obs; column++) resid[column] -= b * x[column];
 	}
 
-	release(&temp);
 	return true;
 }
 
@@ -1591,49 +1925,23 @@ double LcPrime(const DenseVector &v, const double * residW, const SparseMatrix &
     return pp;
 }    
 
-void run1(SparseMatrix &w, const double rr, double &trace, double &trace2,
-		  double &frobenius,
-		  wxGauge* p_bar, double p_bar_min_fraction, double p_bar_max_fraction)
+/** Conjugate gradient solves of run1 for rows obs_start..obs_end.  The
+ trace, trace2 and frobenius terms of row ix are stored in contrib[3*ix],
+ contrib[3*ix+1] and contrib[3*ix+2]. */
+static void run1_range(const SparseMatrix* w, const double rr,
+					   std::vector<double>* contrib,
+					   int obs_start, int obs_end)
 {
-	LOG_MSG("Entering run1");
     const int LIMIT = 50;
     const double EPS = 1.0e-14;
-    const int dim = w.dim();
+    const int dim = w->dim();
     SparseVector	sol( dim ), resid( dim ), p( dim ), d( dim );
     double rho, beta, rho_lag;
-
-    int its = 0 , nzs = 0;
-    
-    trace = 0, trace2 = 0, frobenius = 0;
-    double s0 = 0, s1 = 0, s2 = 0, sse = 0;
-    double gs0 = 0, gs1 = 0, gs2 = 0;
 	
-	int g_min, g_max, prev_g_val; 
-	int cur_g_val, g_val_init, g_val_final, g_val_range;
-	int loop_min = 0, loop_max = max(0, dim-1);
-	if (p_bar) {
-		g_min = 0;
-		g_max = p_bar->GetRange();
-		g_val_init = p_bar_min_fraction * g_max;
-		g_val_final = p_bar_max_fraction * g_max;
-		g_val_range = g_val_final - g_val_init;
-		prev_g_val = g_val_init;
-		cur_g_val = prev_g_val;
-		p_bar->SetValue(g_val_init);
-		p_bar->Update();
-	}	
-    for (int ix = 0; ix < dim; ++ix) {
-		if (p_bar) {
-			cur_g_val = (ix*g_val_range)/loop_max + g_val_init;
-			if (cur_g_val > prev_g_val) {
-				p_bar->SetValue(cur_g_val);
-				prev_g_val = cur_g_val;
-				p_bar->Update();
-			}
-		}
+    for (int ix = obs_start; ix <= obs_end; ++ix) {
 		sol.reset();
         sol.setAt( ix, 1 );
-        w.rowIminusRhoThis( rr, p, sol );			// p = Ax
+        w->rowIminusRhoThis( rr, p, sol );			// p = Ax
         resid.minus( sol, p );			// r = b - Ax
         rho = resid.norm();			// rho = ss of resid
         int it = 0;				// iteration counter
@@ -1645,32 +1953,168 @@ void run1(SparseMatrix &w, const double rr, double &trace, double &trace2,
                 beta = rho / rho_lag;
                 d.timesPlus(resid, beta);
             }
-            w.rowIminusRhoThis( rr, p, d );			// p = Ad
+            w->rowIminusRhoThis( rr, p, d );			// p = Ad
             double alpha = rho / d.product( p );	// alpha = rho / d'p
             sol.addTimes( d, alpha );			// sol = sol + alpha*d
             resid.addTimes( p, -alpha );		// resid = resid - alpha*p
             rho_lag = rho;
             rho = resid.norm();
-            s0 = s1;
-            s1 = s2;
-            s2 = w.getRow(ix).timesColumn(sol);
         }
-        w.rowMatrix( p, sol );				// p = (Winv(I-rW))i 
+        w->rowMatrix( p, sol );				// p = (Winv(I-rW))i 
         
-        extract(p, w.getScale(), ix, trace, trace2, frobenius);
-        its += it;
-        nzs += sol.getNzEntries();
-        double se = 0;
-        if (s2-s1 > 1.0e-14)  se = geoda_sqr(s2-s1)/(s2-2.0*s1+s0);
-        sse += s2 - se;
-        gs0 += s0;
-        gs1 += s1;
-        gs2+= s2;
+		double* c = &(*contrib)[3*ix];
+        extract(p, w->getScale(), ix, c[0], c[1], c[2]);
     }
+}
+
+/** State shared by the run1 tasks on the GenUtils task pool. */
+struct Run1Tasks {
+	const SparseMatrix* w;
+	double rr;
+	std::vector<double>* contrib;
+	wxGauge* p_bar;
+	int g_val_init;
+	int g_val_range;
+	int prev_g_val;
+};
+
+static void run1_task(void* ctx, size_t first, size_t last, int worker_id)
+{
+	Run1Tasks* r = (Run1Tasks*) ctx;
+	run1_range(r->w, r->rr, r->contrib, first, last);
+}
+
+/** Called on the thread that started run1, so the gauge can be updated. */
+static bool run1_progress(void* ctx, size_t done, size_t total)
+{
+	Run1Tasks* r = (Run1Tasks*) ctx;
+	int cur_g_val = (int) (((double) done * r->g_val_range) / total)
+		+ r->g_val_init;
+	if (cur_g_val > r->prev_g_val) {
+		r->p_bar->SetValue(cur_g_val);
+		r->prev_g_val = cur_g_val;
+		r->p_bar->Update();
+	}
+	return true;
+}
+
+/** Hutchinson estimates of the run1 quantities.  For a Rademacher vector
+ z and A = (I - rr W)^-1 W, z'Az, |Az|^2 and |D A D^-1 z|^2 are unbiased for
+ trace, trace2 and frobenius, where D holds the row scales of w.  Each probe
+ takes two conjugate gradient solves, instead of one per observation.
+ Probes are drawn in blocks of ten until the standard errors relative to
+ max(|estimate|, 1) are below approx->rel_tol or the budget is spent. */
+static void run1_hutchinson(const SparseMatrix &w, const double rr,
+							double &trace, double &trace2, double &frobenius,
+							TraceApprox* approx, wxGauge* p_bar,
+							double p_bar_min_fraction,
+							double p_bar_max_fraction)
+{
+	wxStopWatch sw;
+	const int dim = w.dim(), block = 10, budget = approx->num_probes;
+	const double* scale = w.getScale();
+	int g_val_init = 0, g_val_range = 0;
+	if (p_bar) {
+		int g_max = p_bar->GetRange();
+		g_val_init = p_bar_min_fraction * g_max;
+		g_val_range = p_bar_max_fraction * g_max - g_val_init;
+	}
+	
+	wxUint32 state = RademacherSeed(approx->seed + 1);
+	DenseVector z(dim), zs(dim), wz(dim), a(dim);
+	std::vector<double> t, t2, f;
+	double se_t = 0, se_t2 = 0, se_f = 0, rse = 0;
+	while ((int) t.size() < budget) {
+		for (int b = 0; b < block && (int) t.size() < budget; ++b) {
+			for (int i = 0; i < dim; ++i) {
+				double r = Rademacher(state);
+				z.setAt(i, r);
+				zs.setAt(i, r / scale[i]);
+			}
+			w.matrixColumn(wz, z);
+			cg(w, rr, wz, a);				// a = Az
+			t.push_back(z.product(a));
+			t2.push_back(a.norm());
+			w.matrixColumn(wz, zs);
+			cg(w, rr, wz, a);				// a = A D^-1 z
+			double s = 0;
+			for (int i = 0; i < dim; ++i)
+				s += geoda_sqr(a.getValue(i) * scale[i]);
+			f.push_back(s);
+		}
+		MeanStdError(t, trace, se_t);
+		MeanStdError(t2, trace2, se_t2);
+		MeanStdError(f, frobenius, se_f);
+		rse = RelStdError(se_t, trace);
+		if (RelStdError(se_t2, trace2) > rse) rse = RelStdError(se_t2, trace2);
+		if (RelStdError(se_f, frobenius) > rse) rse = RelStdError(se_f, frobenius);
+		if (p_bar) {
+			p_bar->SetValue(g_val_init + (g_val_range * t.size()) / budget);
+			p_bar->Update();
+		}
+		if (rse <= approx->rel_tol) break;
+	}
+	approx->trace_probes = t.size();
+	approx->trace_rse = rse;
+	if (p_bar) {
+		p_bar->SetValue(g_val_init + g_val_range);
+		p_bar->Update();
+	}
+	LOG_MSG(wxString::Format("run1 Hutchinson estimate with %d probes took "
+							 "%ld ms", (int) t.size(), sw.Time()));
+}
+
+/** Computes trace, trace2 and frobenius by solving one conjugate gradient
+ system per row.  Rows are independent, so they are run as tasks on the
+ GenUtils task pool.  Each row's terms are kept separately and summed in row
+ order afterwards, so the result does not depend on the number of
+ threads.  The progress bar is only touched from the calling thread and
+ follows the number of rows done.  When approx asks for it and there are
+ at least SMALL_DIM rows, the traces are estimated by run1_hutchinson. */
+void run1(SparseMatrix &w, const double rr, double &trace, double &trace2,
+		  double &frobenius,
+		  wxGauge* p_bar, double p_bar_min_fraction, double p_bar_max_fraction,
+		  TraceApprox* approx)
+{
+	LOG_MSG("Entering run1");
+	wxStopWatch sw;
+    const int dim = w.dim();
+	if (approx && approx->num_probes > 0 && dim >= SMALL_DIM) {
+		run1_hutchinson(w, rr, trace, trace2, frobenius, approx, p_bar,
+						p_bar_min_fraction, p_bar_max_fraction);
+		LOG_MSG("Exiting run1");
+		return;
+	}
+    
+    trace = 0, trace2 = 0, frobenius = 0;
+	std::vector<double> contrib(3*dim, 0);
+	
+	int g_val_init = 0, g_val_final = 0, g_val_range = 0, prev_g_val = 0;
+	if (p_bar) {
+		int g_max = p_bar->GetRange();
+		g_val_init = p_bar_min_fraction * g_max;
+		g_val_final = p_bar_max_fraction * g_max;
+		g_val_range = g_val_final - g_val_init;
+		prev_g_val = g_val_init;
+		p_bar->SetValue(g_val_init);
+		p_bar->Update();
+	}
+	
+	Run1Tasks tasks = { &w, rr, &contrib, p_bar, g_val_init, g_val_range,
+		prev_g_val };
+	GenUtils::RunTasks(dim, run1_task, p_bar ? run1_progress : 0, &tasks, 0);
+	
+	for (int ix = 0; ix < dim; ++ix) {
+		trace += contrib[3*ix];
+		trace2 += contrib[3*ix+1];
+		frobenius += contrib[3*ix+2];
+	}
 	if (p_bar) {
 		p_bar->SetValue(g_val_final);
 		p_bar->Update();
 	}
+	LOG_MSG(wxString::Format("run1 for %d observations took %ld ms",
+							 dim, sw.Time()));
     LOG_MSG("Exiting run1");
 }
 
@@ -1836,7 +2280,8 @@ double SmallSimulationLag(Weights &W,
 						  double* LogLik, bool asym,
 						  wxGauge* p_bar,
 						  double p_bar_min_fraction,
-						  double p_bar_max_fraction)  
+						  double p_bar_max_fraction,
+						  std::vector<double>* eig)  
 {
     W.Transform(W_MAT);               // makes sure it is properly formated
     const int   dim = W.dim();
@@ -1852,10 +2297,14 @@ double SmallSimulationLag(Weights &W,
     }
 
 	int row = 0, column = 0;
+	// the spectrum of an earlier regression on the same weights
+	const bool have_eig = !asym && eig && eig->size() == (size_t) dim;
     WMatrix	sym;
-    copy(sym, W.Mit());
+    if (!have_eig) copy(sym, W.Mit());
 	
-	if (!asym) {
+	if (have_eig) {
+		// sym is not needed
+	} else if (!asym) {
 		MakeSym(sym());       // make it symmetric; has eigenvalues of the rowstandardized matrix
 	} else {
 		RowStandardize(sym());
@@ -1868,15 +2317,19 @@ double SmallSimulationLag(Weights &W,
     	lag.setAt(cnt, p_lag[cnt]);
 
 	double *s = new double [dim], *wr = new double [dim], *wi = new double [dim];
-	if (!asym)
+	if (have_eig)
+	{
+		for (row = 0; row < dim; row++) s[row] = (*eig)[row];
+	}
+	else if (!asym)
 	{
 		// assume real and symmetric matrix
 		// use CLAPACK to compute all eigenvalues
 		// use dspev_
 
 		char jobz = 'N', uplo = 'U';
-		long int n = dim;
-		long int ldz = dim, lwork = 3 * dim, info = 0;
+		integer n = dim;
+		integer ldz = dim, lwork = 3 * dim, info = 0;
 		double *a = new double [dim * (dim + 1) / 2];
 		double *z = NULL;
 		double *work = new double [lwork];
@@ -1895,8 +2348,8 @@ double SmallSimulationLag(Weights &W,
 //#endif
 
 		if (!info) {
-			// eigenvalues are in s
-			// good and nothing else to do in this step
+			// eigenvalues are in s, kept for later regressions
+			if (eig) eig->assign(s, s+dim);
 		} else {
 			cerr << "error in computing eigenvalues" << endl;
 		//	wxMessageBox("error in computing eigenvalues";
@@ -1910,8 +2363,8 @@ double SmallSimulationLag(Weights &W,
 		// use dgeev_
 
 		char jobvl = 'N', jobvr = 'N';
-		long int n = dim;
-		long int lda = dim, ldvl = dim, ldvr = dim, lwork = 3 * dim, info = 0;
+		integer n = dim;
+		integer lda = dim, ldvl = dim, ldvr = dim, lwork = 3 * dim, info = 0;
 		double *a = new double [dim * dim];
 		double *vl = NULL, *vr = NULL;
 		double *work = new double [lwork];
@@ -1976,7 +2429,8 @@ double SimulationLag(const GalElement *weight,
 					 double* LogLik,
 					 wxGauge* p_bar,
 					 double p_bar_min_fraction,
-					 double p_bar_max_fraction)
+					 double p_bar_max_fraction,
+					 TraceApprox* approx)
 {
 	LOG_MSG("Entering SimulationLag, GalElement*");
   	Weights  W(weight, num_obs);          // read the weights matrix
@@ -1985,7 +2439,8 @@ double SimulationLag(const GalElement *weight,
         return SmallSimulationLag(W, num_obs, rho, my_Y, my_X, deps,
 								  InclConstant, LogLik, false,
 								  p_bar, p_bar_max_fraction,
-								  p_bar_max_fraction);
+								  p_bar_max_fraction,
+								  approx ? approx->eigenvalues : 0);
     
     W.Transform(W_GWT);               // makes sure it is formated
     const int   dim= W.Git().count();
@@ -2016,8 +2471,11 @@ double SimulationLag(const GalElement *weight,
     // "  computing polynomial 
     start= clock();
 
-    InitPoly(Precision, dim);
-    SparsePoly(sym());
+    const bool sparse_lj = InitLogJacobian(weight, num_obs, approx);
+    if (!sparse_lj) {
+        InitPoly(Precision, dim);
+        SparsePoly(sym());
+    }
     // "  --- finished computing polynomial" 
 	double **cov = new double * [deps];
 	double *resid = new double [dim];
@@ -2040,7 +2498,10 @@ double SimulationLag(const GalElement *weight,
 	}
     VALUE rhoEstimate = 0.0;
 	// e0: resid, eL: residw see Oleg's paper
-    rhoEstimate = GoldenSectionLag(-1, 0, 1, re, reW, LogLik);
+    rhoEstimate = GoldenSectionLag(-1, 0, 1, re, reW, LogLik, approx);
+    while (sparse_lj && RaiseSeriesOrder(rhoEstimate, weight, num_obs, approx))
+        rhoEstimate = GoldenSectionLag(-1, 0, 1, re, reW, LogLik, approx);
+    if (sparse_lj) FinishLogJacobian(rhoEstimate, approx);
     stop= clock();
 
 	LOG_MSG("Exiting SimulationLag");
@@ -2275,7 +2736,8 @@ double SmallSimulationError(Weights &W,
 							double *LogLik, bool asym,
 							wxGauge* p_bar,
 							double p_bar_min_fraction,
-							double p_bar_max_fraction)  
+							double p_bar_max_fraction,
+							std::vector<double>* eig)  
 {
     W.Transform(W_MAT);               // makes sure it is formated
     const int   dim = W.dim();
@@ -2293,8 +2755,10 @@ double SmallSimulationError(Weights &W,
     };
     X.reset(deps);
 
+	// the spectrum of an earlier regression on the same weights
+	const bool have_eig = !asym && eig && eig->size() == (size_t) dim;
     WMatrix		sym;
-    copy(sym, W.Mit());
+    if (!have_eig) copy(sym, W.Mit());
 	
 	//{
 	//	LOG_MSG("sym dump before MakeSym:");
@@ -2306,7 +2770,9 @@ double SmallSimulationError(Weights &W,
 	//	}
 	//}
 	
-    if (!asym) {
+    if (have_eig) {
+		// sym is not needed
+	} else if (!asym) {
     	MakeSym(sym());                 // make it symmetric, while preserving eigenvalues -- used for computing log-Jacobian
     } else {
     	RowStandardize(sym());
@@ -2331,15 +2797,19 @@ double SmallSimulationError(Weights &W,
     start = clock();
 
 	double *s = new double [dim], *wr = new double [dim], *wi = new double [dim];
-	if (!asym)
+	if (have_eig)
+	{
+		for (row = 0; row < dim; row++) s[row] = (*eig)[row];
+	}
+	else if (!asym)
 	{
 		// assume real and symmetric matrix
 		// use CLAPACK to compute all eigenvalues
 		// use dspev_
 
 		char jobz = 'N', uplo = 'U';
-		long int n = dim;
-		long int ldz = dim, lwork = 3 * dim, info = 0;
+		integer n = dim;
+		integer ldz = dim, lwork = 3 * dim, info = 0;
 		double *a = new double [dim * (dim + 1) / 2];
 		double *z = NULL;
 		double *work = new double [lwork];
@@ -2350,17 +2820,11 @@ double SmallSimulationError(Weights &W,
 			}
 		}
 
-// use __WXMAC__ to call vecLib
-//#ifdef WORDS_BIGENDIAN
-#ifdef __WXMAC__
 		dspev_(&jobz, &uplo, &n, a, s, z, &ldz, work, &info);
-#else
-		dspev_(&jobz, &uplo, (integer*)&n, (doublereal*)a, (doublereal*)s, (doublereal*)z, (integer*)&ldz, (doublereal*)work, (integer*)&info);
-#endif
 
 		if (!info) {
-			// eigenvalues are in s
-			// good and nothing else to do in this step
+			// eigenvalues are in s, kept for later regressions
+			if (eig) eig->assign(s, s+dim);
 		} else {
 			cerr << "error in computing eigenvalues" << endl;
 			wxMessageBox("Error: There was an error computing eigenvalues.");
@@ -2374,8 +2838,8 @@ double SmallSimulationError(Weights &W,
 		// use dgeev_
 
 		char jobvl = 'N', jobvr = 'N';
-		long int n = dim;
-		long int lda = dim, ldvl = dim, ldvr = dim, lwork = 3 * dim, info = 0;
+		integer n = dim;
+		integer lda = dim, ldvl = dim, ldvr = dim, lwork = 3 * dim, info = 0;
 		double *a = new double [dim * dim];
 		double *vl = NULL, *vr = NULL;
 		double *work = new double [lwork];
@@ -2385,13 +2849,7 @@ double SmallSimulationError(Weights &W,
 			}
 		}
 
-// use __WXMAC__ to call vecLib
-//#ifdef WORDS_BIGENDIAN
-#ifdef __WXMAC__
 		dgeev_(&jobvl, &jobvr, &n, a, &lda, wr, wi, vl, &ldvl, vr, &ldvr, work, &lwork, &info);
-#else
-		dgeev_(&jobvl, &jobvr, (integer*)&n, (doublereal*)a, (integer*)&lda, (doublereal*)wr, (doublereal*)wi, (doublereal*)vl, (integer*)&ldvl, (doublereal*)vr, (integer*)&ldvr, (doublereal*)work, (integer*)&lwork, (integer*)&info);
-#endif
 
 		if (!info) {
 			// eigenvalues are in wr and wi
@@ -2425,7 +2883,8 @@ double SimulationError(const GalElement *my_gal,
 					   double* LogLik,
 					   wxGauge* p_bar,
 					   double p_bar_min_fraction,
-					   double p_bar_max_fraction)  
+					   double p_bar_max_fraction,
+					   TraceApprox* approx)  
 {
     Weights W(my_gal, num_obs);          
     const int   dim = W.dim();
@@ -2433,7 +2892,8 @@ double SimulationError(const GalElement *my_gal,
         return  SmallSimulationError(W, rho, my_Y, my_X, deps, beta,
 									 InclConstant, LogLik, false,
 									 p_bar, p_bar_min_fraction,
-									 p_bar_max_fraction);
+									 p_bar_max_fraction,
+									 approx ? approx->eigenvalues : 0);
     W.Transform(W_GWT);               // makes sure it is formated
     int			cnt;
     WVector      	y(dim);
@@ -2456,11 +2916,22 @@ double SimulationError(const GalElement *my_gal,
 
     RowStandardize(W.Git());	// non-symmetric, row-standardized -- used to compute spatial lag
     VALUE lambdaEstimate = 0.0;
-    InitPoly(Precision, dim);
-    SparsePoly(sym());
+    const bool sparse_lj = InitLogJacobian(my_gal, num_obs, approx);
+    if (!sparse_lj) {
+        InitPoly(Precision, dim);
+        SparsePoly(sym());
+    }
     Destroy(sym());		// don't need that spatial weights anymore
 
-    lambdaEstimate = GoldenSectionError(-1, 0, 1, X, y, W.Git(), beta, LogLik);
+    lambdaEstimate = GoldenSectionError(-1, 0, 1, X, y, W.Git(), beta, LogLik,
+                                        approx);
+    while (sparse_lj && RaiseSeriesOrder(lambdaEstimate, my_gal, num_obs,
+                                         approx))  {
+        delete [] beta;
+        lambdaEstimate = GoldenSectionError(-1, 0, 1, X, y, W.Git(), beta,
+                                            LogLik, approx);
+    }
+    if (sparse_lj) FinishLogJacobian(lambdaEstimate, approx);
     return lambdaEstimate;
 }
 
@@ -20,6 +20,7 @@
 #ifndef __GEODA_CENTER_ML_IM_H__
 #define __GEODA_CENTER_ML_IM_H__
 
+#include <vector>
 #include <wx/gauge.h>
 #include "DenseVector.h"
 #include "SparseMatrix.h"
@@ -27,6 +28,71 @@
 const int SMALL_DIM = 500;
 const int ASYM_DIM = 1000;
 
+/** Settings and achieved accuracy of the stochastic approximation used by
+ the spatial lag and error ML estimators for weights with at least
+ SMALL_DIM observations (smaller ones always use eigenvalues).  With
+ num_probes == 0 the characteristic polynomial gives the log-Jacobian and
+ run1 solves one conjugate gradient system per observation.  Otherwise
+ ln|I - rho W| is replaced by the Martin series -sum_k rho^k tr(W^k) / k,
+ truncated after series_order terms.  While the truncation bound at the
+ estimate exceeds both rel_tol relative to the log-Jacobian and its standard
+ error, series_order is doubled, up to max_series_order, and the model is
+ estimated again; logdet_trunc_high is set if the bound is still too large
+ at that order.  The traces of W(I - rho W)^-1
+ needed for the information matrix are estimated with Hutchinson's
+ estimator.  Both draw Rademacher probe vectors from seed.  Probes are added
+ in blocks until the relative standard error drops below rel_tol or
+ num_probes probes have been used.  With cholesky set, ln|I - rho W| is
+ instead computed exactly from a sparse Cholesky factor (SparseCholesky),
+ while num_probes still selects how the traces are obtained.  The factor
+ needs symmetric weights; for asymmetric ones the estimators clear
+ cholesky, set asymmetric and fall back to the series or polynomial.  The remaining
+ members are filled in by the estimators and are zero when the exact path
+ was taken.  When eigenvalues is set, weights with fewer than SMALL_DIM
+ observations take the spectrum of the symmetrized W from it if it holds
+ one value per observation, and otherwise store the spectrum they compute
+ in it, so that later regressions on the same weights skip the O(n^3)
+ eigenvalue computation. */
+struct TraceApprox {
+	TraceApprox(int num_probes_ = 0, int series_order_ = 30,
+				double rel_tol_ = 0.001, unsigned int seed_ = 123456789)
+	: num_probes(num_probes_), series_order(series_order_),
+	rel_tol(rel_tol_), seed(seed_), cholesky(false), eigenvalues(0),
+	logdet_probes(0), trace_probes(0), logdet_se(0), logdet_trunc(0),
+	logdet_trunc_high(false), trace_rse(0), factor_size(0),
+	asymmetric(false), lj_chol(0), lj_order(0), lj_probes(0), lj_dim(0) {}
+	
+	/** Probe budget offered by the regression dialog. */
+	static const int default_probes = 200;
+	/** Largest series order the estimators raise series_order to. */
+	static const int max_series_order = 240;
+	
+	int num_probes; // probe budget, 0 for the exact computation
+	int series_order; // number of terms in the log-Jacobian series
+	double rel_tol; // target relative standard error
+	unsigned int seed;
+	bool cholesky; // exact log-Jacobian from a sparse Cholesky factor
+	std::vector<double>* eigenvalues; // spectrum kept between regressions
+	
+	int logdet_probes; // probes used for the log-Jacobian
+	int trace_probes; // probes used for the information matrix traces
+	double logdet_se; // std. error of the log-likelihood at the estimate
+	double logdet_trunc; // bound on the series truncation error
+	bool logdet_trunc_high; // logdet_trunc above tolerance at max order
+	double trace_rse; // largest relative std. error of the traces
+	long factor_size; // nonzeros in the Cholesky factor
+	bool asymmetric; // cholesky was asked for but W is not symmetric
+	
+	// Log-Jacobian state of the estimator in progress: the sparse Cholesky
+	// factor, or lj_order Martin series moments z'W^k z for each of
+	// lj_probes probes of dimension lj_dim.
+	SparseCholesky* lj_chol;
+	std::vector<double> lj_moments;
+	int lj_order;
+	int lj_probes;
+	int lj_dim;
+};
+
 double SimulationLag(const GalElement* weight,
 					 int num_obs,
 					 int	Precision, 
@@ -38,7 +104,8 @@ double SimulationLag(const GalElement* weight,
 					 double* Lik,
 					 wxGauge* p_bar,
 					 double p_bar_min_fraction,
-					 double p_bar_max_fraction);  
+					 double p_bar_max_fraction,
+					 TraceApprox* approx = 0);  
 
 double SimulationError(const GalElement* weight,
 					   int num_obs,
@@ -52,7 +119,8 @@ double SimulationError(const GalElement* weight,
 					   double* Lik,
 					   wxGauge* p_bar,
 					   double p_bar_min_fraction,
-					   double p_bar_max_fraction);
+					   double p_bar_max_fraction,
+					   TraceApprox* approx = 0);
 
 bool OLS(DenseVector &y, DenseVector * X, const bool IncludeConst,
 		 double ** &cov, double *resid, DenseVector &ols);
@@ -66,5 +134,24 @@ bool OLS(Iterator<VALUE> y, Iterator<WVector> X, const bool IncludeConst,
 bool ordinaryLS(DenseVector &y, DenseVector * X, double ** &cov, 
 				 double * resid, DenseVector &ols);
 
+/** X'X of the vars columns of X (obs rows) into the upper triangle of the
+ column-major vars by vars array xtx, and X'y into xty when y is not 0. */
+void CrossProducts(const DenseVector * X, const int vars, const int obs,
+				   const DenseVector * y, double * xtx, double * xty);
+
+/** Rows per block of vars columns for CrossProductsAdd. */
+int CrossProductsBlock(const int vars, const int obs);
+
+/** Adds A'A of the column-major rows by vars block A to the upper
+ triangle of xtx and A'y to xty when y is not 0, for callers that form the
+ regressors a block of rows at a time. */
+void CrossProductsAdd(const double * a, const int rows, const int vars,
+					  const double * y, double * xtx, double * xty);
+
+/** inv = inverse of the X'X from CrossProducts, by Cholesky factorization.
+ xtx is overwritten.  Returns false if X'X is not positive definite or too
+ ill-conditioned for the normal equations. */
+bool CrossProductInverse(double * xtx, const int vars, double ** inv);
+
 #endif
 
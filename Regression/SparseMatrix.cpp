@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <iterator>
 #include <wx/wxprec.h>
 
 #ifndef WX_PRECOMP
@@ -233,3 +235,140 @@ void SparseMatrix::MakeTranspose()
 		}
 	}
 }
+
+SparseCholesky::SparseCholesky(const SparseMatrix &w)
+: size(w.dim())
+{
+	minimumDegree(w);
+}
+
+/* Minimum degree ordering on the explicit elimination graph.  The
+ neighbors of an observation when it is eliminated are exactly the rows of
+ its column in the factor, so the pattern of L falls out of the ordering.
+ Ties are broken by the smaller observation index. */
+void SparseCholesky::minimumDegree(const SparseMatrix &w)
+{
+	using namespace std;
+	vector< vector<int> > adj(size);
+	for (int r=0; r<size; r++) {
+		const SparseRow& row = w.getRow(r);
+		for (int cnt=0; cnt<row.getSize(); cnt++) {
+			int c = row.getIx(cnt);
+			if (c == r) continue;
+			adj[r].push_back(c);
+			adj[c].push_back(r);
+		}
+	}
+	set< pair<int,int> > degree;
+	for (int r=0; r<size; r++) {
+		sort(adj[r].begin(), adj[r].end());
+		adj[r].erase(unique(adj[r].begin(), adj[r].end()), adj[r].end());
+		degree.insert(make_pair((int) adj[r].size(), r));
+	}
+	
+	perm.resize(size);
+	vector<int> pinv(size);
+	vector< vector<int> > pattern(size);
+	vector<int> merged;
+	for (int k=0; k<size; k++) {
+		int v = degree.begin()->second;
+		degree.erase(degree.begin());
+		perm[k] = v;
+		pinv[v] = k;
+		const vector<int>& nb = adj[v];
+		for (size_t i=0; i<nb.size(); i++) {
+			int u = nb[i];
+			degree.erase(make_pair((int) adj[u].size(), u));
+			// u becomes adjacent to all other neighbors of v
+			merged.clear();
+			set_union(adj[u].begin(), adj[u].end(), nb.begin(), nb.end(),
+					  back_inserter(merged));
+			merged.erase(remove(merged.begin(), merged.end(), u),
+						 merged.end());
+			merged.erase(remove(merged.begin(), merged.end(), v),
+						 merged.end());
+			adj[u].swap(merged);
+			degree.insert(make_pair((int) adj[u].size(), u));
+		}
+		pattern[v].swap(adj[v]);
+	}
+	
+	Lp.resize(size+1);
+	Lp[0] = 0;
+	for (int k=0; k<size; k++) Lp[k+1] = Lp[k] + 1 + pattern[perm[k]].size();
+	Li.resize(Lp[size]);
+	Lx.resize(Lp[size]);
+	for (int k=0; k<size; k++) {
+		vector<int>& pat = pattern[perm[k]];
+		int p = Lp[k];
+		Li[p++] = k;
+		for (size_t i=0; i<pat.size(); i++) pat[i] = pinv[pat[i]];
+		sort(pat.begin(), pat.end());
+		copy(pat.begin(), pat.end(), Li.begin() + p);
+		vector<int>().swap(pat);
+	}
+	
+	Ap.resize(size+1);
+	Ad.resize(size);
+	Ap[0] = 0;
+	for (int k=0; k<size; k++) {
+		const SparseRow& row = w.getRow(perm[k]);
+		Ad[k] = 0;
+		for (int cnt=0; cnt<row.getSize(); cnt++) {
+			int i = pinv[row.getIx(cnt)];
+			if (i == k) {
+				Ad[k] += row.getWeight(cnt);
+			} else if (i > k) {
+				Ai.push_back(i);
+				Ax.push_back(row.getWeight(cnt));
+			}
+		}
+		Ap[k+1] = Ai.size();
+	}
+}
+
+/* Left-looking numeric factorization of I - rho*W on the fixed pattern.
+ head[j] links the columns k < j whose next unused row is j, and next[k]
+ is the position of that row in column k.  A pivot that is not positive
+ (rho outside the admissible range) is taken as 1e-16, as OnePoly does
+ for the characteristic polynomial. */
+double SparseCholesky::logDet(const double rho)
+{
+	std::vector<double> x(size, 0.0);
+	std::vector<int> head(size, -1), link(size, -1), next(size, 0);
+	double ld = 0;
+	for (int j=0; j<size; j++) {
+		x[j] = 1.0 - rho * Ad[j];
+		for (int p=Ap[j]; p<Ap[j+1]; p++) x[Ai[p]] = -rho * Ax[p];
+		int k = head[j];
+		while (k != -1) {
+			int nk = link[k];
+			int p = next[k];
+			double ljk = Lx[p];
+			for (int q=p; q<Lp[k+1]; q++) x[Li[q]] -= Lx[q] * ljk;
+			if (++next[k] < Lp[k+1]) {
+				int i = Li[next[k]];
+				link[k] = head[i];
+				head[i] = k;
+			}
+			k = nk;
+		}
+		double d = x[j];
+		if (d < 1.0e-16) d = 1.0e-16;
+		ld += log(d);
+		double ljj = sqrt(d);
+		Lx[Lp[j]] = ljj;
+		x[j] = 0;
+		for (int p=Lp[j]+1; p<Lp[j+1]; p++) {
+			Lx[p] = x[Li[p]] / ljj;
+			x[Li[p]] = 0;
+		}
+		if (Lp[j]+1 < Lp[j+1]) {
+			next[j] = Lp[j]+1;
+			int i = Li[next[j]];
+			link[j] = head[i];
+			head[i] = j;
+		}
+	}
+	return ld;
+}
@@ -89,5 +89,33 @@ private :
 	void MakeTranspose();
 	std::vector< std::list< std::pair<int,double> > > transpose;
 };
+
+/*  ---  SparseCholesky  ---  */
+/** Cholesky factor of I - rho*W for the symmetric form W of a weights
+ matrix (see SparseMatrix::makeStdSymmetric).  The constructor computes a
+ minimum degree ordering and the pattern of the factor once; logDet then
+ factors numerically for each rho and returns ln|I - rho*W| from the
+ diagonal of the factor.  Memory is proportional to the size of the factor,
+ so this stays exact where the dense eigenvalues do not fit. */
+class SparseCholesky  {
+
+public :
+    SparseCholesky(const SparseMatrix &w);
+
+    int dim()  const  {  return size;  }
+    long factorSize()  const  {  return Li.size();  }
+
+    double logDet(const double rho);
+
+private :
+    int size;
+    std::vector<int> perm;	// perm[k]: observation eliminated k-th
+    std::vector<int> Lp, Li;	// pattern of the factor by column, diagonal first
+    std::vector<double> Lx;
+    std::vector<int> Ap, Ai;	// strictly lower part of W in the new order
+    std::vector<double> Ax, Ad;	// ... and its diagonal
+
+    void minimumDegree(const SparseMatrix &w);
+};
 #endif
 
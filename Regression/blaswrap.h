@@ -5,7 +5,8 @@
 #ifndef __GEODA_CENTER_BLAS_WRAP_H__
 #define __GEODA_CENTER_BLAS_WRAP_H__
 
-#ifndef NO_BLAS_WRAP
+/* a system BLAS keeps the plain Fortran names */
+#if !defined(NO_BLAS_WRAP) && !defined(GDA_SYSTEM_LAPACK)
  
 /* BLAS1 routines */
 #define srotg_ f2c_srotg
@@ -3,8 +3,15 @@
 #ifndef __GEODA_CENTER_F2C_H__
 #define __GEODA_CENTER_F2C_H__
 
+/* GDA_SYSTEM_LAPACK is defined when linking a system BLAS/LAPACK, such as
+   OpenBLAS or the reference LAPACK, whose routines take 32-bit integers. */
+#ifdef GDA_SYSTEM_LAPACK
+typedef int integer;
+typedef unsigned int uinteger;
+#else
 typedef long int integer;
 typedef unsigned long int uinteger;
+#endif
 typedef char *address;
 typedef short int shortint;
 typedef float real;
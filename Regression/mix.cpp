@@ -526,20 +526,22 @@ double chicdf(double chisq, int df)
 
 extern double product(const double * v1, const double * v2, const int &sz);
 
-double* JarqueBera(double* e, long n, long k)
+// JarqueBera --
+// Jarque-Bera test from the sums e2, e3 and e4 of the second, third and
+// fourth powers of the n residuals, so that it can also be computed from
+// running sums over a table too large to hold.
+double* JarqueBera(double e2, double e3, double e4, long n)
 {
 
-	double sigma2 = norm(e,n);
+	double sigma2 = e2;
 	if (n <=30) 
        sigma2 = sigma2 / (n-1); //        # unbiased estimator of population sig sq.
   else
        sigma2 = sigma2 / n; // # mean square of sample residuals
 
-  double* m2e = vproduct(e,e,n);
-
-  double skewness = product(m2e,e,n) / n / pow(sigma2,1.5);
+  double skewness = e3 / n / pow(sigma2,1.5);
   skewness *= skewness;
-  double kurtosis = product(m2e,m2e,n) /n / geoda_sqr(sigma2);
+  double kurtosis = e4 /n / geoda_sqr(sigma2);
 
   double jb = n * (skewness/6.0 + (geoda_sqr(kurtosis-3.0) / 24.0));
 
@@ -560,8 +562,25 @@ double* JarqueBera(double* e, long n, long k)
 //local JB = (r(N)/6)*((r(skewness)^2)+[(1/4)*(r(kurtosis)-3)^2])
 
 }
+
+double* JarqueBera(double* e, long n, long k)
+{
+	double* m2e = vproduct(e,e,n);
+	double* rslt = JarqueBera(norm(e,n), product(m2e,e,n),
+							  product(m2e,m2e,n), n);
+	delete [] m2e;
+	return rslt;
+}
+
 extern bool SymMatInverse(Iterator<WVector> mt);
 extern bool SymMatInverse(double ** mt, const int dim);
+extern void CrossProducts(const DenseVector * X, const int vars,
+						  const int obs, const DenseVector * y,
+						  double * xtx, double * xty);
+extern bool CrossProductInverse(double * xtx, const int vars, double ** inv);
+extern int CrossProductsBlock(const int vars, const int obs);
+extern void CrossProductsAdd(const double * a, const int rows, const int vars,
+							 const double * y, double * xtx, double * xty);
 
 
 double *BP_Test(double *resid, int obs, double** X, int nvar, bool InclConst)
@@ -577,15 +596,14 @@ double *BP_Test(double *resid, int obs, double** X, int nvar, bool InclConst)
 	for (j = 0; j < obs; j++) {
 		x[0].setAt(j, 1.0);
 	}
+	// the squared regressors go to new columns, X is shared with the other
+	// diagnostics
 	for (i = 1; i < nvar; i++) {
-		if (InclConst) {
-			x[i].absorb(X[i], obs);
-		} else {
-			x[i].absorb(X[i - 1], obs);
-		}
-		ns = x[i].norm();
+		const double* xi = InclConst ? X[i] : X[i - 1];
+		ns = norm(xi, obs);
+		x[i].absorb(new double [obs], obs, true);
 		for (j = 0; j < obs; j++) {
-			x[i].setAt(j, geoda_sqr(x[i].getValue(j) / sqrt(ns)));
+			x[i].setAt(j, geoda_sqr(xi[j] / sqrt(ns)));
 		}
 	}
 
@@ -593,42 +611,38 @@ double *BP_Test(double *resid, int obs, double** X, int nvar, bool InclConst)
 	for (i = 0; i < nvar; i++)
 		alloc(cov[i], nvar);
 
-	// use SVD to compute inverse(Z'Z)
-	// use dgesvd_
-
-	char jobu = 'S', jobvt = 'S';
-	long int m = obs, n = nvar;
-	long int lda = obs, ldu = obs, ldvt = nvar, lwork = 5 * obs, info = 0;
-	double *a = new double [obs * nvar];
-	double *s = new double [nvar];
-	double *u = new double [ldu * nvar];
-	double *vt = new double [ldvt * nvar];
-	double *work = new double [lwork];
-	for (i = 0; i < obs; i++) {
+	// inverse(Z'Z) from the Cholesky factor of Z'Z, or from the SVD of Z
+	// when Z'Z is too ill-conditioned
+	std::vector<double> ztz(nvar * nvar);
+	CrossProducts(x, nvar, obs, 0, &ztz[0], 0);
+	if (!CrossProductInverse(&ztz[0], nvar, cov)) {
+		// use dgesvd_, U is not needed
+		char jobu = 'N', jobvt = 'S';
+		integer m = obs, n = nvar;
+		integer lda = obs, ldu = 1, ldvt = nvar, lwork = 5 * obs, info = 0;
+		std::vector<double> a((size_t) obs * nvar), s(nvar), vt(ldvt * nvar);
+		std::vector<double> work(lwork);
+		double u = 0;
 		for (j = 0; j < nvar; j++) {
-			a[i + obs * j] = x[j].getValue(i);
+			std::copy(x[j].getThis(), x[j].getThis() + obs,
+					  a.begin() + (size_t) obs * j);
 		}
-	}
 
-// use __WXMAC__ to call vecLib
-//#ifdef WORDS_BIGENDIAN
-#ifdef __WXMAC__MMM
-	dgesvd_(&jobu, &jobvt, &m, &n, a, &lda, s, u, &ldu, vt, &ldvt, work, &lwork, &info);
-#else
-	dgesvd_(&jobu, &jobvt, (integer*)&m, (integer*)&n, (doublereal*)a, (integer*)&lda, (doublereal*)s, (doublereal*)u, (integer*)&ldu, (doublereal*)vt, (integer*)&ldvt, (doublereal*)work, (integer*)&lwork, (integer*)&info);
-#endif
+		dgesvd_(&jobu, &jobvt, &m, &n, &a[0], &lda, &s[0], &u, &ldu,
+				&vt[0], &ldvt, &work[0], &lwork, &info);
 
-	if (!info) {
-		// (z'z)^(-1) = VW^(-2)V'
-		for (i = 0; i < nvar; i++) {
-			for (j = 0; j < nvar; j++) {
-				for (m = 0; m < nvar; m++) {
-					cov[i][j] += (vt[i * nvar + m] * vt[m + j * nvar]) / (s[m] * s[m]);
+		if (!info) {
+			// (z'z)^(-1) = VW^(-2)V'
+			for (i = 0; i < nvar; i++) {
+				for (j = 0; j < nvar; j++) {
+					for (int k = 0; k < nvar; k++) {
+						cov[i][j] += (vt[i * nvar + k] * vt[k + j * nvar]) / (s[k] * s[k]);
+					}
 				}
 			}
+		} else {
+			// do nothing
 		}
-	} else {
-		// do nothing
 	}
 
 	double mse = e.norm() / obs;
@@ -664,65 +678,119 @@ double *BP_Test(double *resid, int obs, double** X, int nvar, bool InclConst)
 	return rslt;
 }
 
-double MC_Condition_Number(double **X, int dim, int expl)
+// BP_Test --
+// Breusch-Pagan and Koenker-Bassett tests from accumulated sums, for
+// residuals that are not held in memory.  ztz is Z'Z of the nvar auxiliary
+// regressors of BP_Test above (column-major, upper triangle used and
+// overwritten), with the squares left unscaled since scaling the columns
+// of Z does not change the tests.  ze2 = Z'e^2, ee = e'e and e4 is the sum
+// of e^4 over the obs residuals.  Returns NULL if Z'Z is singular.
+double *BP_Test(double *ztz, const double *ze2, double ee, double e4,
+				int obs, int nvar, bool InclConst)
 {
-	int i = 0, j = 0, row = 0, column = 0; 
-	double xn = 0;
-	DenseVector *x = new DenseVector [dim];
+	int i = 0, j = 0;
+	std::vector<double> inv_v(nvar * nvar), z1(nvar);
+	std::vector<double*> cov(nvar);
+	for (i = 0; i < nvar; i++) cov[i] = &inv_v[i * nvar];
+	// Z'1 is the first column of Z'Z, the first regressor being 1
+	for (j = 0; j < nvar; j++) z1[j] = ztz[nvar * j];
+	for (i = 0; i < nvar; i++) {
+		for (j = 0; j < nvar; j++) {
+			cov[i][j] = (i <= j) ? ztz[i + nvar * j] : ztz[j + nvar * i];
+		}
+	}
+	if (!CrossProductInverse(ztz, nvar, &cov[0])) {
+		if (!SymMatInverse(&cov[0], nvar)) return NULL;
+	}
 
-	for (i = 0; i < expl; i++)
-		x[i].absorb(X[i], dim, false);
+	double mse = ee / obs;
 
-	for (i = 0; i < expl; i++) {
-		xn = x[i].norm();
-		for (j = 0; j < dim; j++) {
-			x[i].setAt(j, x[i].getValue(j) / sqrt(xn));
-		}
+	// g = e^2 - mse, so g'z = Z'e^2 - mse Z'1
+	std::vector<double> gz(nvar);
+	for (i = 0; i < nvar; i++) gz[i] = ze2[i] - mse * z1[i];
+	double bp = 0; // bp = g'z[(z'z)^-1]z'g
+	for (i = 0; i < nvar; i++) {
+		for (j = 0; j < nvar; j++) bp += gz[i] * cov[i][j] * gz[j];
 	}
+	// sum of (e^2 - mse)^2 / obs
+	double mean = e4 / obs - geoda_sqr(mse);
+
+	double *rslt = new double [6];
+	rslt[0] = 1. / (2 * geoda_sqr(mse)) * bp; // Breusch-Pagan
+	rslt[1] = InclConst ? nvar - 1 : nvar;
+ 	rslt[2] = gammp(rslt[1] / 2.0, rslt[0] / 2.0);
+	rslt[3] = (1.0 / mean) * bp; // Koenker-Basset
+	rslt[4] = rslt[1];
+ 	rslt[5] = gammp(rslt[1] / 2.0, rslt[3] / 2.0);
+
+	return rslt;
+}
+
+// MC_Condition_Number --
+// Condition number of the k regressors from their cross-product matrix
+// (k by k, column-major, upper triangle used), each column scaled to unit
+// length first.  Returns -999 if the eigenvalues cannot be computed.
+double MC_Condition_Number(const double *xtx, int expl)
+{
+	int row = 0, column = 0;
 
 	// use CLAPACK to compute the largest and the smallest eigenvalues
 	// use dspev_
 
 	char jobz = 'N', uplo = 'U';
-	long int n = expl;
-	long int ldz = expl, lwork = 3 * expl, info = 0;
-	double *a = new double [expl * (expl + 1) / 2];
-	double *s = new double [expl];
+	integer n = expl;
+	integer ldz = expl, lwork = 3 * expl, info = 0;
+	std::vector<double> a(expl * (expl + 1) / 2), s(expl), work(lwork);
 	double *z = NULL;
-	double *work = new double [lwork];
-	for (row = 0; row < expl; row++) {
-		for (column = row + 1; column < expl; column++)
-			a[row + column * (column + 1) / 2] = x[row].product(x[column]);
-			a[row + row * (row + 1) / 2] = x[row].norm();
+	for (column = 0; column < expl; column++) {
+		for (row = 0; row <= column; row++) {
+			a[row + column * (column + 1) / 2] = xtx[row + expl * column] /
+				sqrt(xtx[row + expl * row] * xtx[column + expl * column]);
+		}
 	}
 
-// use __WXMAC__ to call vecLib
-//#ifdef WORDS_BIGENDIAN
-#ifdef __WXMAC__MMM
-	dspev_(&jobz, &uplo, &n, a, s, z, &ldz, work, &info);
-#else
-	dspev_(&jobz, &uplo, (integer*)&n, (doublereal*)a, (doublereal*)s, (doublereal*)z, (integer*)&ldz, (doublereal*)work, (integer*)&info);
-#endif
+	dspev_(&jobz, &uplo, &n, &a[0], &s[0], z, &ldz, &work[0], &info);
 
 	if (!info) {
 		double max = s[expl - 1], min = s[0];
 		return sqrt(max / min);
-	} else {
+	}
+	return -999;
+}
+
+double MC_Condition_Number(double **X, int dim, int expl)
+{
+	DenseVector *x = new DenseVector [expl];
+	for (int i = 0; i < expl; i++)
+		x[i].absorb(X[i], dim, false);
+
+	std::vector<double> xtx(expl * expl);
+	CrossProducts(x, expl, dim, 0, &xtx[0], 0);
+	delete [] x;
+
+	double cn = MC_Condition_Number(&xtx[0], expl);
+	if (cn == -999) {
 	//	cerr << "error in computing eigenvalues" << endl;
 		wxMessageBox("error in computing eigenvalues");
-		return -999;
 	}
+	return cn;
 }
 
 
+// WhiteTest --
+// White's test: n R^2 of the regression of the squared residuals on a
+// constant, the regressors and all their squares and cross-products.  The
+// auxiliary regressors are formed one block of rows at a time and added to
+// the cross-product matrix (CrossProductsAdd), so the n by df auxiliary
+// matrix is never stored.  Returns -99999 for the statistic and the
+// probability if the auxiliary cross-product matrix is singular.
 double* WhiteTest(int obs, int nvar, double* resid, double** X, bool InclConstant)
 {
-	typedef double* double_ptr_type;
-	double *r2 = new double[obs];
-	int i = 0, jj = 0;
+	int i = 0, j = 0, jj = 0;
 	//	if (!InclConstant) DevFromMean(obs,resid);
 
 	// (1) r2 = Compute e2
+	std::vector<double> r2(obs);
 	double r2_bar = 0;
 	for (i=0;i<obs;i++)
 	{
@@ -731,81 +799,67 @@ double* WhiteTest(int obs, int nvar, double* resid, double** X, bool InclConstan
 	}
 	r2_bar /= obs;
 	
-	
-	// (2) define (n*n + 3n)/2 memory location for w
+	// (2) the auxiliary regression has a constant, the regressors other than
+	// the constant, X[first .. nvar-1], and their products, df + 1 columns
 	const int df = InclConstant? (geoda_sqr(nvar-1)+3*(nvar-1))/2 : (geoda_sqr(nvar)+3*nvar)/2;
-	double_ptr_type *w  = new double_ptr_type[df+1];
-
-	for (i=0;i<=df;i++) w[i] = new double[obs];
-
-
-	// (3) keep original X into w[1 .. nvar][]
-	int ix = InclConstant? 0 : 1;
-	int k = nvar+ix;
-
-	for (jj=0;jj<obs;jj++)
-		w[0][jj] = 1.0;
-
-	if (InclConstant)
-	{
-		for (i=1;i<nvar;i++)
-		{
+	const int first = InclConstant? 1 : 0;
+	const int k = df + 1;
+	double *rsl = new double[3];
+	rsl[0] = df;
+	rsl[1] = -99999;
+	rsl[2] = -99999;
 
-				for (jj=0;jj<obs;jj++)
-					w[i][jj] = X[i][jj];
+	// (3) W'W and W'r2 by blocks of rows of W
+	const int block = CrossProductsBlock(k, obs);
+	std::vector<double> w((size_t) block * k), wtw(k * k, 0.0), wtr(k, 0.0);
+	for (int start = 0; start < obs; start += block) {
+		const int rows = min(block, obs - start);
+		int c = 0;
+		for (jj = 0; jj < rows; jj++) w[jj] = 1.0;
+		for (i = first, c = 1; i < nvar; i++, c++) {
+			std::copy(X[i] + start, X[i] + start + rows, w.begin() + c * rows);
 		}
-	}
-	else
-	{
-		for (i=0;i<nvar;i++)
-				for (jj=0;jj<obs;jj++)
-					w[i+1][jj] = X[i][jj];
+		for (i = first; i < nvar; i++) {
+			for (j = i; j < nvar; j++, c++) {
+				double *wc = &w[c * rows];
+				const double *xi = X[i] + start, *xj = X[j] + start;
+				for (jj = 0; jj < rows; jj++) wc[jj] = xi[jj] * xj[jj];
+			}
+		}
+		CrossProductsAdd(&w[0], rows, k, &r2[start], &wtw[0], &wtr[0]);
 	}
 
-	// (4) Create cross product of Xs and store them into w[nvar ... df][]
-	for (i=1-ix;i<nvar;i++)
-	{
-		for (int j=i; j<nvar;j++)
-		{
-			for (jj=0;jj<obs;jj++)
-				w[k][jj] = X[i][jj] * X[j][jj];
-			k++;
+	// (4) coefficients of the auxiliary regression
+	std::vector<double> inv_v(k * k), a(wtw);
+	std::vector<double*> inv(k);
+	for (i = 0; i < k; i++) inv[i] = &inv_v[i * k];
+	if (!CrossProductInverse(&a[0], k, &inv[0])) {
+		for (i = 0; i < k; i++) {
+			for (j = 0; j < k; j++) {
+				inv[i][j] = (i <= j) ? wtw[i + k * j] : wtw[j + k * i];
+			}
 		}
+		if (!SymMatInverse(&inv[0], k)) return rsl;
 	}
-
-	// (5) Compute OLS, r2 on w
-	DenseVector		yw(r2, obs, false), olsw(k);
-  DenseVector *xw = new DenseVector[k];
-
-  for (int cnt = 0; cnt < k; ++cnt)  
-	{
-
-     xw[cnt].absorb(w[cnt], obs, false);
+	std::vector<double> b(k, 0.0);
+	for (i = 0; i < k; i++) {
+		for (j = 0; j < k; j++) b[i] += inv[i][j] * wtr[j];
 	}
 
-
-  double ** cov = new double * [k];
-  double *u = new double[obs];
-	for (i = 0; i < k; i++) {
-		cov[i] = new double [k];
-		for (jj = 0; jj < k; jj++) {
-			cov[i][jj] = 0;
+	// (5) residual sum of squares, the auxiliary regressors recomputed
+	double uu = 0.0, s_u = 0.0;
+	for (jj = 0; jj < obs; jj++) {
+		double fit = b[0];
+		int c = 1;
+		for (i = first; i < nvar; i++, c++) fit += b[c] * X[i][jj];
+		for (i = first; i < nvar; i++) {
+			for (j = i; j < nvar; j++, c++) fit += b[c] * X[i][jj] * X[j][jj];
 		}
+		uu += geoda_sqr(r2[jj] - fit);
+		s_u += geoda_sqr(r2[jj] - r2_bar);
 	}
-	double *rsl = new double[3];
-	rsl[0] = df;
-	rsl[1] = -99999;
-	rsl[2] = -99999;
-  if (!ordinaryLS(yw, xw, cov, u, olsw))
-	{
-		return rsl;
-	}
-
-	double s_u = 0.0;
-	for (i=0;i<obs;i++)
-		s_u += geoda_sqr(r2[i] - r2_bar);
 
-	rsl[1]= obs * ( 1 - (norm(u,obs) / s_u));
+	rsl[1]= obs * ( 1 - (uu / s_u));
 //	rsl[1]= chicdf(rsl[0],df);
 	rsl[2]= gammp( double (df) / 2.0, rsl[1]/2.0 );
 
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <map>
 #include <boost/unordered_map.hpp>
 #include <wx/wxprec.h>
@@ -26,8 +27,12 @@
 #endif
 
 #include <wx/gauge.h>
+#include <wx/stopwatch.h>
+#include <boost/bind.hpp>
 #include "../logger.h"
+#include "../GenUtils.h"
 #include "../ShapeOperations/GalWeight.h"
+#include "../DataViewer/TableInterface.h"
 
 #include "mix.h"
 #include "Lite2.h"
@@ -39,6 +44,7 @@
 
 extern double fprob (int dfnum, int dfden, double F);
 extern double* JarqueBera(double* e, long n, long k);
+extern double* JarqueBera(double e2, double e3, double e4, long n);
 
 void Compute_MoranI(GalElement* g,
 												double *resid,
@@ -48,7 +54,7 @@ void Compute_RSLmError(GalElement* g,
 					   double *resid,
 					   int dim,
 					   double* rst,
-					   const std::vector< std::set<int> >& g_lookup);
+					   const double trWW);
 
 void Compute_RSLmErrorRobust(GalElement* g,
 							 double** cov,
@@ -59,7 +65,7 @@ void Compute_RSLmErrorRobust(GalElement* g,
 							 int dim,
 							 int expl,
 							 double* rst,
-							 const std::vector< std::set<int> >& g_lookup);
+							 const double trWW);
 
 void Compute_RSLmLag(GalElement* g,
 					 double** cov,
@@ -70,7 +76,7 @@ void Compute_RSLmLag(GalElement* g,
 					 int dim,
 					 int expl,
 					 double* rst,
-					 const std::vector< std::set<int> >& g_lookup);
+					 const double trWW);
 
 void Compute_RSLmLagRobust(GalElement* g,
 						   double** cov,
@@ -81,7 +87,7 @@ void Compute_RSLmLagRobust(GalElement* g,
 						   int dim,
 						   int expl,
 						   double* rst,
-						   const std::vector< std::set<int> >& g_lookup);
+						   const double trWW);
 
 void Compute_RSLmSarma(GalElement* g,
 					   double** cov,
@@ -92,7 +98,7 @@ void Compute_RSLmSarma(GalElement* g,
 					   int dim,
 					   int expl,
 					   double* rst,
-					   const std::vector< std::set<int> >& g_lookup);
+					   const double trWW);
 
 
 bool ordinaryLS(DenseVector &y, 
@@ -106,8 +112,11 @@ extern double product(const double * v1, const double * v2, const int &sz);
 extern double cdf(double x);
 extern float betai(float a, float b, float x);
 extern double MC_Condition_Number(double**, int,int);
+extern double MC_Condition_Number(const double *xtx, int expl);
 extern double *BP_Test(double *resid, int obs, double** X, int expl,
 					   bool InclConst);
+extern double *BP_Test(double *ztz, const double *ze2, double ee, double e4,
+					   int obs, int nvar, bool InclConst);
 extern double *WhiteTest(int obs, int nvar, double* resid, double** X,
 						 bool InclConstant);
 
@@ -117,68 +126,31 @@ void Lag(DenseVector &lag, const DenseVector &x, GalElement *g)
         lag.setAt( cnt, g[cnt].SpatialLag(x.getThis()) );
 }
 
-void MakeFastLookupMat(GalElement *g, int dim,
-					   std::vector< std::set<int> >& g_lookup)
-{
-	using namespace std;
-	g_lookup.resize(dim);
-    for (int cnt = 0; cnt < dim; ++cnt) {
-        for (int cp = 0; cp < g[cnt].Size(); ++cp) {
-			g_lookup[cnt].insert(g[cnt][cp]);
-		}
-	}
-}
-
-// Note: it is expected that input g_lookup was initialized as follows:
-// MakeFastLookupMat(g, dim, g_lookup);
-double T(GalElement *g, int dim,
-		 const std::vector< std::set<int> >& g_lookup)  
+double T(GalElement *g, int dim)
 {
     // tr(W'W+WW)
     // = tr(W'W) + tr(WW)
-    // = w'_ij*w_ji + w_ij*w_ji
+    // = sum_ij w_ij*w_ij + sum_ij w_ij*w_ji
+    //
+    // Only non-zero w_ij contribute to either sum, so both traces are
+    // accumulated over the neighbor lists.  w_ji is found by a binary
+    // search in the neighbors of j and is zero when i is not a neighbor of
+    // j, which handles asymmetric weights such as k-nearest neighbors.  A
+    // neighbor listed twice is counted once, as GetRW finds only one of
+    // its entries.
     
-	using namespace std;
     double	sum = 0;
     
-    int i=0, j=0;
-    for (i = 0; i < dim; ++i) {
-        for (j = 0; j < dim; ++j) {
-            //w_ij * w_ji
-            
-                //sum += g[i][j] * g[j][i];
-                sum += g[i].GetRW(j) * g[j].GetRW(i);
-        }
-    }
-    for (i = 0; i < dim; ++i) {
-        for (j = 0; j < dim; ++j) {
-            //w'_ij * w_ji
-                //sum += g[j][i] * g[j][i];
-                sum += g[j].GetRW(i) * g[j].GetRW(i);
-        }
-    }
-    
-    /*
-     // below is also incorrect when handling knn weights matrix
-    int cnt = 0, cp = 0;
-    for (cnt = 0; cnt < dim; ++cnt) {
-        for (cp = 0; cp < g[cnt].Size(); ++cp) {
-            sum += geoda_sqr(1.0/g[cnt].Size());
+    for (int i = 0; i < dim; ++i) {
+        for (long cp = 0, sz = g[i].Size(); cp < sz; ++cp) {
+            long j = g[i][cp];
+            if (g[i].FindNbr(j) != cp) continue;
+            double w_ij = g[i].GetRW(j);
+            sum += w_ij * w_ij + w_ij * g[j].GetRW(i);
         }
     }
-		
-	for (cnt = 0; cnt < dim; ++cnt) {
-        for (cp = 0; cp < g[cnt].Size(); ++cp) {
-			if (g_lookup[g[cnt][cp]].find(cnt)  != g_lookup[g[cnt][cp]].end()) {
-                // check if transpose element exists (ie, non-zero)
-				sum += (1.0/g[cnt].Size()/g[ g[cnt][cp] ].Size());
-			}
-		}
-	}
-	*/
     
     return sum;
-    //return 21.738295484789607;
 }
 
 // This original version of T computes the trace of W'W + WW where W
@@ -209,7 +181,7 @@ void Compute_RSLmLag(GalElement* g,
 					 int dim,
 					 int expl,
 					 double *rst,
-					 const std::vector< std::set<int> >& g_lookup)
+					 const double trWW)
 {
     double *Y = y.getThis();
     double const ee = norm(resid, dim);
@@ -235,7 +207,7 @@ void Compute_RSLmLag(GalElement* g,
     z.squareTimesColumn( z2, cov );			// z2 = (X'X)^(-1)X'WXb
     const double xMx = z.product(z2); // (WXb)'X(X'X)^(-1)X'WXb
     // lag.norm : (WXb)'(WXb)
-    double v = (lag.norm() - xMx + T(g, dim, g_lookup) * sigma2) / sigma2;
+    double v = (lag.norm() - xMx + trWW * sigma2) / sigma2;
     RS /= v;
 
     double const RS_stat = gammp( 0.5, RS * 0.5);
@@ -257,7 +229,7 @@ void Compute_RSLmLagRobust(GalElement* g,
 						   int dim,
 						   int expl,
 						   double *rst,
-						   const std::vector< std::set<int> >& g_lookup)
+						   const double trWW)
 {
     double *Y = y.getThis();
     double const ee = norm(resid, dim);
@@ -292,7 +264,7 @@ void Compute_RSLmLagRobust(GalElement* g,
     // z.product(z2) : (WXb)'(X(X'X)^(-1)X')(WXb)
     const double T11 = Wy.norm() -  z.product(z2);
     const double T1 = T11 / sigma2;
-    const double T21 = T(g, dim, g_lookup);
+    const double T21 = trWW;
     const double T2 = 1.0 / (T1 + T21);
 
     RS /= (1.0 / T2 - T21);
@@ -323,7 +295,6 @@ void Compute_MoranI(GalElement* g,
     for (int cnt = 0; cnt < dim; ++cnt)
     {
         lag.setAt( cnt, g[cnt].SpatialLag(resid) ); // We
-		re.setAt(cnt, resid[cnt]);
     }
 
     double MoranI = re.product( lag ) / ee; // [e'We] / [ee]
@@ -490,7 +461,7 @@ double Compute_MoranZ(GalElement* g,
 void Compute_RSLmError(GalElement* g,
 					   double *resid,
 					   int dim, double *rst,
-					   const std::vector< std::set<int> >& g_lookup)
+					   const double trWW)
 {
     double const ee = norm(resid, dim);
     double const sigma2	=  ee / (dim);
@@ -505,7 +476,7 @@ void Compute_RSLmError(GalElement* g,
 
     double RS = geoda_sqr(re.product( lag ) / sigma2); // [e'We/sigma2]^2
 
-    double t = T(g, dim, g_lookup); // tr[(W'+W)*W]
+    double t = trWW; // tr[(W'+W)*W]
     RS /= t;
     
 	double const RS_stat = gammp( 0.5, RS * 0.5);
@@ -523,7 +494,7 @@ void Compute_RSLmErrorRobust(GalElement* g,
 							 int dim,
 							 int expl,
 							 double *rst,
-							 const std::vector< std::set<int> >& g_lookup)
+							 const double trWW)
 {
     double *Y = y.getThis();
     double const ee = norm(resid, dim);
@@ -556,7 +527,7 @@ void Compute_RSLmErrorRobust(GalElement* g,
     // z.product(z2) : (WXb)'(X(X'X)^(-1)X')(WXb)
     const double T11 = Wy.norm() -  z.product(z2);
     const double T1 = T11 / sigma2;
-    const double T21 = T(g, dim, g_lookup);
+    const double T21 = trWW;
     const double T2 = 1.0 / (T1 + T21);
 
     const double RS = geoda_sqr(RS2 - (RS1 * T2 * T21)) / (T21-(T21*T21*T2));
@@ -576,7 +547,7 @@ void Compute_RSLmSarma(GalElement* g,
 					   int dim,
 					   int expl,
 					   double *rst,
-					   const std::vector< std::set<int> >& g_lookup)
+					   const double trWW)
 {
     double *Y = y.getThis();
     double const ee = norm(resid, dim);
@@ -609,7 +580,7 @@ void Compute_RSLmSarma(GalElement* g,
     // z.product(z2) : (WXb)'(X(X'X)^(-1)X')(WXb)
     const double T11 = Wy.norm() -  z.product(z2);
     const double T1 = T11 / sigma2;
-    const double T21 = T(g, dim, g_lookup);
+    const double T21 = trWW;
     const double T2 = 1.0 / (T1 + T21);
 
     const double RS = (geoda_sqr(RS1 - RS2)/ (1.0/T2 - T21)) + (RS2*RS2/T21);
@@ -644,7 +615,8 @@ extern void run1(SparseMatrix &w,
 				 double &frobenius,
 				 wxGauge* p_bar,
 				 double p_bar_min_fraction,
-				 double p_bar_max_fraction);
+				 double p_bar_max_fraction,
+				 TraceApprox* approx);
 
 bool SymMatInverse(double ** mt, const int dim);
 
@@ -664,6 +636,158 @@ void DevFromMean(int nObs, double* RawData)
 	}
 }
 
+/** Shared state of the diagnostic tests of classicalRegression, each of
+ which is one task on the task pool.  The tests only read the regression
+ inputs and write their own fields of dr; ms is the time of each task. */
+struct OlsDiagnostics {
+	enum Test { WHITE, BP, MORAN, COND, LM_ERR, LM_ERR_ROBUST, LM_LAG,
+		LM_LAG_ROBUST, LM_SARMA, JB };
+	GalElement *g;
+	int dim, expl;
+	double **X, **cov;
+	DenseVector *x, *y, *ols;
+	double *resid, *jb_resid;
+	bool InclConstant, m_moranz;
+	double trWW; // tr(W'W + WW)
+	double condnumber;
+	DiagnosticReport *dr;
+	std::vector<Test> tasks;
+	std::vector<long> ms;
+	
+	void Run(size_t i);
+	static wxString Name(Test t);
+};
+
+wxString OlsDiagnostics::Name(Test t)
+{
+	switch (t) {
+		case WHITE: return "White";
+		case BP: return "Breusch-Pagan";
+		case MORAN: return "Moran's I";
+		case COND: return "Multicollinearity condition number";
+		case LM_ERR: return "Lagrange Multiplier (error)";
+		case LM_ERR_ROBUST: return "Robust LM (error)";
+		case LM_LAG: return "Lagrange Multiplier (lag)";
+		case LM_LAG_ROBUST: return "Robust LM (lag)";
+		case LM_SARMA: return "Lagrange Multiplier (SARMA)";
+		case JB: return "Jarque-Bera";
+	}
+	return wxEmptyString;
+}
+
+void OlsDiagnostics::Run(size_t i)
+{
+	wxStopWatch sw;
+	double rst[2];
+	switch (tasks[i]) {
+		case WHITE:
+		{
+			double *white = WhiteTest(dim, expl, resid, X, InclConstant);
+			dr->SetWhiteTest(0, white[0]);
+			dr->SetWhiteTest(1, white[1]);
+			dr->SetWhiteTest(2, white[2]);
+			delete [] white;
+			break;
+		}
+		case BP:
+		{
+			double *bp = BP_Test(resid, dim, X, expl, InclConstant);
+			if (bp == NULL) {
+				dr->SetBPTest(0, expl);
+				dr->SetBPTest(1, -1.0);
+				dr->SetBPTest(2, -1.0);
+
+				dr->SetKBTest(0, expl);
+				dr->SetKBTest(1, -1.0);
+				dr->SetKBTest(2, -1.0);
+			} else {
+				dr->SetBPTest(0, bp[1]);
+				dr->SetBPTest(1, bp[0]);
+				dr->SetBPTest(2, bp[2]);
+
+				dr->SetKBTest(0, bp[4]);
+				dr->SetKBTest(1, bp[3]);
+				dr->SetKBTest(2, bp[5]);
+				delete [] bp;
+			}
+			break;
+		}
+		case MORAN:
+			Compute_MoranI(g, resid, dim, rst);
+			dr->SetMoranI(0, rst[0]);
+			if (m_moranz) {
+				const double MoranZ = Compute_MoranZ(g, cov, x, dim, expl,
+													 rst[0]);
+				dr->SetMoranI(1, MoranZ);
+				dr->SetMoranI(2, 2.0 * (1.0 - nc(fabs(MoranZ))));
+			}
+			break;
+		case COND:
+		{
+			std::vector<double> xtx(expl * expl);
+			CrossProducts(x, expl, dim, 0, &xtx[0], 0);
+			condnumber = MC_Condition_Number(&xtx[0], expl);
+			break;
+		}
+		case LM_ERR:
+			Compute_RSLmError(g, resid, dim, rst, trWW);
+			dr->SetLmError(0, 1.0);
+			dr->SetLmError(1, rst[0]);
+			dr->SetLmError(2, rst[1]);
+			break;
+		case LM_ERR_ROBUST:
+			Compute_RSLmErrorRobust(g, cov, *y, x, *ols, resid, dim, expl,
+									rst, trWW);
+			dr->SetLmErrRobust(0, 1.0);
+			dr->SetLmErrRobust(1, rst[0]);
+			dr->SetLmErrRobust(2, rst[1]);
+			break;
+		case LM_LAG:
+			Compute_RSLmLag(g, cov, *y, x, *ols, resid, dim, expl, rst, trWW);
+			dr->SetLmLag(0, 1.0);
+			dr->SetLmLag(1, rst[0]);
+			dr->SetLmLag(2, rst[1]);
+			break;
+		case LM_LAG_ROBUST:
+			Compute_RSLmLagRobust(g, cov, *y, x, *ols, resid, dim, expl,
+								  rst, trWW);
+			dr->SetLmLagRobust(0, 1.0);
+			dr->SetLmLagRobust(1, rst[0]);
+			dr->SetLmLagRobust(2, rst[1]);
+			break;
+		case LM_SARMA:
+			Compute_RSLmSarma(g, cov, *y, x, *ols, resid, dim, expl, rst,
+							  trWW);
+			dr->SetLmSarma(0, 2.0);
+			dr->SetLmSarma(1, rst[0]);
+			dr->SetLmSarma(2, rst[1]);
+			break;
+		case JB:
+		{
+			double *jb = JarqueBera(jb_resid, dim, expl);
+			dr->SetJBTest(0, 2.0);
+			dr->SetJBTest(1, jb[0]);
+			dr->SetJBTest(2, jb[2]);
+			delete [] jb;
+			break;
+		}
+	}
+	ms[i] = sw.Time();
+}
+
+void OlsDiagnosticsRange(OlsDiagnostics* d, size_t first, size_t last,
+						 int worker)
+{
+	for (size_t i = first; i <= last; i++) d->Run(i);
+}
+
+bool OlsDiagnosticsProgress(wxGauge* gauge, size_t done, size_t total)
+{
+	const int g_rng = gauge->GetRange();
+	gauge->SetValue((2*g_rng)/3 + (g_rng * done) / (3 * total));
+	return true;
+}
+
 // yuntien: August 2005
 // Regression
 bool classicalRegression(GalElement *g,
@@ -735,59 +859,8 @@ bool classicalRegression(GalElement *g,
 		dr->SetYHat(i, y_hat.getValue(i));
 	}
 
-	// diagnostics for spatial dependence
-	if (g != NULL)
-	{
-		std::vector< std::set<int> > g_lookup;
-		MakeFastLookupMat(g, dim, g_lookup);
-		
-		double *rst = new double[2];
-
-		Compute_RSLmError(g, resid, dim, rst, g_lookup);
-		dr->SetLmError(0, 1.0);
-		dr->SetLmError(1, rst[0]);
-		dr->SetLmError(2, rst[1]);
-
-
-		Compute_RSLmErrorRobust(g, cov, y, x, ols, resid, dim, expl, rst,
-								g_lookup);
-		dr->SetLmErrRobust(0, 1.0);
-		dr->SetLmErrRobust(1, rst[0]);
-		dr->SetLmErrRobust(2, rst[1]);
-
-
-		Compute_RSLmLag(g, cov, y, x, ols, resid, dim, expl, rst, g_lookup);
-		dr->SetLmLag(0, 1.0);
-		dr->SetLmLag(1, rst[0]);
-		dr->SetLmLag(2, rst[1]);
-
-
-		Compute_RSLmLagRobust(g, cov, y, x, ols, resid, dim, expl, rst,
-							  g_lookup);
-		dr->SetLmLagRobust(0, 1.0);
-		dr->SetLmLagRobust(1, rst[0]);
-		dr->SetLmLagRobust(2, rst[1]);
-
-
-		Compute_RSLmSarma(g, cov, y, x, ols, resid, dim, expl, rst, g_lookup);
-		dr->SetLmSarma(0, 2.0);
-		dr->SetLmSarma(1, rst[0]);
-		dr->SetLmSarma(2, rst[1]);
-
-
-		Compute_MoranI(g, resid, dim, rst);
-		dr->SetMoranI(0, rst[0]);
-		if (m_moranz)
-		{
-			const double MoranZ = Compute_MoranZ(g, cov, x, dim, expl, rst[0]);
-			dr->SetMoranI(1, MoranZ);
-			dr->SetMoranI(2, 2.0 * (1.0 - nc(fabs(MoranZ))));
-		}
-	}
-	if (gauge) gauge->SetValue((2*g_rng)/3);
 	release(&D);
 
-
 	double const sigma2ml = ee / dim;
 	dr->SetSigSq(sigma2);
 	dr->SetSigSqLm(sigma2ml);
@@ -843,40 +916,585 @@ bool classicalRegression(GalElement *g,
 	dr->SetFTest(f_value);
 	dr->SetFTestProb(fprob(k - 1, n - k, f_value)); // Prob of F-test
 	dr->SetRSS(ee);
+	if (gauge) gauge->SetValue((2*g_rng)/3);
 
-	dr->SetCondNumber(MC_Condition_Number(X, n, k));
-	double *jb = JarqueBera(resid, dim, expl);
-	dr->SetJBTest(0, 2.0);
-	dr->SetJBTest(1, jb[0]);
-	dr->SetJBTest(2, jb[2]);
+	// The diagnostics are independent of each other and run concurrently.
+	// The spatial and heteroskedasticity tests use the residuals stored in
+	// dr, Jarque-Bera the residuals demeaned above when there is no
+	// constant.
+	OlsDiagnostics d;
+	d.g = g;
+	d.dim = dim;
+	d.expl = expl;
+	d.X = X;
+	d.x = x;
+	d.y = &y;
+	d.ols = &ols;
+	d.cov = cov;
+	d.resid = dr->GetResidual();
+	d.jb_resid = resid;
+	d.InclConstant = InclConstant;
+	d.m_moranz = m_moranz;
+	d.trWW = 0;
+	d.condnumber = 0;
+	d.dr = dr;
+	// heaviest first
+	if (do_white_test) d.tasks.push_back(OlsDiagnostics::WHITE);
+	d.tasks.push_back(OlsDiagnostics::BP);
+	if (g) {
+		// tr(W'W + WW) is shared by the LM tests; computing it here also
+		// builds the lookup caches of g before the tasks read it.
+		d.trWW = T(g, dim);
+		d.tasks.push_back(OlsDiagnostics::MORAN);
+	}
+	d.tasks.push_back(OlsDiagnostics::COND);
+	if (g) {
+		d.tasks.push_back(OlsDiagnostics::LM_ERR);
+		d.tasks.push_back(OlsDiagnostics::LM_ERR_ROBUST);
+		d.tasks.push_back(OlsDiagnostics::LM_LAG);
+		d.tasks.push_back(OlsDiagnostics::LM_LAG_ROBUST);
+		d.tasks.push_back(OlsDiagnostics::LM_SARMA);
+	}
+	d.tasks.push_back(OlsDiagnostics::JB);
+	d.ms.resize(d.tasks.size());
+
+	wxStopWatch sw;
+	boost::function<bool (size_t, size_t)> progress;
+	if (gauge) progress = boost::bind(OlsDiagnosticsProgress, gauge, _1, _2);
+	GenUtils::RunTasks(d.tasks.size(),
+					   boost::bind(OlsDiagnosticsRange, &d, _1, _2, _3),
+					   1, 0, progress);
+	LOG_MSG(wxString::Format("classicalRegression: %d diagnostics in %ld ms",
+							 (int) d.tasks.size(), sw.Time()));
+
+	if (d.condnumber == -999) wxMessageBox("error in computing eigenvalues");
+	dr->SetCondNumber(d.condnumber);
+	for (i = 0; i < (int) d.tasks.size(); i++) {
+		dr->AddTiming(OlsDiagnostics::Name(d.tasks[i]), d.ms[i]);
+	}
+
+	delete [] resid;
+	release(&cov);
+	release(&x);
+	if (gauge) gauge->SetValue(g_rng);
+
+    return true;
+}
+
+/** Shared state of batchRegression.  Column c of the stacked matrix
+ S = [Z WZ W'Z], Z = [X y], is column c of G, the cross-products S'S. */
+struct BatchRegression {
+	int dim, expl, m, ncols; // observations, regressors, columns of Z, S
+	const double *y, *Wy;
+	double **X;
+	const CsrWeight* W;
+	std::vector<double> G;
+	double trWW; // tr(W'W + WW)
+	bool InclConstant, m_moranz;
+	const std::vector< std::vector<int> >* specs;
+	std::vector<RegressionSpecResult>* results;
+	std::vector< std::vector<double> > resid, lag; // per worker
+	
+	double g(int i, int j) const { return G[i + ncols * j]; }
+	void Solve(size_t spec, int worker);
+};
+
+void BatchRegression::Solve(size_t spec, int worker)
+{
+	const std::vector<int>& v = (*specs)[spec];
+	RegressionSpecResult& r = (*results)[spec];
+	const int p = v.size();
+	int i = 0, j = 0, cnt = 0;
+	r.vars = v;
+	r.ok = false;
+	if (p == 0 || p >= dim) return;
+	
+	// X'X, X'y and inv(X'X) of the specification from G
+	std::vector<double> xtx(p * p), xty(p), inv_v(p * p);
+	std::vector<double*> inv(p);
+	for (i = 0; i < p; i++) {
+		inv[i] = &inv_v[i * p];
+		xty[i] = g(v[i], expl);
+		for (j = 0; j < p; j++) xtx[i + p * j] = g(v[i], v[j]);
+	}
+	r.condnumber = MC_Condition_Number(&xtx[0], p);
+	std::vector<double> a(xtx);
+	if (!CrossProductInverse(&a[0], p, &inv[0])) {
+		for (i = 0; i < p; i++) {
+			for (j = 0; j < p; j++) inv[i][j] = xtx[i + p * j];
+		}
+		if (!SymMatInverse(&inv[0], p)) return;
+	}
+	std::vector<double> b(p, 0.0);
+	for (i = 0; i < p; i++) {
+		for (j = 0; j < p; j++) b[i] += inv[i][j] * xty[j];
+	}
+	
+	// residuals, one column of X at a time
+	double* e = &resid[worker][0];
+	for (cnt = 0; cnt < dim; cnt++) e[cnt] = y[cnt];
+	for (i = 0; i < p; i++) {
+		const double* x = X[v[i]];
+		for (cnt = 0; cnt < dim; cnt++) e[cnt] -= b[i] * x[cnt];
+	}
+	const double ee = product(e, e, dim);
+	const int n = dim;
+	const double df = dim - p;
+	const double sigma2 = ee / df;
+	
+	r.coeff = b;
+	r.probs.resize(p);
+	for (i = 0; i < p; i++) {
+		const double z = b[i] / sqrt(inv[i][i] * sigma2);
+		r.probs[i] = betai(df / 2.0, 0.5, df / (df + geoda_sqr(z)));
+		if (i == 0 && p == 1) r.ftest = geoda_sqr(z); // F test when k=1
+	}
+	
+	// fit as in classicalRegression
+	double sum_y = 0.0, R2 = 0;
+	if (!InclConstant) {
+		double e_bar = 0;
+		for (cnt = 0; cnt < dim; cnt++) e_bar += e[cnt];
+		e_bar /= dim;
+		double e2 = 0;
+		for (cnt = 0; cnt < dim; cnt++) {
+			e2 += geoda_sqr(e[cnt] - e_bar);
+			sum_y += geoda_sqr(y[cnt] - e_bar);
+		}
+		R2 = 1.0 - (e2 / (sum_y));
+	} else {
+		double ybar = 0;
+		for (cnt = 0; cnt < dim; cnt++) ybar += y[cnt];
+		ybar /= dim;
+		for (cnt = 0; cnt < dim; cnt++) sum_y += geoda_sqr(y[cnt] - ybar);
+		R2 = 1.0 - (ee / sum_y);
+	}
+	if (fabs(R2) > 1.0 || R2 < 0) R2 = 0.0;
+	r.r2 = R2;
+	r.r2_a = 1.0 - ((n - 1) * ((1.0 - R2) / (n - p)));
+	r.sig_sq = sigma2;
+	r.lik = -1.0 * ((n / 2.0) * (log(2.0 * M_PI)) +
+					(n / 2.0) * log((ee / n)) +
+					(ee / (2.0 * (ee / n))));
+	r.aic = -2.0 * r.lik + 2.0 * p;
+	r.sc = -2.0 * r.lik + p * log((double) n);
+	if (p > 1) r.ftest = (R2 / (p - 1.)) / ((1. - R2) / (n - p));
+	r.ftestP = fprob(p - 1, n - p, r.ftest);
+	// without a constant Jarque-Bera is computed from the centered
+	// residuals, as in classicalRegression; lag[worker] is free until the
+	// spatial diagnostics below
+	double* jb_e = e;
+	if (!InclConstant) {
+		double e_bar = 0;
+		for (cnt = 0; cnt < dim; cnt++) e_bar += e[cnt];
+		e_bar /= dim;
+		jb_e = &lag[worker][0];
+		for (cnt = 0; cnt < dim; cnt++) jb_e[cnt] = e[cnt] - e_bar;
+	}
+	double *jb = JarqueBera(jb_e, dim, p);
+	r.jb = jb[0];
+	r.jb_prob = jb[2];
+	delete [] jb;
+	r.ok = true;
+	if (!W) return;
+	
+	// diagnostics for spatial dependence: the e'We and e'Wy terms from the
+	// residuals, the WXb terms from the lagged cross-products
+	double* We = &lag[worker][0];
+	W->SpatialLag(e, We);
+	const double sigma2ml = ee / dim;
+	const double RS1 = product(e, Wy, dim) / sigma2ml; // e'Wy/sigma2
+	const double RS2 = product(e, We, dim) / sigma2ml; // e'We/sigma2
+	
+	// (WXb)'(WXb) and z = X'WXb
+	double WXb2 = 0, xMx = 0;
+	std::vector<double> z(p, 0.0);
+	for (i = 0; i < p; i++) {
+		for (j = 0; j < p; j++) {
+			WXb2 += b[i] * b[j] * g(m + v[i], m + v[j]);
+			z[i] += g(v[i], m + v[j]) * b[j];
+		}
+	}
+	for (i = 0; i < p; i++) {
+		for (j = 0; j < p; j++) xMx += z[i] * inv[i][j] * z[j];
+	}
+	const double T1 = (WXb2 - xMx) / sigma2ml;
+	const double T2 = 1.0 / (T1 + trWW);
+	
+	double RS = geoda_sqr(RS1) / (T1 + trWW);
+	r.lmlag_prob = gammp(0.5, RS * 0.5);
+	RS = geoda_sqr(RS1 - RS2) / (1.0 / T2 - trWW);
+	r.lmlagr_prob = gammp(0.5, RS * 0.5);
+	RS = geoda_sqr(RS2) / trWW;
+	r.lmerr_prob = gammp(0.5, RS * 0.5);
+	RS = geoda_sqr(RS2 - (RS1 * T2 * trWW)) / (trWW - (trWW * trWW * T2));
+	r.lmerrr_prob = gammp(0.5, RS * 0.5);
+	RS = (geoda_sqr(RS1 - RS2) / (1.0 / T2 - trWW)) + (RS2 * RS2 / trWW);
+	r.lmsarma_prob = gammp(1.0, RS * 0.5);
+	
+	r.moranI = RS2 * sigma2ml / ee; // e'We / e'e
+	if (!m_moranz) return;
+	// Moran's I z-value as in Compute_MoranZ, with A = inv(X'X)X'WX and
+	// the traces of inv(X'X) times X'WWX, X'WW'X and X'W'WX
+	std::vector<double> A(p * p, 0.0);
+	for (i = 0; i < p; i++) {
+		for (j = 0; j < p; j++) {
+			for (int l = 0; l < p; l++) {
+				A[i * p + j] += inv[i][l] * g(v[l], m + v[j]);
+			}
+		}
+	}
+	double trA = 0, trAA = 0, trB = 0;
+	for (i = 0; i < p; i++) {
+		trA += A[i * p + i];
+		for (j = 0; j < p; j++) {
+			trAA += A[i * p + j] * A[j * p + i];
+			trB += inv[i][j] * (2 * g(2 * m + v[j], m + v[i]) +
+								g(2 * m + v[j], 2 * m + v[i]) +
+								g(m + v[j], m + v[i]));
+		}
+	}
+	const double varI = (n - p) * (n - p + 2.0) /
+		(trWW + (2.0 * trAA) - trB - (2.0 * geoda_sqr(trA) / (n - p)));
+	const double mI = trA / (n - p);
+	const double MoranZ = (r.moranI + mI) * sqrt(varI);
+	r.moranI_prob = 2.0 * (1.0 - nc(fabs(MoranZ)));
+}
+
+void BatchRegressionRange(BatchRegression* b, size_t first, size_t last,
+						  int worker)
+{
+	for (size_t i = first; i <= last; i++) b->Solve(i, worker);
+}
 
-//	int wdf= InclConstant ? (geoda_sqr(k-1)+3*(k-1))/2 : (geoda_sqr(k)+3*k)/2;
-//	release(&resid);
-	resid = dr->GetResidual();
+bool BatchRegressionProgress(wxGauge* gauge, size_t done, size_t total)
+{
+	gauge->SetValue((gauge->GetRange() * done) / total);
+	return true;
+}
 
-	if (do_white_test) {
-		double *white = WhiteTest(dim, expl, resid, X, InclConstant);
-		dr->SetWhiteTest(0, white[0]);
-		dr->SetWhiteTest(1, white[1]);
-		dr->SetWhiteTest(2, white[2]);
+// Batch of OLS regressions of Y on subsets of the expl columns of X, one
+// for each entry of specs (the column indices of a specification).  The
+// cross-products of X, y and, with weights g, of their spatial lags WX, Wy
+// and W'X, W'y are computed once; each specification is then solved from
+// its submatrices on the task pool.  The heteroskedasticity tests need an
+// auxiliary regression per specification and are left to
+// classicalRegression.  The results are written to
+// dr->GetSpecifications() in the order of specs.
+bool batchRegression(GalElement *g, int dim, double * Y, double ** X,
+					 int expl, const std::vector< std::vector<int> >& specs,
+					 DiagnosticReport *dr, bool InclConstant, bool m_moranz,
+					 wxGauge* gauge)
+{
+	wxStopWatch sw;
+	BatchRegression b;
+	b.dim = dim;
+	b.expl = expl;
+	b.m = expl + 1;
+	b.ncols = g ? 3 * b.m : b.m;
+	b.y = Y;
+	b.Wy = 0;
+	b.X = X;
+	b.trWW = 0;
+	b.InclConstant = InclConstant;
+	b.m_moranz = m_moranz;
+	b.specs = &specs;
+	b.results = &dr->GetSpecifications();
+	b.results->clear();
+	b.results->resize(specs.size());
+	if (specs.empty()) return true;
+	
+	CsrWeight* W = g ? new CsrWeight(g, dim) : 0;
+	b.W = W;
+	int i = 0, cnt = 0;
+	std::vector<double> lags(g ? (size_t) 2 * b.m * dim : 0);
+	DenseVector *s = new DenseVector[b.ncols];
+	for (i = 0; i < b.m; i++) s[i].absorb(i < expl ? X[i] : Y, dim, false);
+	if (g) {
+		for (i = 0; i < b.m; i++) {
+			double* wz = &lags[(size_t) i * dim];
+			double* wtz = &lags[(size_t) (b.m + i) * dim];
+			W->SpatialLag(s[i].getThis(), wz);
+			// W'z, the transposed lag
+			for (cnt = 0; cnt < dim; cnt++) {
+				const long* nbrs = W->Nbrs(cnt);
+				const double* w = W->RowStdWeights(cnt);
+				const double zi = s[i].getValue(cnt);
+				for (long k = 0, sz = W->Size(cnt); k < sz; k++) {
+					wtz[nbrs[k]] += w[k] * zi;
+				}
+			}
+			s[b.m + i].absorb(wz, dim, false);
+			s[2 * b.m + i].absorb(wtz, dim, false);
+		}
+		b.Wy = s[b.m + expl].getThis();
+		b.trWW = T(g, dim);
+	}
+	b.G.resize((size_t) b.ncols * b.ncols);
+	CrossProducts(s, b.ncols, dim, 0, &b.G[0], 0);
+	delete [] s;
+	for (int c = 0; c < b.ncols; c++) {
+		for (i = c + 1; i < b.ncols; i++) {
+			b.G[i + b.ncols * c] = b.G[c + b.ncols * i];
+		}
 	}
+	LOG_MSG(wxString::Format("batchRegression: cross-products of %d columns "
+							 "in %ld ms", b.ncols, sw.Time()));
+	
+	const int nthreads = GenUtils::NumThreads(specs.size());
+	b.resid.resize(nthreads, std::vector<double>(dim));
+	// W e, or the centered residuals of Jarque-Bera without a constant
+	if (g || !InclConstant) b.lag.resize(nthreads, std::vector<double>(dim));
+	boost::function<bool (size_t, size_t)> progress;
+	if (gauge) progress = boost::bind(BatchRegressionProgress, gauge, _1, _2);
+	GenUtils::RunTasks(specs.size(),
+					   boost::bind(BatchRegressionRange, &b, _1, _2, _3),
+					   0, 0, progress);
+	if (W) delete W;
+	if (gauge) gauge->SetValue(gauge->GetRange());
+	LOG_MSG(wxString::Format("batchRegression: %d specifications in %ld ms",
+							 (int) specs.size(), sw.Time()));
+	return true;
+}
 
+/** Running sums with Kahan compensation, for adding up the totals of many
+ chunks of rows without the rounding error growing with their number. */
+struct KahanSums {
+	std::vector<double> sum, comp;
+	KahanSums(size_t n) : sum(n, 0.0), comp(n, 0.0) {}
+	void Add(const double* x) {
+		for (size_t i = 0; i < sum.size(); i++) {
+			const double y = x[i] - comp[i];
+			const double t = sum[i] + y;
+			comp[i] = (t - sum[i]) - y;
+			sum[i] = t;
+		}
+	}
+};
+
+// Reads rows first .. first+rows-1 of cols into the column-major block a,
+// after a column of ones if InclConstant.
+void StreamingChunk(TableInterface* table, const std::vector<int>& cols,
+					const std::vector<int>& tms, bool InclConstant,
+					int first, int rows, std::vector<double>& buf,
+					std::vector<double>& a)
+{
+	int c = 0;
+	if (InclConstant) {
+		std::fill(a.begin(), a.begin() + rows, 1.0);
+		c = 1;
+	}
+	for (size_t i = 0; i < cols.size(); i++, c++) {
+		table->GetColData(cols[i], tms[i], first, rows, buf);
+		std::copy(buf.begin(), buf.begin() + rows,
+				  a.begin() + (size_t) c * rows);
+	}
+}
 
-//	resid = dr->GetResidual();
-	double *bp = BP_Test(resid, dim, X, expl, InclConstant);
+// OLS of the last column of cols on the others (and a constant) for tables
+// too large to copy into dense arrays.  The data is read from the table a
+// chunk of rows at a time, twice: the first pass accumulates [X y]'[X y]
+// and the cross-products of the Breusch-Pagan regressors, the second the
+// moments of the residuals.  Within a chunk the sums are blocked
+// (CrossProductsAdd) and the chunk totals are added with Kahan
+// compensation.  The residuals and predicted values are stored in dr, or,
+// when resid_col and pred_col are not -1, written to these table columns a
+// chunk at a time instead (dr then does not keep them).  Reports the same
+// fit statistics and non-spatial diagnostics as classicalRegression except
+// White's test, whose auxiliary regression on all products of the
+// regressors is not accumulated.  Returns false if X'X cannot be inverted.
+bool streamingRegression(TableInterface* table, const std::vector<int>& cols,
+						 const std::vector<int>& tms, DiagnosticReport *dr,
+						 bool InclConstant, int resid_col, int pred_col,
+						 wxGauge* gauge)
+{
+	wxStopWatch sw;
+	const int n = table->GetNumberRows();
+	const int k = cols.size() - 1 + (InclConstant ? 1 : 0); // regressors
+	const int m = k + 1; // columns of [X y]
+	if (k < 1 || n <= k) return false;
+	int g_rng = 100;
+	if (gauge) {
+		g_rng = gauge->GetRange();
+		gauge->SetValue(0);
+	}
 
-	if (bp == NULL)
-	{
-		dr->SetBPTest(0, expl);
+	const int block = CrossProductsBlock(m, n);
+	const bool spill = (resid_col != -1 && pred_col != -1);
+	int i = 0, j = 0, cnt = 0, first = 0;
+	std::vector<double> buf(block), a((size_t) block * m);
+	std::vector<double> z((size_t) block * k), fit(block);
+
+	// pass 1: [X y]'[X y], Z'Z for the Breusch-Pagan regressors Z (a
+	// constant and the squares of the regressors of BP_Test) and sum of y
+	KahanSums G(m * m), ZZ(k * k), Sy(1);
+	std::vector<double> g(m * m), zz(k * k);
+	for (first = 0; first < n; first += block) {
+		const int rows = std::min(block, n - first);
+		StreamingChunk(table, cols, tms, InclConstant, first, rows, buf, a);
+		std::fill(g.begin(), g.end(), 0.0);
+		CrossProductsAdd(&a[0], rows, m, 0, &g[0], 0);
+		G.Add(&g[0]);
+
+		std::fill(z.begin(), z.begin() + rows, 1.0);
+		for (j = 1; j < k; j++) {
+			const double* x = &a[(size_t) (InclConstant ? j : j - 1) * rows];
+			double* zj = &z[(size_t) j * rows];
+			for (cnt = 0; cnt < rows; cnt++) zj[cnt] = geoda_sqr(x[cnt]);
+		}
+		std::fill(zz.begin(), zz.end(), 0.0);
+		CrossProductsAdd(&z[0], rows, k, 0, &zz[0], 0);
+		ZZ.Add(&zz[0]);
+
+		const double* y = &a[(size_t) k * rows];
+		double sy = 0;
+		for (cnt = 0; cnt < rows; cnt++) sy += y[cnt];
+		Sy.Add(&sy);
+		if (gauge) gauge->SetValue((int) (g_rng * (first + rows) / (3.0 * n)));
+	}
+	const long pass1_ms = sw.Time();
+
+	// coefficients
+	std::vector<double> xtx(k * k), xty(k), b(k, 0.0);
+	for (j = 0; j < k; j++) {
+		for (i = 0; i <= j; i++) xtx[i + k * j] = G.sum[i + m * j];
+		xty[j] = G.sum[j + m * k];
+	}
+	std::vector<double> work(xtx), cov_v(k * k);
+	std::vector<double*> cov(k);
+	for (i = 0; i < k; i++) cov[i] = &cov_v[i * k];
+	if (!CrossProductInverse(&work[0], k, &cov[0])) {
+		for (i = 0; i < k; i++) {
+			for (j = 0; j < k; j++) {
+				cov[i][j] = (i <= j) ? xtx[i + k * j] : xtx[j + k * i];
+			}
+		}
+		if (!SymMatInverse(&cov[0], k)) return false;
+	}
+	for (i = 0; i < k; i++) {
+		for (j = 0; j < k; j++) b[i] += cov[i][j] * xty[j];
+	}
+
+	// pass 2: sums of e, e^2, e^3, e^4, (y - ybar)^2 and Z'e^2
+	const double ybar = Sy.sum[0] / n;
+	KahanSums S(5 + k);
+	std::vector<double> s(5 + k), out;
+	for (first = 0; first < n; first += block) {
+		const int rows = std::min(block, n - first);
+		StreamingChunk(table, cols, tms, InclConstant, first, rows, buf, a);
+		std::fill(fit.begin(), fit.end(), 0.0);
+		for (j = 0; j < k; j++) {
+			const double* x = &a[(size_t) j * rows];
+			for (cnt = 0; cnt < rows; cnt++) fit[cnt] += b[j] * x[cnt];
+		}
+		std::fill(s.begin(), s.end(), 0.0);
+		if (spill) out.resize(rows);
+		const double* y = &a[(size_t) k * rows];
+		for (cnt = 0; cnt < rows; cnt++) {
+			const double e = y[cnt] - fit[cnt], e2 = e * e;
+			s[0] += e;
+			s[1] += e2;
+			s[2] += e2 * e;
+			s[3] += e2 * e2;
+			s[4] += geoda_sqr(y[cnt] - ybar);
+			s[5] += e2;
+			for (j = 1; j < k; j++) {
+				s[5 + j] += e2 *
+					geoda_sqr(a[cnt + (size_t) (InclConstant ? j : j-1) * rows]);
+			}
+			if (spill) {
+				out[cnt] = e;
+			} else {
+				dr->SetResidual(first + cnt, e);
+				dr->SetYHat(first + cnt, fit[cnt]);
+			}
+		}
+		S.Add(&s[0]);
+		if (spill) {
+			table->SetColData(resid_col, 0, first, out);
+			out.assign(fit.begin(), fit.begin() + rows);
+			table->SetColData(pred_col, 0, first, out);
+		}
+		if (gauge) gauge->SetValue((int) (g_rng * (n + 2.0 * (first + rows)) /
+										  (3.0 * n)));
+	}
+	const long pass2_ms = sw.Time() - pass1_ms;
+
+	const double ee = S.sum[1];
+	const double df = n - k;
+	const double sigma2 = ee / df;
+	for (cnt = 0; cnt < k; ++cnt) {
+		dr->SetCoeff(cnt, b[cnt]);
+		dr->SetStdError(cnt, sqrt(cov[cnt][cnt] * sigma2));
+		const double zval = dr->GetCoefficient(cnt) / dr->GetStdError(cnt);
+		dr->SetZValue(cnt, zval);
+		double tcdf = df / (df + geoda_sqr(dr->GetZValue(cnt)));
+		dr->SetProbVal(cnt, betai(df / 2.0, 0.5, tcdf));
+		for (j = 0; j < k; j++) dr->SetCovar(cnt, j, cov[cnt][j] * sigma2);
+	}
+	dr->SetSigSq(sigma2);
+	dr->SetSigSqLm(ee / n);
+	dr->SetMeanY(ybar);
+	dr->SetSDevY(sqrt(S.sum[4] / n));
+
+	// without a constant the residuals are centered first, as in
+	// classicalRegression
+	const double e_bar = InclConstant ? 0 : S.sum[0] / n;
+	const double e2 = S.sum[1] - n * geoda_sqr(e_bar);
+	const double e3 = S.sum[2] - 3 * e_bar * S.sum[1] +
+		2 * n * pow(e_bar, 3);
+	const double e4 = S.sum[3] - 4 * e_bar * S.sum[2] +
+		6 * geoda_sqr(e_bar) * S.sum[1] - 3 * n * pow(e_bar, 4);
+	double R2;
+	if (!InclConstant) {
+		const double sum_y = S.sum[4] + n * geoda_sqr(ybar - e_bar);
+		R2 = 1.0 - (e2 / sum_y);
+	} else {
+		R2 = 1.0 - (ee / S.sum[4]);
+	}
+	if (fabs(R2) > 1.0 || R2 < 0)
+		R2 = 0.0;
+
+	dr->SetR2Fit(R2);
+	dr->SetR2Adjust(1.0 - ((n - 1) * ((1.0 - R2) / (n - k))));
+
+	double lik = -1.0 * ((n / 2.0) * (log(2.0 * M_PI)) +
+						 (n / 2.0) * log((ee / n)) +
+						 (ee / (2.0 * (ee / n))));
+	dr->SetLIK(lik);
+	dr->SetAIC(-2.0 * lik + 2.0 * k); // # Akaike AIC
+	dr->SetSC(-2.0 * lik + k * log((double) n)); // # Schwartz SC 
+
+	double f_value;
+	if (k == 1)
+		f_value = geoda_sqr(dr->GetZValue(0)); // F test when k=1
+	else
+		f_value = (R2 / (k - 1.)) / ((1. - R2) / (n - k));// # F-test when k>1
+	dr->SetFTest(f_value);
+	dr->SetFTestProb(fprob(k - 1, n - k, f_value)); // Prob of F-test
+	dr->SetRSS(ee);
+
+	const double cn = MC_Condition_Number(&xtx[0], k);
+	if (cn == -999) wxMessageBox("error in computing eigenvalues");
+	dr->SetCondNumber(cn);
+
+	double *jb = JarqueBera(e2, e3, e4, n);
+	dr->SetJBTest(0, 2.0);
+	dr->SetJBTest(1, jb[0]);
+	dr->SetJBTest(2, jb[2]);
+	delete [] jb;
+
+	std::vector<double> ztz(ZZ.sum);
+	double *bp = BP_Test(&ztz[0], &S.sum[5], ee, S.sum[3], n, k, InclConstant);
+	if (bp == NULL) {
+		dr->SetBPTest(0, k);
 		dr->SetBPTest(1, -1.0);
 		dr->SetBPTest(2, -1.0);
 
-		dr->SetKBTest(0, expl);
+		dr->SetKBTest(0, k);
 		dr->SetKBTest(1, -1.0);
 		dr->SetKBTest(2, -1.0);
-	}
-	else
-	{
+	} else {
 		dr->SetBPTest(0, bp[1]);
 		dr->SetBPTest(1, bp[0]);
 		dr->SetBPTest(2, bp[2]);
@@ -884,13 +1502,16 @@ bool classicalRegression(GalElement *g,
 		dr->SetKBTest(0, bp[4]);
 		dr->SetKBTest(1, bp[3]);
 		dr->SetKBTest(2, bp[5]);
+		delete [] bp;
 	}
 
-	release(&cov);
-	release(&x);
+	dr->AddTiming("Cross-products (first pass)", pass1_ms);
+	dr->AddTiming("Residual moments (second pass)", pass2_ms);
 	if (gauge) gauge->SetValue(g_rng);
-
-    return true;
+	LOG_MSG(wxString::Format("streamingRegression: %d rows, %d regressors, "
+							 "chunks of %d rows in %ld ms", n, k, block,
+							 sw.Time()));
+	return true;
 }
 
 bool spatialLagRegression(GalElement *g,
@@ -901,7 +1522,8 @@ bool spatialLagRegression(GalElement *g,
 						  int deps, 
 						  DiagnosticReport *dr, 
 						  bool InclConstant,
-						  wxGauge* p_bar)  
+						  wxGauge* p_bar,
+						  TraceApprox* approx)  
 {
 	LOG_MSG("Entering spatialLagRegression, GalElement*");
 
@@ -916,7 +1538,7 @@ bool spatialLagRegression(GalElement *g,
 	
 	initRho = SimulationLag(g, num_obs, 41, 0.31, Y, X, deps,
 							!InclConstant, &LogLike,
-							p_bar, 0, 0.1);
+							p_bar, 0, 0.1, approx);
 	SparseMatrix	orig(g, dim);
 
 	double **cov = new double * [deps];
@@ -944,13 +1566,13 @@ bool spatialLagRegression(GalElement *g,
 	
 	double trace, trace2, fr;
 	
-	run1( orig, initRho, trace, trace2, fr, p_bar, 0.1, 0.55 );
+	run1( orig, initRho, trace, trace2, fr, p_bar, 0.1, 0.55, approx );
 	// correction for rho:  m
 	// final rho: finRho
 	double m = mic(r, rw, initRho, trace, trace2);
 	double finRho = initRho - m;
 	
-	run1( orig, finRho, trace, trace2, fr, p_bar, 0.55, 1 );	
+	run1( orig, finRho, trace, trace2, fr, p_bar, 0.55, 1, approx );	
 	
 	// approximate computational error: m 
 	m = mic(r, rw, finRho, trace, trace2);
@@ -1107,6 +1729,14 @@ bool spatialLagRegression(GalElement *g,
 	dr->SetAIC(aic); // # Akaike AIC
 	dr->SetSC(sc); // # Schwartz SC 
 	dr->SetSigSq(sigma2);
+	if (approx) {
+		dr->SetApproximation(approx->logdet_probes, approx->trace_probes,
+							 approx->series_order, approx->logdet_se,
+							 approx->logdet_trunc, approx->trace_rse);
+		dr->SetApproxTruncationHigh(approx->logdet_trunc_high);
+		dr->SetCholeskyFactorSize(approx->factor_size);
+		dr->SetCholeskyAsymmetric(approx->asymmetric);
+	}
 	
 	double LRtest = 2.0 * (lik - likOLS);
 	dr->SetLR_Test(0,1.0);
@@ -1161,7 +1791,8 @@ bool spatialErrorRegression(GalElement *g,
 							int deps, 
 							DiagnosticReport *rr, 
 							bool InclConstant,
-							wxGauge* p_bar)  
+							wxGauge* p_bar,
+							TraceApprox* approx)  
 {
 	typedef double* double_ptr_type;
 	DenseVector		y(Y, dim, false), *X = new DenseVector[deps];
@@ -1174,7 +1805,8 @@ bool spatialErrorRegression(GalElement *g,
 	
 	double LogLike = 0, initLambda = 0;
 	initLambda = SimulationError(g, num_obs, 100, 0.31, Y, XX, deps, beta,
-								 !InclConstant, &LogLike, p_bar, 0.0, 0.1 );
+								 !InclConstant, &LogLike, p_bar, 0.0, 0.1,
+								 approx );
 	release(&beta);
 	
 	double **cov = new double * [deps], *e_ols = new double [n];
@@ -1207,7 +1839,7 @@ bool spatialErrorRegression(GalElement *g,
 	double sigma2 = rsd.norm() / dim;
 	
 	orig.makeStdSymmetric();
-	run1( orig, initLambda, trace, trace2, fr, p_bar, 0.1, 0.55 );
+	run1( orig, initLambda, trace, trace2, fr, p_bar, 0.1, 0.55, approx );
 	orig.makeRowStd();
 	
 	// correction for lambda: m 
@@ -1217,7 +1849,7 @@ bool spatialErrorRegression(GalElement *g,
 	
 	orig.makeStdSymmetric();
 	
-	run1( orig, lambda, trace, trace2, fr, p_bar, 0.55, 1 );
+	run1( orig, lambda, trace, trace2, fr, p_bar, 0.55, 1, approx );
 	orig.makeRowStd();
 	
 	EGLS(lambda, y, X, orig, egls);
@@ -1334,6 +1966,14 @@ bool spatialErrorRegression(GalElement *g,
 	rr->SetLIK(lik);
 	rr->SetAIC(aic); // # Akaike AIC
 	rr->SetSC(sc); // # Schwartz SC 
+	if (approx) {
+		rr->SetApproximation(approx->logdet_probes, approx->trace_probes,
+							 approx->series_order, approx->logdet_se,
+							 approx->logdet_trunc, approx->trace_rse);
+		rr->SetApproxTruncationHigh(approx->logdet_trunc_high);
+		rr->SetCholeskyFactorSize(approx->factor_size);
+		rr->SetCholeskyAsymmetric(approx->asymmetric);
+	}
 	
 	double LRtest = 2.0 * (lik - likOLS);
 	rr->SetLR_Test(0,1.0);
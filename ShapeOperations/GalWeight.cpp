@@ -34,15 +34,56 @@
 
 
 
-GalElement::GalElement()
+GalElement::GalElement() : nbrOrderValid(false)
 {
 }
 
+/** Orders positions in a neighbor list by neighbor id. */
+struct NbrPosLess {
+	const std::vector<long>& nbr;
+	NbrPosLess(const std::vector<long>& nbr_) : nbr(nbr_) {}
+	bool operator()(int a, int b) const { return nbr[a] < nbr[b]; }
+};
+
+void GalElement::MakeNbrOrder()
+{
+	nbrOrder.clear();
+	nbrOrderValid = true;
+	size_t sz = nbr.size();
+	bool asc = true, desc = true;
+	for (size_t i=1; i<sz && (asc || desc); i++) {
+		if (nbr[i-1] > nbr[i]) asc = false;
+		if (nbr[i-1] < nbr[i]) desc = false;
+	}
+	if (asc || desc) return;
+	nbrOrder.resize(sz);
+	for (size_t i=0; i<sz; i++) nbrOrder[i] = i;
+	std::sort(nbrOrder.begin(), nbrOrder.end(), NbrPosLess(nbr));
+}
+
+int GalElement::FindNbr(long nbr_id)
+{
+	if (!nbrOrderValid) MakeNbrOrder();
+	size_t sz = nbr.size();
+	if (sz == 0) return -1;
+	bool by_order = !nbrOrder.empty();
+	bool desc = !by_order && nbr[0] > nbr[sz-1];
+	// lower bound of nbr_id
+	size_t lo = 0, hi = sz;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		long v = nbr[by_order ? nbrOrder[mid] : mid];
+		if (desc ? v > nbr_id : v < nbr_id) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo == sz) return -1;
+	int pos = by_order ? nbrOrder[lo] : (int) lo;
+	return nbr[pos] == nbr_id ? pos : -1;
+}
+
 bool GalElement::Check(long nbrIdx)
 {
-    if (nbrLookup.find(nbrIdx) != nbrLookup.end())
-        return true;
-    return false;
+	return FindNbr(nbrIdx) != -1;
 }
 
 // return row standardized weights value
@@ -60,14 +101,16 @@ double GalElement::GetRW(int idx)
             nbrAvgW[i] = nbrWeight[i] / sumW;
         }
     }
-    if (Check(idx) == false)
+    int pos = FindNbr(idx);
+    if (pos == -1)
         return 0;
     
-    return nbrAvgW[nbrLookup[idx]];
+    return nbrAvgW[pos];
 }
 
 void GalElement::SetSizeNbrs(size_t	sz)
 {
+	nbrOrderValid = false;
 	nbr.resize(sz);
     nbrWeight.resize(sz);
     for(size_t i=0; i<sz; i++) {
@@ -79,7 +122,7 @@ void GalElement::SetNbr(size_t pos, long n)
 {
     if (pos < nbr.size()) {
         nbr[pos] = n;
-        nbrLookup[n] = pos;
+        nbrOrderValid = false;
     }
     // this should be called by GAL created only
     if (pos < nbrWeight.size()) {
@@ -91,7 +134,7 @@ void GalElement::SetNbr(size_t pos, long n, double w)
 {
     if (pos < nbr.size()) {
         nbr[pos] = n;
-        nbrLookup[n] = pos;
+        nbrOrderValid = false;
     }
     // this should be called by GWT-GAL 
     if (pos < nbrWeight.size()) {
@@ -107,7 +150,6 @@ void GalElement::SetNbrs(const std::vector<long>& nbrs)
         size_t sz = nbr.size();
         nbrWeight.resize(sz);
         for(size_t i=0; i<sz; i++) {
-            nbrLookup[nbrs[i]] = i;
             nbrWeight[i] = 1.0;
         }
     }
@@ -122,6 +164,7 @@ void GalElement::SetNbrs(const GalElement& gal)
     
     nbr = gal.GetNbrs();
     nbrWeight = gal.GetNbrWeights();
+    nbrOrderValid = false;
 }
 
 const std::vector<long> & GalElement::GetNbrs() const
@@ -137,6 +180,7 @@ const std::vector<double> & GalElement::GetNbrWeights() const
 void GalElement::SortNbrs()
 {
 	std::sort(nbr.begin(), nbr.end(), std::greater<long>());
+	nbrOrderValid = false;
 }
 
 /** Compute spatial lag for a contiguity weights matrix.
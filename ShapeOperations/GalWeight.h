@@ -21,7 +21,6 @@
 #define __GEODA_CENTER_GAL_WEIGHT_H__
 
 #include <vector>
-#include <map>
 #include "GeodaWeight.h"
 
 class Project;
@@ -48,10 +47,18 @@ public:
     bool Check(long nbrIdx);
     
 private:
-    std::map<long, int> nbrLookup; // nbr_id, idx_in_nbrWeight
+	/** position of nbr_id in nbr, or -1 if it is not a neighbor */
+	int FindNbr(long nbr_id);
+	void MakeNbrOrder();
+	
 	std::vector<long> nbr;
 	std::vector<double> nbrWeight;
     std::vector<double> nbrAvgW;
+	// Positions in nbr sorted by neighbor id, for binary search in Check
+	// and GetRW.  Built on first lookup and left empty when nbr itself is
+	// already sorted in either direction, as it is for most weights.
+	std::vector<int> nbrOrder;
+	bool nbrOrderValid;
 };
 
 class GalWeight : public GeoDaWeight {
@@ -72,6 +79,9 @@ public:
                         std::vector<wxInt64>& stack_ids,
                         const wxString& ofname);
     virtual bool SaveSpaceTimeWeights(const wxString& ofname, WeightsManInterface* wmi, TableInterface* table_int);
+	
+protected:
+	virtual CsrWeight* NewCsr() { return new CsrWeight(gal, num_obs); }
 };
 
 namespace Gda {
@@ -18,9 +18,128 @@
  */
 
 #include <wx/filename.h>
+#include "../GenUtils.h"
+#include "GalWeight.h"
+#include "GwtWeight.h"
 #include "GeodaWeight.h"
 
+CsrWeight::CsrWeight(const GalElement* gal, int num_obs_, bool row_standardize)
+: num_obs(num_obs_), offset(num_obs_+1, 0), binary(true)
+{
+	for (int i=0; i<num_obs; i++) offset[i+1] = offset[i] + gal[i].Size();
+	nbr.resize(offset[num_obs]);
+	weight.resize(offset[num_obs]);
+	for (int i=0; i<num_obs; i++) {
+		const std::vector<long>& nbrs = gal[i].GetNbrs();
+		const std::vector<double>& w = gal[i].GetNbrWeights();
+		long o = offset[i];
+		for (size_t j=0, sz=nbrs.size(); j<sz; j++) {
+			nbr[o+j] = nbrs[j];
+			weight[o+j] = (j < w.size()) ? w[j] : 1.0;
+			if (weight[o+j] != 1.0) binary = false;
+		}
+	}
+	if (row_standardize) RowStandardize();
+}
+
+CsrWeight::CsrWeight(const GwtElement* gwt, int num_obs_, bool row_standardize)
+: num_obs(num_obs_), offset(num_obs_+1, 0), binary(true)
+{
+	for (int i=0; i<num_obs; i++) offset[i+1] = offset[i] + gwt[i].Size();
+	nbr.resize(offset[num_obs]);
+	weight.resize(offset[num_obs]);
+	for (int i=0; i<num_obs; i++) {
+		long o = offset[i];
+		for (long j=0, sz=gwt[i].Size(); j<sz; j++) {
+			nbr[o+j] = gwt[i].data[j].nbx;
+			weight[o+j] = gwt[i].data[j].weight;
+			if (weight[o+j] != 1.0) binary = false;
+		}
+	}
+	if (row_standardize) RowStandardize();
+}
+
+void CsrWeight::RowStandardize()
+{
+	rs_weight.resize(weight.size());
+	for (int i=0; i<num_obs; i++) {
+		double sumW = 0;
+		for (long k=offset[i]; k<offset[i+1]; k++) sumW += weight[k];
+		for (long k=offset[i]; k<offset[i+1]; k++) {
+			rs_weight[k] = (sumW == 0) ? 0 : weight[k] / sumW;
+		}
+	}
+}
+
+bool CsrWeight::HasIsolates() const
+{
+	for (int i=0; i<num_obs; i++) {
+		if (offset[i+1] == offset[i]) return true;
+	}
+	return false;
+}
+
+long CsrWeight::MaxSize() const
+{
+	long m = 0;
+	for (int i=0; i<num_obs; i++) {
+		if (offset[i+1] - offset[i] > m) m = offset[i+1] - offset[i];
+	}
+	return m;
+}
+
+uint64_t CsrWeight::Hash() const
+{
+	uint64_t h = Gda::HashBytes(&num_obs, sizeof(num_obs));
+	h = Gda::HashBytes(&offset[0], offset.size()*sizeof(long), h);
+	if (!nbr.empty()) h = Gda::HashBytes(&nbr[0], nbr.size()*sizeof(long), h);
+	if (!weight.empty()) {
+		h = Gda::HashBytes(&weight[0], weight.size()*sizeof(double), h);
+	}
+	return h;
+}
+
+double CsrWeight::SpatialLag(int i, const double* x) const
+{
+	double lag = 0;
+	if (!rs_weight.empty()) {
+		for (long k=offset[i]; k<offset[i+1]; k++) lag += x[nbr[k]] * rs_weight[k];
+		return lag;
+	}
+	double sumW = 0;
+	for (long k=offset[i]; k<offset[i+1]; k++) {
+		lag += x[nbr[k]] * weight[k];
+		sumW += weight[k];
+	}
+	return (sumW == 0) ? 0 : lag / sumW;
+}
+
+void CsrWeight::SpatialLag(const double* x, double* lag) const
+{
+	for (int i=0; i<num_obs; i++) lag[i] = SpatialLag(i, x);
+}
+
+double CsrWeight::WeightedSum(int i, const double* x) const
+{
+	double lag = 0;
+	for (long k=offset[i]; k<offset[i+1]; k++) lag += x[nbr[k]] * weight[k];
+	return lag;
+}
+
+GalElement* CsrWeight::ToGal() const
+{
+	GalElement* gal = new GalElement[num_obs];
+	for (int i=0; i<num_obs; i++) {
+		gal[i].SetSizeNbrs(Size(i));
+		for (long k=offset[i]; k<offset[i+1]; k++) {
+			gal[i].SetNbr(k-offset[i], nbr[k], weight[k]);
+		}
+	}
+	return gal;
+}
+
 GeoDaWeight::GeoDaWeight(const GeoDaWeight& gw)
+: csr(0)
 {
 	GeoDaWeight::operator=(gw);
 }
@@ -33,10 +152,17 @@ const GeoDaWeight& GeoDaWeight::operator=(const GeoDaWeight& gw)
 	symmetry_checked = gw.symmetry_checked;
 	is_symmetric = gw.is_symmetric;
 	num_obs = gw.num_obs;
+	InvalidateCsr();
 	
 	return *this;
 }
 
+const CsrWeight& GeoDaWeight::GetCsr()
+{
+	if (!csr) csr = NewCsr();
+	return *csr;
+}
+
 wxString GeoDaWeight::GetTitle()
 {
 	if (!title.IsEmpty()) return title;
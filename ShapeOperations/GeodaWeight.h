@@ -20,19 +20,82 @@
 #ifndef __GEODA_CENTER_GEODA_WEIGHTS_H__
 #define __GEODA_CENTER_GEODA_WEIGHTS_H__
 
+#include <stdint.h>
 #include <vector>
 #include <wx/string.h>
 
 class Project;
 class WeightsManInterface;
 class TableInterface;
+class GalElement;
+class GwtElement;
+
+/**
+ Compressed sparse row (CSR) storage for a spatial weights matrix.  All
+ neighbor lists live in two contiguous arrays: the neighbors of observation
+ i are nbr[offset[i]] .. nbr[offset[i+1]-1], with their weights at the same
+ positions of weight.  When requested, row-standardized weights are kept in
+ a third array of the same layout.  GalElement and GwtElement arrays can be
+ converted in both directions, so existing callers keep working.
+ */
+class CsrWeight {
+public:
+	CsrWeight() : num_obs(0), offset(1, 0), binary(true) {}
+	CsrWeight(const GalElement* gal, int num_obs, bool row_standardize=true);
+	CsrWeight(const GwtElement* gwt, int num_obs, bool row_standardize=true);
+	
+	int NumObs() const { return num_obs; }
+	long NumNonZero() const { return nbr.size(); }
+	long Size(int i) const { return offset[i+1] - offset[i]; }
+	/** largest number of neighbors of any observation */
+	long MaxSize() const;
+	/** hash of the neighbors and weights, see Gda::HashBytes */
+	uint64_t Hash() const;
+	/** neighbors of observation i, Size(i) entries */
+	const long* Nbrs(int i) const { return nbr.empty() ? 0 : &nbr[offset[i]]; }
+	/** weights of observation i, Size(i) entries */
+	const double* Weights(int i) const {
+		return weight.empty() ? 0 : &weight[offset[i]]; }
+	/** row-standardized weights of observation i, or 0 if not computed */
+	const double* RowStdWeights(int i) const {
+		return rs_weight.empty() ? 0 : &rs_weight[offset[i]]; }
+	bool IsRowStandardized() const { return !rs_weight.empty(); }
+	/** true if every weight is 1, as for GAL files.  Permutation tests
+	 can then add up the drawn values instead of weighting them. */
+	bool IsBinary() const { return binary; }
+	void RowStandardize();
+	bool HasIsolates() const;
+	
+	/** Row-standardized spatial lag of x at observation i. Same result as
+	 GalElement::SpatialLag. */
+	double SpatialLag(int i, const double* x) const;
+	double SpatialLag(int i, const std::vector<double>& x) const {
+		return x.empty() ? 0 : SpatialLag(i, &x[0]); }
+	/** Row-standardized spatial lag of x for all observations. */
+	void SpatialLag(const double* x, double* lag) const;
+	/** Sum of x over the neighbors of observation i times their weights as
+	 stored, i.e. the spatial lag without row-standardizing. */
+	double WeightedSum(int i, const double* x) const;
+	
+	/** Array of num_obs GalElements for callers not yet using CSR.  The
+	 caller owns the returned array. */
+	GalElement* ToGal() const;
+	
+private:
+	int num_obs;
+	std::vector<long> offset; // num_obs+1 entries
+	std::vector<long> nbr;
+	std::vector<double> weight;
+	std::vector<double> rs_weight;
+	bool binary;
+};
 
 class GeoDaWeight {
 public:
-	GeoDaWeight() : symmetry_checked(false), num_obs(0) {}
+	GeoDaWeight() : symmetry_checked(false), num_obs(0), csr(0) {}
 	GeoDaWeight(const GeoDaWeight& gw);
     
-	virtual ~GeoDaWeight() {}
+	virtual ~GeoDaWeight() { if (csr) delete csr; csr = 0; }
 
 public:
 	virtual const GeoDaWeight& operator=(const GeoDaWeight& gw);
@@ -46,6 +109,15 @@ public:
                                 std::vector<wxInt64>& stack_ids,
                                 const wxString& ofname)=0;
     virtual bool SaveSpaceTimeWeights(const wxString& ofname, WeightsManInterface* wmi, TableInterface* table_int)=0;
+	
+	/** CSR copy of the weights with row-standardized weights, built on
+	 first use.  Call InvalidateCsr after changing the neighbor lists. */
+	const CsrWeight& GetCsr();
+	void InvalidateCsr() { if (csr) delete csr; csr = 0; }
+	
+protected:
+	virtual CsrWeight* NewCsr() = 0;
+	CsrWeight* csr;
    
 public:
 	enum WeightType { gal_type, gwt_type };
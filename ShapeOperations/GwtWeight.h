@@ -77,6 +77,9 @@ public:
                         std::vector<wxInt64>& stack_ids,
                         const wxString& ofname);
     virtual bool SaveSpaceTimeWeights(const wxString& ofname, WeightsManInterface* wmi, TableInterface* table_int);
+	
+protected:
+	virtual CsrWeight* NewCsr() { return new CsrWeight(gwt, num_obs); }
 };
 
 namespace Gda {
@@ -24,12 +24,18 @@
 #include <iomanip>
 #include <cmath>
 #include <time.h>
+#include <algorithm>
+#include <functional>
+#include <utility>
 #include <vector>
+#include <boost/bind.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <wx/wxprec.h>
 #ifndef WX_PRECOMP
 #include <wx/wx.h>
 #endif
+#include <wx/stopwatch.h>
 
 #include "AbstractShape.h"
 #include "BasePoint.h"
@@ -200,6 +206,7 @@ class PolygonPartition
 	BasePartition       pX;
 	PartitionP          pY;
 	int *               nbrPoints;
+	bool                ownNbrPoints;
 	
 	int prev(const int pt) const  
 	{
@@ -217,13 +224,23 @@ class PolygonPartition
 	int                 NumParts;
 	
 	PolygonPartition(Shapefile::PolygonContents* _poly)
-	: pX(), pY(), nbrPoints(NULL) {
+	: pX(), pY(), nbrPoints(NULL), ownNbrPoints(true) {
+		poly = _poly;
+		NumPoints = poly->num_points;
+		NumParts = poly->num_parts;
+	}
+	/** nbrPoints is a ring neighbor table created with NewNbrPoints that
+	 is shared with other partitions of the same polygon and not deleted. */
+	PolygonPartition(Shapefile::PolygonContents* _poly, int* _nbrPoints)
+	: pX(), pY(), nbrPoints(_nbrPoints), ownNbrPoints(false) {
 		poly = _poly;
 		NumPoints = poly->num_points;
 		NumParts = poly->num_parts;
 	}
 	~PolygonPartition();
 	
+	static int* NewNbrPoints(Shapefile::PolygonContents* poly);
+	
 	Shapefile::Point* GetPoint(const int i){ return &poly->points[i];}
 	int GetPart(int i){ return (int)poly->parts[i]; }
 	double GetMinX(){ return (double)poly->box[0]; }
@@ -639,7 +656,8 @@ void PartitionP::remove(const int del)  {
  PolygonPartition:: destructor
  */
 PolygonPartition::~PolygonPartition()   {
-	if (nbrPoints)  {  delete [] nbrPoints;  nbrPoints= NULL;  };
+	if (nbrPoints && ownNbrPoints)  {  delete [] nbrPoints;  };
+	nbrPoints= NULL;
 	return;
 }
 
@@ -696,21 +714,35 @@ int PolygonPartition::MakePartition(int mX, int mY)  {
 
 /*
  PolygonPartition
+ Ring neighbor table used by prev() and succ(). It depends only on the
+ polygon, so it can be built once and shared between partitions.
  */
-void PolygonPartition::MakeNeighbors()  
+int* PolygonPartition::NewNbrPoints(Shapefile::PolygonContents* poly)
 {
-	nbrPoints= new int [ NumPoints ];
-	if (nbrPoints == NULL) return;
+	int NumPoints = poly->num_points;
+	int NumParts = poly->num_parts;
+	int* nbrPoints= new int [ NumPoints ];
 	for (int cnt= 0; cnt < NumPoints; ++cnt) {
 		nbrPoints [ cnt ] = cnt+1;
 	}
 	int first= 0, last;
 	for (int part= 1; part <= NumParts; ++part) {
-		last= (part == NumParts) ? NumPoints : GetPart(part);
+		last= (part == NumParts) ? NumPoints : (int)poly->parts[part];
 		nbrPoints [ first ] = -(last-2);
 		nbrPoints [ last-1 ] = first+1;
 		first= last;
-	}	
+	}
+	return nbrPoints;
+}
+
+/*
+ PolygonPartition
+ */
+void PolygonPartition::MakeNeighbors()  
+{
+	if (nbrPoints) return;
+	nbrPoints= NewNbrPoints(poly);
+	ownNbrPoints= true;
 }
 
 /*
@@ -1116,168 +1148,513 @@ void PartitionM::remove(const int del)  {
 
 
 
-// # of records in the Shapefile == dimesion of the weights matrix
-static long         gRecords= 0;
-// locations of the polygon records in the shp file
-static long *       gOffset= NULL;
-// bounding boxes for each polygon
-static Box *        gBox= NULL;
-// bounding box for the entire map
-static Box          gBigBox;
-// partition constructed on lower(x) and upper(x) for each polygon
-static BasePartition  gMinX, gMaxX;
-// partition constructed on y for each polygon
-static PartitionM * gY;
+typedef std::vector<std::pair<long, long> > NbrPairs;
+
+/**
+ Builds the weights from lists of related pairs.  Each pair (i,j) is added
+ to the neighbors of both i and j, and every neighbor list is sorted in
+ descending order with duplicates removed.  The single-threaded sweep only
+ sorted the rows that MakeFull had to complete and kept the rest in the
+ order the sweep found them, so .gal files written from these weights
+ list the same neighbors, but on some lines in a different order.
+ */
+static GalElement* PairsToGal(long num_recs,
+							  const std::vector<NbrPairs>& pair_lists)
+{
+	GalElement* gl= new GalElement [ num_recs ];
+	std::vector<std::vector<long> > G(num_recs);
+	for (size_t s=0; s<pair_lists.size(); ++s) {
+		const NbrPairs& pairs = pair_lists[s];
+		for (size_t k=0; k<pairs.size(); ++k) {
+			G[pairs[k].first].push_back(pairs[k].second);
+			G[pairs[k].second].push_back(pairs[k].first);
+		}
+	}
+	for (long i=0; i<num_recs; ++i) {
+		if (G[i].empty()) continue;
+		std::sort(G[i].begin(), G[i].end(), std::greater<long>());
+		G[i].erase(std::unique(G[i].begin(), G[i].end()), G[i].end());
+		gl[i].SetSizeNbrs(G[i].size());
+		for (size_t j=0; j<G[i].size(); ++j) gl[i].SetNbr(j, G[i][j]);
+	}
+	return gl;
+}
 
+/**
+ ContiguityEngine
+ Builds queen or rook contiguity for all polygons of a Shapefile.  All
+ state is held by the engine object, so several weights can be built at
+ the same time.  The map is cut into vertical x-strips holding roughly the
+ same number of polygons and each strip is swept by its own worker thread
+ with the lower(x) / upper(x) / y partitions of the original sweep.  A pair
+ of polygons is only tested in the strip where the x-overlap of their
+ bounding boxes begins, so every pair is tested exactly once.
+ */
+class ContiguityEngine {
+public:
+	ContiguityEngine(Shapefile::Main& main, bool is_queen,
+					 double precision_threshold);
+	~ContiguityEngine();
+	GalElement* Run();
+	
+private:
+	void SweepStrips(size_t strip_start, size_t strip_end, int thread_id);
+	void SweepStrip(int strip);
+	void MakeNbrPoints(size_t start, size_t end, int thread_id);
+	int StripOf(double x) const;
+	
+	bool is_queen;
+	double precision_threshold;
+	// # of records in the Shapefile == dimension of the weights matrix
+	long num_recs;
+	std::vector<Shapefile::PolygonContents*> polys;
+	// ring neighbor table for each polygon, shared by all partitions
+	std::vector<int*> nbr_points;
+	// bounding box for the entire map
+	double shp_min_y, shp_y_len;
+	// strip s covers x in [strip_x[s], strip_x[s+1]]
+	std::vector<double> strip_x;
+	// related pairs found in each strip
+	std::vector<NbrPairs> strip_pairs;
+};
 
-GalElement* MakeContiguity(Shapefile::Main& main, bool is_queen,
-                           double precision_threshold=0.0)
+ContiguityEngine::ContiguityEngine(Shapefile::Main& main, bool is_queen_,
+								   double precision_threshold_)
+: is_queen(is_queen_), precision_threshold(precision_threshold_)
 {
 	using namespace Shapefile;
-	int curr;
-	GalElement * gl= new GalElement [ gRecords ];
+	num_recs = main.records.size();
+	polys.resize(num_recs);
+	for (long cnt= 0; cnt < num_recs; ++cnt) {
+		polys[cnt] = dynamic_cast<PolygonContents*> (main.records[cnt].contents_p);
+	}
+	nbr_points.resize(num_recs, 0);
+	shp_min_y = (double)main.header.bbox_y_min;
+	shp_y_len = (double)main.header.bbox_y_max - shp_min_y;
 	
-	if (!gl) return NULL;
-	GeoDaSet   Neighbors(gRecords), Related(gRecords);
-	//  cout << "total steps= " << gMinX.Cells() << endl;
-	for (int step= 0; step < gMinX.Cells(); ++step) {
+	// strip boundaries at quantiles of lower(x) so that strips hold
+	// roughly the same number of polygons
+	double shp_min_x = (double)main.header.bbox_x_min;
+	double shp_max_x = (double)main.header.bbox_x_max;
+	int num_strips = GenUtils::NumThreads(num_recs);
+	if (shp_max_x <= shp_min_x) num_strips = 1;
+	std::vector<double> min_x(num_recs);
+	for (long cnt= 0; cnt < num_recs; ++cnt) min_x[cnt] = polys[cnt]->box[0];
+	std::sort(min_x.begin(), min_x.end());
+	strip_x.push_back(shp_min_x);
+	for (int s= 1; s < num_strips; ++s) {
+		double x = min_x[(num_recs * s) / num_strips];
+		if (x > strip_x.back() && x < shp_max_x) strip_x.push_back(x);
+	}
+	strip_x.push_back(shp_max_x);
+	strip_pairs.resize(strip_x.size()-1);
+}
+
+ContiguityEngine::~ContiguityEngine()
+{
+	for (size_t i=0; i<nbr_points.size(); ++i) {
+		if (nbr_points[i]) delete [] nbr_points[i];
+	}
+}
+
+int ContiguityEngine::StripOf(double x) const
+{
+	int s = (int) (std::upper_bound(strip_x.begin(), strip_x.end(), x)
+				   - strip_x.begin()) - 1;
+	if (s < 0) s = 0;
+	if (s >= (int) strip_pairs.size()) s = strip_pairs.size()-1;
+	return s;
+}
+
+void ContiguityEngine::MakeNbrPoints(size_t start, size_t end, int thread_id)
+{
+	for (size_t i=start; i<=end; ++i) {
+		nbr_points[i] = PolygonPartition::NewNbrPoints(polys[i]);
+	}
+}
+
+void ContiguityEngine::SweepStrips(size_t strip_start, size_t strip_end,
+								   int thread_id)
+{
+	for (size_t s=strip_start; s<=strip_end; ++s) SweepStrip(s);
+}
+
+void ContiguityEngine::SweepStrip(int strip)
+{
+	using namespace Shapefile;
+	double sx_min = strip_x[strip];
+	double sx_max = strip_x[strip+1];
+	bool is_first = (strip == 0);
+	bool is_last = (strip+1 == (int) strip_pairs.size());
+	NbrPairs& pairs = strip_pairs[strip];
+	
+	// polygons overlapping this strip, local id -> record id.  The outer
+	// strips are open ended so that nothing outside the header bounding
+	// box is lost.
+	std::vector<long> recs;
+	for (long cnt= 0; cnt < num_recs; ++cnt) {
+		if ((is_last || polys[cnt]->box[0] <= sx_max) &&
+			(is_first || polys[cnt]->box[2] >= sx_min)) {
+			recs.push_back(cnt);
+		}
+	}
+	long n_recs = recs.size();
+	if (n_recs == 0) return;
+	
+	// partition constructed on lower(x) and upper(x) for each polygon
+	long gx= n_recs / 8 + 2;
+	BasePartition minX(n_recs, gx, sx_max - sx_min);
+	BasePartition maxX(n_recs, gx, sx_max - sx_min);
+	for (long cnt= 0; cnt < n_recs; ++cnt) {
+		minX.include( cnt, polys[recs[cnt]]->box[0] - sx_min );
+		maxX.include( cnt, polys[recs[cnt]]->box[2] - sx_min );
+	}
+	
+	// partition constructed on y for each polygon
+	PartitionM* Y = 0;
+	long gy= (int)(sqrt((long double)n_recs) + 2), total= 0;
+	do {
+		Y= new PartitionM(n_recs, gy, shp_y_len );
+		for (long cnt= 0; cnt < n_recs; ++cnt) {
+			PolygonContents* ply = polys[recs[cnt]];
+			Y->initIx( cnt, ply->box[1] - shp_min_y, ply->box[3] - shp_min_y );
+		}
+		total= Y->Sum();
+		if (total > n_recs * 8) {
+			delete Y;
+			gy = gy/2 + 1;
+			total= 0;
+		}
+	} while ( total == 0);
+	
+	GeoDaSet Neighbors(n_recs);
+	int curr;
+	for (int step= 0; step < minX.Cells(); ++step) {
 		// include all elements from xmin[step]
-		for (curr= gMinX.first(step); curr != GdaConst::EMPTY;
-				 curr= gMinX.tail(curr)) gY->include(curr);
+		for (curr= minX.first(step); curr != GdaConst::EMPTY;
+			 curr= minX.tail(curr)) Y->include(curr);
 		
 		// test each element in xmax[step]
-		for (curr= gMaxX.first(step); curr != GdaConst::EMPTY;
-				 curr= gMaxX.tail(curr))  {
-			PolygonContents* ply = dynamic_cast<PolygonContents*> (
-																														 main.records[curr].contents_p);
-			PolygonPartition testPoly(ply);
-			testPoly.MakePartition();
+		for (curr= maxX.first(step); curr != GdaConst::EMPTY;
+			 curr= maxX.tail(curr))  {
+			long curr_id = recs[curr];
+			PolygonContents* ply = polys[curr_id];
 			
 			// form a list of neighbors
-			for (int cell=gY->lowest(curr); cell <= gY->upmost(curr); ++cell) {
-				int potential = gY->first( cell );
+			for (int cell=Y->lowest(curr); cell <= Y->upmost(curr); ++cell) {
+				int potential = Y->first( cell );
 				while (potential != GdaConst::EMPTY) {
 					if (potential != curr) Neighbors.Push( potential );
-					potential = gY->tail(potential, cell);
+					potential = Y->tail(potential, cell);
 				}
 			}
 			
+			// the host partition is only built once a candidate passes the
+			// bounding box tests
+			PolygonPartition* testPoly = 0;
+			
 			// test each potential neighbor
 			for (int nbr = Neighbors.Pop(); nbr != GdaConst::EMPTY;
-					 nbr = Neighbors.Pop()) {
-				PolygonContents* nbr_ply = dynamic_cast<PolygonContents*> (
-																																	 main.records[nbr].contents_p);
-				if (ply->intersect(nbr_ply)) {
-					
-					PolygonPartition nbrPoly(nbr_ply);
-					//shp.seekg(gOffset[nbr]+12, ios::beg);
-					//nbrPoly.ReadShape(shp);
-					
-					if (curr == 0 && nbr == 0) {
-						
-					}
-					
-					// run sweep with testPoly as a host and nbrPoly as a guest
-					int related = testPoly.sweep(nbrPoly, is_queen,
-																			 precision_threshold);
-					if (related) Related.Push(nbr);
+				 nbr = Neighbors.Pop()) {
+				long nbr_id = recs[nbr];
+				PolygonContents* nbr_ply = polys[nbr_id];
+				double lo_x = std::max(ply->box[0], nbr_ply->box[0]);
+				if (StripOf(lo_x) != strip) continue;
+				if (!ply->intersect(nbr_ply)) continue;
+				
+				if (!testPoly) {
+					testPoly = new PolygonPartition(ply, nbr_points[curr_id]);
+					testPoly->MakePartition();
+				}
+				PolygonPartition nbrPoly(nbr_ply, nbr_points[nbr_id]);
+				// run sweep with testPoly as a host and nbrPoly as a guest
+				if (testPoly->sweep(nbrPoly, is_queen, precision_threshold)) {
+					pairs.push_back(std::make_pair(curr_id, nbr_id));
 				}
 			}
+			if (testPoly) delete testPoly;
 			
-			
-			if (size_t sz = Related.Size()) {
-				gl[curr].SetSizeNbrs(sz);
-				for (size_t i=0; i<sz; ++i) gl[curr].SetNbr(i, Related.Pop());
-			}
-			
-			gY->remove(curr);       // remove from the partition
+			Y->remove(curr);       // remove from the partition
 		}
 	}
+	delete Y;
+}
+
+GalElement* ContiguityEngine::Run()
+{
+	if (num_recs == 0) return new GalElement [ num_recs ];
 	
-	return gl;
+	GenUtils::RunThreaded(num_recs,
+		boost::bind(&ContiguityEngine::MakeNbrPoints, this, _1, _2, _3));
+	GenUtils::RunThreaded(strip_pairs.size(),
+		boost::bind(&ContiguityEngine::SweepStrips, this, _1, _2, _3),
+		strip_pairs.size());
+	
+	// every related pair was found once, so make the result symmetric
+	return PairsToGal(num_recs, strip_pairs);
 }
 
+/**
+ SharedContiguity
+ Builds queen or rook contiguity in one pass over the rings of all polygons
+ rather than sweeping pairs of polygons with overlapping bounding boxes.
+ For queen contiguity every vertex is inserted into a hash map, for rook
+ contiguity every edge in normalized (sorted endpoint) order, so polygons
+ sharing a vertex or an edge end up in the same bucket.  With a precision
+ threshold, vertices are hashed to grid cells at least as large as the
+ threshold and compared with the vertices of the adjacent cells; rook
+ contiguity then requires the ring neighbors of the matching vertices to
+ match as well, exactly as in PolygonPartition::sweep.
+ */
+class SharedContiguity {
+public:
+	SharedContiguity(Shapefile::Main& main, bool is_queen,
+					 double precision_threshold);
+	~SharedContiguity();
+	GalElement* Run();
+	
+private:
+	/** vertex pt (or edge from pt to pt+1) of polygon poly.  Entries of the
+	 same bucket are linked through next. */
+	struct Entry {
+		long poly;
+		int pt;
+		int next;
+	};
+	typedef std::pair<wxInt64, wxInt64> GridCell;
+	
+	template <class Key>
+	void Insert(boost::unordered_map<Key, int>& buckets, const Key& key,
+				long poly, int pt);
+	template <class Key>
+	void BucketPairs(const boost::unordered_map<Key, int>& buckets);
+	void HashVertices();
+	void HashEdges();
+	void HashGridCells();
+	void GridCellPairs();
+	bool Related(const Entry& e, const Entry& f);
+	GridCell CellOf(const Shapefile::Point& p) const;
+	
+	bool is_queen;
+	double precision_threshold;
+	double cell_size;
+	long num_recs;
+	std::vector<Shapefile::PolygonContents*> polys;
+	// ring neighbor tables, only needed for rook with a precision threshold
+	std::vector<int*> nbr_points;
+	std::vector<Entry> entries;
+	boost::unordered_map<GridCell, int> cells;
+	std::vector<NbrPairs> pairs;
+};
 
-void MakeFull(GalElement* W, size_t obs)
+SharedContiguity::SharedContiguity(Shapefile::Main& main, bool is_queen_,
+								   double precision_threshold_)
+: is_queen(is_queen_), precision_threshold(precision_threshold_),
+cell_size(precision_threshold_), pairs(1)
 {
-	using namespace std;
-	vector<set<long> > G(obs);
-	for (size_t i=0; i<obs; ++i) {
-		for (size_t j=0, sz=W[i].Size(); j<sz; ++j) {
-			G[i].insert(W[i][j]);
-			G[W[i][j]].insert(i);
-		}
+	using namespace Shapefile;
+	num_recs = main.records.size();
+	polys.resize(num_recs);
+	long num_pts = 0;
+	for (long cnt= 0; cnt < num_recs; ++cnt) {
+		polys[cnt] = dynamic_cast<PolygonContents*> (main.records[cnt].contents_p);
+		num_pts += polys[cnt]->num_points;
 	}
-	for (size_t i=0; i<obs; ++i) {
-		if (W[i].Size() == G[i].size()) continue;
-		W[i].SetSizeNbrs(G[i].size());
-		size_t cnt = 0;
-		for (set<long>::iterator it=G[i].begin(); it!=G[i].end(); ++it) {
-			W[i].SetNbr(cnt++, *it);
+	entries.reserve(num_pts);
+	
+	// grid cells may be larger than the threshold, but cell indices must
+	// stay well within the range of a 64-bit integer
+	double max_abs = std::max(std::max(fabs(main.header.bbox_x_min),
+									   fabs(main.header.bbox_x_max)),
+							  std::max(fabs(main.header.bbox_y_min),
+									   fabs(main.header.bbox_y_max)));
+	if (max_abs > cell_size * 1e15) cell_size = max_abs / 1e15;
+	
+	if (!is_queen && precision_threshold > 0) {
+		nbr_points.resize(num_recs);
+		for (long cnt= 0; cnt < num_recs; ++cnt) {
+			nbr_points[cnt] = PolygonPartition::NewNbrPoints(polys[cnt]);
 		}
-		W[i].SortNbrs();
 	}
 }
 
+SharedContiguity::~SharedContiguity()
+{
+	for (size_t i=0; i<nbr_points.size(); ++i) delete [] nbr_points[i];
+}
 
+SharedContiguity::GridCell
+SharedContiguity::CellOf(const Shapefile::Point& p) const
+{
+	return GridCell((wxInt64) floor(p.x / cell_size),
+					(wxInt64) floor(p.y / cell_size));
+}
 
-GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
-                    double precision_threshold)
+template <class Key>
+void SharedContiguity::Insert(boost::unordered_map<Key, int>& buckets,
+							  const Key& key, long poly, int pt)
 {
-	using namespace Shapefile;
-	
-	gRecords = main.records.size();
-	double shp_min_x = (double)main.header.bbox_x_min;
-	double shp_max_x = (double)main.header.bbox_x_max;
-	double shp_min_y = (double)main.header.bbox_y_min;
-	double shp_max_y = (double)main.header.bbox_y_max;
-	double shp_x_len = shp_max_x - shp_min_x;
-	double shp_y_len = shp_max_y - shp_min_y;
-	
-	long gx, gy, cnt, total=0;
-	gx= gRecords / 8 + 2;
-	
-	gMinX.alloc(gRecords, gx, shp_x_len );
-	gMaxX.alloc(gRecords, gx, shp_x_len );
-	
-	for (cnt= 0; cnt < gRecords; ++cnt) {
-		PolygonContents* ply = dynamic_cast<PolygonContents*> (
-																					main.records[cnt].contents_p);
-		
-		gMinX.include( cnt, ply->box[0] - shp_min_x );
-		gMaxX.include( cnt, ply->box[2] - shp_min_x );
+	Entry e;
+	e.poly = poly;
+	e.pt = pt;
+	e.next = -1;
+	typename boost::unordered_map<Key, int>::iterator it = buckets.find(key);
+	if (it == buckets.end()) {
+		buckets[key] = entries.size();
+	} else {
+		// exact keys of the same polygon carry no extra information
+		if (entries[it->second].poly == poly) return;
+		e.next = it->second;
+		it->second = entries.size();
 	}
-	
-	gy= (int)(sqrt((long double)gRecords) + 2);
-	do {
-		gY= new PartitionM(gRecords, gy, shp_y_len );
-		for (cnt= 0; cnt < gRecords; ++cnt) {
-			PolygonContents* ply = dynamic_cast<PolygonContents*> (
-																				main.records[cnt].contents_p);
-			gY->initIx( cnt, ply->box[1] - shp_min_y, ply->box[3] - shp_min_y );
-		}
-		total= gY->Sum();
-		if (total > gRecords * 8) {
-			delete gY;
-			gy = gy/2 + 1;
-			total= 0;
+	entries.push_back(e);
+}
+
+template <class Key>
+void SharedContiguity::BucketPairs(const boost::unordered_map<Key, int>& buckets)
+{
+	typename boost::unordered_map<Key, int>::const_iterator it;
+	for (it = buckets.begin(); it != buckets.end(); ++it) {
+		for (int e = it->second; e != -1; e = entries[e].next) {
+			for (int f = entries[e].next; f != -1; f = entries[f].next) {
+				if (entries[e].poly != entries[f].poly) {
+					pairs[0].push_back(std::make_pair(entries[e].poly,
+													  entries[f].poly));
+				}
+			}
 		}
-	} while ( total == 0);
-	
-	GalElement * gl= MakeContiguity(main, is_queen, precision_threshold);
-	
-	if (gY) delete gY; gY = 0;
-	if (gOffset) delete [] gOffset; gOffset = 0;
-	if (gBox) delete [] gBox; gBox = 0;
-	
-	MakeFull(gl, gRecords);
-	return gl;
+	}
 }
 
+void SharedContiguity::HashVertices()
+{
+	boost::unordered_map<Shapefile::Point, int> buckets(entries.capacity());
+	for (long cnt= 0; cnt < num_recs; ++cnt) {
+		const std::vector<Shapefile::Point>& pts = polys[cnt]->points;
+		for (int i=0, sz=pts.size(); i<sz; ++i) {
+			Insert(buckets, pts[i], cnt, i);
+		}
+	}
+	BucketPairs(buckets);
+}
 
+void SharedContiguity::HashEdges()
+{
+	boost::unordered_map<Shapefile::Edge, int> buckets(entries.capacity());
+	for (long cnt= 0; cnt < num_recs; ++cnt) {
+		Shapefile::PolygonContents* ply = polys[cnt];
+		for (int part= 0; part < ply->num_parts; ++part) {
+			int first = ply->parts[part];
+			int last = (part+1 == ply->num_parts) ? ply->num_points :
+				(int) ply->parts[part+1];
+			// note that endpoints are repeated in Shapefiles
+			for (int i=first; i<last-1; ++i) {
+				if (ply->points[i] == ply->points[i+1]) continue;
+				Insert(buckets, Shapefile::Edge(ply->points[i],
+												ply->points[i+1]), cnt, i);
+			}
+		}
+	}
+	BucketPairs(buckets);
+}
 
+void SharedContiguity::HashGridCells()
+{
+	cells.rehash(entries.capacity());
+	for (long cnt= 0; cnt < num_recs; ++cnt) {
+		const std::vector<Shapefile::Point>& pts = polys[cnt]->points;
+		for (int i=0, sz=pts.size(); i<sz; ++i) {
+			// every vertex is kept: a polygon can have several vertices in
+			// the same cell and only some of them may match
+			Entry e;
+			e.poly = cnt;
+			e.pt = i;
+			GridCell c = CellOf(pts[i]);
+			boost::unordered_map<GridCell, int>::iterator it = cells.find(c);
+			e.next = (it == cells.end()) ? -1 : it->second;
+			cells[c] = entries.size();
+			entries.push_back(e);
+		}
+	}
+}
 
+bool SharedContiguity::Related(const Entry& e, const Entry& f)
+{
+	if (e.poly == f.poly) return false;
+	Shapefile::Point& p = polys[e.poly]->points[e.pt];
+	if (!p.equals(polys[f.poly]->points[f.pt], precision_threshold)) {
+		return false;
+	}
+	if (is_queen) return true;
+	PolygonPartition host(polys[e.poly], nbr_points[e.poly]);
+	PolygonPartition guest(polys[f.poly], nbr_points[f.poly]);
+	return host.edge(guest, e.pt, f.pt, precision_threshold);
+}
 
+void SharedContiguity::GridCellPairs()
+{
+	// each cell is compared with itself and four of its eight neighbors,
+	// so every pair of adjacent cells is visited once
+	const int dx[] = { 0, 1, 1, 1, 0 };
+	const int dy[] = { 0, -1, 0, 1, 1 };
+	boost::unordered_map<GridCell, int>::const_iterator it, nb;
+	for (it = cells.begin(); it != cells.end(); ++it) {
+		for (int k=0; k<5; ++k) {
+			int nb_head = it->second;
+			if (k > 0) {
+				nb = cells.find(GridCell(it->first.first + dx[k],
+										 it->first.second + dy[k]));
+				if (nb == cells.end()) continue;
+				nb_head = nb->second;
+			}
+			for (int e = it->second; e != -1; e = entries[e].next) {
+				int f = (k == 0) ? entries[e].next : nb_head;
+				for (; f != -1; f = entries[f].next) {
+					if (Related(entries[e], entries[f])) {
+						pairs[0].push_back(std::make_pair(entries[e].poly,
+														  entries[f].poly));
+					}
+				}
+			}
+		}
+	}
+}
 
+GalElement* SharedContiguity::Run()
+{
+	if (precision_threshold > 0) {
+		HashGridCells();
+		GridCellPairs();
+	} else if (is_queen) {
+		HashVertices();
+	} else {
+		HashEdges();
+	}
+	return PairsToGal(num_recs, pairs);
+}
 
+GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
+                    double precision_threshold)
+{
+	wxStopWatch sw;
+	ContiguityEngine engine(main, is_queen, precision_threshold);
+	GalElement* gl = engine.Run();
+	LOG_MSG(wxString::Format("%s contiguity for %d polygons took %ld ms",
+							 is_queen ? "Queen" : "Rook",
+							 (int) main.records.size(), sw.Time()));
+	return gl;
+}
 
+GalElement* PolysToContigWeightsHash(Shapefile::Main& main, bool is_queen,
+									 double precision_threshold)
+{
+	wxStopWatch sw;
+	SharedContiguity builder(main, is_queen, precision_threshold);
+	GalElement* gl = builder.Run();
+	LOG_MSG(wxString::Format("%s contiguity (shared %s hashing) for %d "
+							 "polygons took %ld ms",
+							 is_queen ? "Queen" : "Rook",
+							 is_queen ? "vertex" : "edge",
+							 (int) main.records.size(), sw.Time()));
+	return gl;
+}
@@ -31,5 +31,13 @@ GalElement* PolysToContigWeights(Shapefile::Main& main,
 																 bool is_queen,
 																 double precision_threshold=0.0);
 
+/** Same result as PolysToContigWeights, but built in a single pass that
+ hashes shared vertices (queen) or shared edges (rook) instead of sweeping
+ pairs of polygons with overlapping bounding boxes.  Usually faster for
+ large maps with many vertices per polygon. */
+GalElement* PolysToContigWeightsHash(Shapefile::Main& main,
+									 bool is_queen,
+									 double precision_threshold=0.0);
+
 
 #endif
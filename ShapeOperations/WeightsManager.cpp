@@ -116,6 +116,9 @@ bool WeightsNewManager::AssociateGal(boost::uuids::uuid w_uuid, GalWeight* gw)
 		delete it->second.gal_weight; it->second.gal_weight = 0;
 	}
 	it->second.gal_weight = gw;
+	// the spectrum belongs to the old weights
+	it->second.eigenvalues.clear();
+	it->second.eig_read = false;
 	if (w_man_state) w_man_state->notifyObservers();
 	return true;
 }
@@ -258,16 +261,17 @@ bool WeightsNewManager::Lag(boost::uuids::uuid w_uuid, const GdaFlexValue& data,
 	if (!gw || !gw->gal || !(gw->num_obs = data.GetObs())) {
 		return false;
 	}
-	GalElement* W = gw->gal;
+	const CsrWeight& W = gw->GetCsr();
 	const std::valarray<double>& x = data.GetConstValArrayRef();
 	result.SetSize(data.GetObs(), data.GetTms());
 	std::valarray<double>& y = result.GetValArrayRef();
 	for (size_t t=0, tms=data.GetTms(); t<tms; ++t) {
 		for (size_t i=0, obs=data.GetObs(); i<obs; ++i) {
 			double s = 0;
-			size_t nbrs = W[i].Size();
+			size_t nbrs = W.Size(i);
+			const long* nbr = W.Nbrs(i);
 			for (size_t n=0; n<nbrs; ++n) {
-				s += x[W[i][n]*tms+t];
+				s += x[nbr[n]*tms+t];
 			}
 			y[i*tms+t] = s / ((double) nbrs);
 		}
@@ -377,6 +381,55 @@ GalWeight* WeightsNewManager::GetGal(boost::uuids::uuid w_uuid)
 	return e.gal_weight;
 }
 
+const CsrWeight* WeightsNewManager::GetCsr(boost::uuids::uuid w_uuid)
+{
+	GalWeight* gw = GetGal(w_uuid);
+	if (!gw || !gw->gal) return 0;
+	return &gw->GetCsr();
+}
+
+uint64_t WeightsNewManager::EigenvaluesKey(boost::uuids::uuid w_uuid)
+{
+	const CsrWeight* w = GetCsr(w_uuid);
+	if (!w) return 0;
+	uint64_t w_hash = w->Hash();
+	uint64_t h = Gda::HashBytes("Eigenvalues", 11);
+	return Gda::HashBytes(&w_hash, sizeof(w_hash), h);
+}
+
+std::vector<double>* WeightsNewManager::GetEigenvalues(boost::uuids::uuid w_uuid)
+{
+	EmType::iterator it = entry_map.find(w_uuid);
+	if (it == entry_map.end()) return 0;
+	Entry& e = it->second;
+	if (e.eigenvalues.empty() && !e.eig_read) {
+		e.eig_read = true;
+		uint64_t key = EigenvaluesKey(w_uuid);
+		Gda::ResultCache cache(key ? e.wpte.wmi.filename : wxString(), key);
+		uint64_t n = 0;
+		if (cache.Load() && cache.Get(&n, sizeof(n)) && n > 0) {
+			e.eigenvalues.resize(n);
+			if (!cache.Get(&e.eigenvalues[0], n*sizeof(double))) {
+				e.eigenvalues.clear();
+			}
+		}
+	}
+	return &e.eigenvalues;
+}
+
+void WeightsNewManager::SaveEigenvalues(boost::uuids::uuid w_uuid)
+{
+	EmType::iterator it = entry_map.find(w_uuid);
+	if (it == entry_map.end() || it->second.eigenvalues.empty()) return;
+	Entry& e = it->second;
+	uint64_t key = EigenvaluesKey(w_uuid);
+	Gda::ResultCache cache(key ? e.wpte.wmi.filename : wxString(), key);
+	uint64_t n = e.eigenvalues.size();
+	cache.Put(&n, sizeof(n));
+	cache.Put(&e.eigenvalues[0], n*sizeof(double));
+	if (!cache.Save()) LOG_MSG("Could not save the eigenvalues of the weights");
+}
+
 GeoDaWeight* WeightsNewManager::GetWeights(boost::uuids::uuid w_uuid)
 {
 	EmType::iterator it = entry_map.find(w_uuid);
@@ -23,6 +23,7 @@
 #include <list>
 #include <map>
 #include <vector>
+#include <stdint.h>
 #include "WeightsManPtree.h"
 #include "../VarCalc/WeightsManInterface.h"
 class GeoDaWeight;
@@ -70,6 +71,9 @@ public:
 	virtual void Remove(boost::uuids::uuid w_uuid);
 	virtual wxString RecNumToId(boost::uuids::uuid w_uuid, long rec_num);
 	virtual GalWeight* GetGal(boost::uuids::uuid w_uuid);
+	virtual const CsrWeight* GetCsr(boost::uuids::uuid w_uuid);
+	virtual std::vector<double>* GetEigenvalues(boost::uuids::uuid w_uuid);
+	virtual void SaveEigenvalues(boost::uuids::uuid w_uuid);
 	virtual GeoDaWeight* GetWeights(boost::uuids::uuid w_uuid);
 	virtual boost::uuids::uuid GetDefault() const;
 	virtual void MakeDefault(boost::uuids::uuid w_uuid);
@@ -81,12 +85,15 @@ public:
 	
 private:
 	struct Entry {
-		Entry() : gal_weight(0), geoda_weight(0) {}
-		Entry(const WeightsPtreeEntry& e) : gal_weight(0), geoda_weight(0), wpte(e) {}
+		Entry() : gal_weight(0), geoda_weight(0), eig_read(false) {}
+		Entry(const WeightsPtreeEntry& e) : gal_weight(0), geoda_weight(0),
+			eig_read(false), wpte(e) {}
 		WeightsPtreeEntry wpte;
 		GalWeight* gal_weight;
         GeoDaWeight* geoda_weight;
 		std::vector<wxString> rec_num_to_id;
+		std::vector<double> eigenvalues; // see GetEigenvalues
+		bool eig_read; // true once the saved eigenvalues were looked for
 	};
 	typedef std::map<boost::uuids::uuid, Entry> EmType;
 	typedef EmType::const_iterator EmTypeCItr;
@@ -95,6 +102,8 @@ private:
 	std::list<boost::uuids::uuid> uuid_order;
 	
 	boost::uuids::uuid FindUuid(const WeightsMetaInfo& wmi) const;
+	/** Gda::ResultCache key of the eigenvalues of the weights. */
+	uint64_t EigenvaluesKey(boost::uuids::uuid w_uuid);
 	GalElement* GetGalElemArray(boost::uuids::uuid w_uuid);
 	bool InitRecNumToIdMap(boost::uuids::uuid w_uuid);
 	TableInterface* table_int;
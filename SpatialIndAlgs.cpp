@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/random.hpp>
 #include <boost/random/uniform_01.hpp>
@@ -28,6 +29,7 @@
 #include "ShpFile.h"
 #include "PointSetAlgs.h"
 #include "GenGeomAlgs.h"
+#include "GenUtils.h"
 #include "SpatialIndAlgs.h"
 #include "VarCalc/NumericTests.h"
 #include "logger.h"
@@ -366,28 +368,21 @@ GwtWeight* SpatialIndAlgs::knn_build(const std::vector<double>& x, const std::ve
 	return gwt;
 }
 
-GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_2d_t& rtree, int nn)
+/** Fill in the kNN GwtElements for query points pts[obs_start..obs_end].
+ Each worker reuses a single query buffer and writes directly into its own
+ disjoint slice of the preallocated gwt array. */
+static void knn_build_range_2d(const rtree_pt_2d_t* rtree,
+							const std::vector<pt_2d_val>* pts,
+							int k, GwtElement* gwt,
+							size_t obs_start, size_t obs_end, int thread_id)
 {
-	wxStopWatch sw;
-	using namespace std;
-
-	GwtWeight* Wp = new GwtWeight;
-	Wp->num_obs = rtree.size();
-	Wp->is_symmetric = false;
-	Wp->symmetry_checked = true;
-	Wp->gwt = new GwtElement[Wp->num_obs];
-	
-	int cnt=0;
-	const int k=nn+1;
-	for (rtree_pt_2d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_2d_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_2d_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
+	std::vector<pt_2d_val> q;
+	q.reserve(k);
+	for (size_t i=obs_start; i<=obs_end; ++i) {
+		const pt_2d_val& v = (*pts)[i];
+		q.clear();
+		rtree->query(bgi::nearest(v.first, k), std::back_inserter(q));
+		GwtElement& e = gwt[v.second];
 		e.alloc(q.size());
 		BOOST_FOREACH(pt_2d_val const& w, q) {
 			if (w.second == v.second) continue;
@@ -395,24 +390,14 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_2d_t& rtree, int nn)
 			neigh.nbx = w.second;
 			neigh.weight = bg::distance(v.first, w.first);
 			e.Push(neigh);
-			++cnt;
 		}
 	}
-
-	stringstream ss;
-	ss << "Time to create " << nn << "-NN GwtWeight "
-	   << "with " << cnt << " total neighbors in ms : "
-	   << sw.Time();
-	LOG_MSG(ss.str());
-	return Wp;
 }
 
-GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_3d_t& rtree, int nn,
-					 bool is_arc, bool is_mi)
+GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_2d_t& rtree, int nn)
 {
 	wxStopWatch sw;
 	using namespace std;
-	using namespace GenGeomAlgs;
 
 	GwtWeight* Wp = new GwtWeight;
 	Wp->num_obs = rtree.size();
@@ -420,17 +405,38 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_3d_t& rtree, int nn,
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
+	vector<pt_2d_val> pts;
+	pts.reserve(rtree.size());
+	rtree.query(bgi::intersects(rtree.bounds()), back_inserter(pts));
+	
 	const int k=nn+1;
-	for (rtree_pt_3d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_3d_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_3d_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
+	GenUtils::RunThreaded(pts.size(), boost::bind(knn_build_range_2d, &rtree, &pts, k,
+										 Wp->gwt, _1, _2, _3));
+	size_t cnt=0;
+	for (size_t i=0; i<Wp->num_obs; ++i) cnt += Wp->gwt[i].Size();
+
+	stringstream ss;
+	ss << "Time to create " << nn << "-NN GwtWeight "
+	   << "with " << cnt << " total neighbors in ms : "
+	   << sw.Time();
+	LOG_MSG(ss.str());
+	return Wp;
+}
+
+static void knn_build_range_3d(const rtree_pt_3d_t* rtree,
+							const std::vector<pt_3d_val>* pts,
+							int k, bool is_arc, bool is_mi,
+							GwtElement* gwt,
+							size_t obs_start, size_t obs_end, int thread_id)
+{
+	using namespace GenGeomAlgs;
+	std::vector<pt_3d_val> q;
+	q.reserve(k);
+	for (size_t i=obs_start; i<=obs_end; ++i) {
+		const pt_3d_val& v = (*pts)[i];
+		q.clear();
+		rtree->query(bgi::nearest(v.first, k), std::back_inserter(q));
+		GwtElement& e = gwt[v.second];
 		e.alloc(q.size());
 		double lon_v, lat_v;
 		double x_v, y_v;
@@ -460,9 +466,31 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_3d_t& rtree, int nn,
 											  bg::get<0>(w.first), bg::get<1>(w.first));
 			}
 			e.Push(neigh);
-			++cnt;
 		}
 	}
+}
+
+GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_3d_t& rtree, int nn,
+					 bool is_arc, bool is_mi)
+{
+	wxStopWatch sw;
+	using namespace std;
+
+	GwtWeight* Wp = new GwtWeight;
+	Wp->num_obs = rtree.size();
+	Wp->is_symmetric = false;
+	Wp->symmetry_checked = true;
+	Wp->gwt = new GwtElement[Wp->num_obs];
+	
+	vector<pt_3d_val> pts;
+	pts.reserve(rtree.size());
+	rtree.query(bgi::intersects(rtree.bounds()), back_inserter(pts));
+	
+	const int k=nn+1;
+	GenUtils::RunThreaded(pts.size(), boost::bind(knn_build_range_3d, &rtree, &pts, k,
+										 is_arc, is_mi, Wp->gwt, _1, _2, _3));
+	size_t cnt=0;
+	for (size_t i=0; i<Wp->num_obs; ++i) cnt += Wp->gwt[i].Size();
 
 	stringstream ss;
 	ss << "Time to create 3D " << (is_arc ? " arc " : "")
@@ -724,6 +752,39 @@ GwtWeight* SpatialIndAlgs::thresh_build(const std::vector<double>& x,
 	return gwt;
 }
 
+/** Threshold query for pts[obs_start..obs_end].  The distance to each
+ candidate is computed once, and neighbors are collected in a contiguous
+ per-thread buffer and copied directly into gwt. */
+static void thresh_build_range_2d(const rtree_pt_2d_t* rtree,
+								  const std::vector<pt_2d_val>* pts,
+								  double th, GwtElement* gwt,
+								  size_t obs_start, size_t obs_end)
+{
+	std::vector<pt_2d_val> q;
+	std::vector<GwtNeighbor> l;
+	for (size_t i=obs_start; i<=obs_end; ++i) {
+		const pt_2d_val& v = (*pts)[i];
+		double x = v.first.get<0>();
+		double y = v.first.get<1>();
+		box_2d b(pt_2d(x-th, y-th), pt_2d(x+th, y+th));
+		q.clear();
+		rtree->query(bgi::intersects(b), std::back_inserter(q));
+		l.clear();
+		BOOST_FOREACH(pt_2d_val const& w, q) {
+			if (w.second == v.second) continue;
+			double d = bg::distance(v.first, w.first);
+			if (d <= th) l.push_back(GwtNeighbor(w.second, d));
+		}
+		GwtElement& e = gwt[v.second];
+		e.alloc(l.size());
+		// neighbors were historically listed in reverse query order
+		for (std::vector<GwtNeighbor>::reverse_iterator it = l.rbegin();
+			 it != l.rend(); ++it) {
+			e.Push(*it);
+		}
+	}
+}
+
 GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_2d_t& rtree, double th)
 {
 	wxStopWatch sw;
@@ -735,38 +796,14 @@ GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_2d_t& rtree, double th)
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
-	for (rtree_pt_2d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_2d_val& v = *it;
-		double x = v.first.get<0>();
-		double y = v.first.get<1>();
-		box_2d b(pt_2d(x-th, y-th), pt_2d(x+th, y+th));
-		size_t obs = v.second;		
-		vector<pt_2d_val> q;
-		rtree.query(bgi::intersects(b), std::back_inserter(q));
-		size_t lcnt = 0;
-		list<pt_2d_val> l;
-		BOOST_FOREACH(pt_2d_val const& w, q) {
-			if (w.second != v.second &&
-				bg::distance(v.first, w.first) <= th)
-			{
-				l.push_front(w);
-				++lcnt;
-			}
-		}
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(lcnt);
-		BOOST_FOREACH(pt_2d_val const& w, l) {
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			neigh.weight = bg::distance(v.first, w.first);
-			e.Push(neigh);
-			++cnt;
-		}
-	}
+	vector<pt_2d_val> pts;
+	pts.reserve(rtree.size());
+	rtree.query(bgi::intersects(rtree.bounds()), back_inserter(pts));
+	
+	GenUtils::RunThreaded(pts.size(), boost::bind(thresh_build_range_2d, &rtree, &pts,
+										 th, Wp->gwt, _1, _2));
+	size_t cnt=0;
+	for (size_t i=0; i<Wp->num_obs; ++i) cnt += Wp->gwt[i].Size();
 
 	stringstream ss;
 	ss << "Time to create " << th << " threshold GwtWeight,"
@@ -815,9 +852,53 @@ double SpatialIndAlgs::est_avg_num_neigh_thresh(const rtree_pt_3d_t& rtree,
 	return avg;
 }
 
+static void thresh_build_range_3d(const rtree_pt_3d_t* rtree,
+								  const std::vector<pt_3d_val>* pts,
+								  double th, bool is_mi, GwtElement* gwt,
+								  size_t obs_start, size_t obs_end)
+{
+	using namespace GenGeomAlgs;
+	std::vector<pt_3d_val> q;
+	std::vector<GwtNeighbor> l;
+	for (size_t i=obs_start; i<=obs_end; ++i) {
+		const pt_3d_val& v = (*pts)[i];
+		double vx = v.first.get<0>();
+		double vy = v.first.get<1>();
+		double vz = v.first.get<2>();
+		double lon_v, lat_v;
+		UnitToLongLatDeg(vx, vy, vz, lon_v, lat_v);
+		box_3d b(pt_3d(vx-th, vy-th, vz-th), pt_3d(vx+th, vy+th, vz+th));
+		q.clear();
+		rtree->query(bgi::intersects(b), std::back_inserter(q));
+		l.clear();
+		BOOST_FOREACH(pt_3d_val const& w, q) {
+			if (w.second == v.second) continue;
+			if (bg::distance(v.first, w.first) > th) continue;
+			double lon_w, lat_w;
+			UnitToLongLatDeg(w.first.get<0>(), w.first.get<1>(),
+							 w.first.get<2>(), lon_w, lat_w);
+			double d;
+			if (is_mi) {
+				d = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
+			} else {
+				d = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
+			}
+			l.push_back(GwtNeighbor(w.second, d));
+		}
+		GwtElement& e = gwt[v.second];
+		e.alloc(l.size());
+		// neighbors were historically listed in reverse query order
+		for (std::vector<GwtNeighbor>::reverse_iterator it = l.rbegin();
+			 it != l.rend(); ++it) {
+			e.Push(*it);
+		}
+	}
+}
+
 /** threshold th is the radius of intersection sphere with
   respect to the unit shpere of the 3d point rtree */
-GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_3d_t& rtree, double th, bool is_mi)
+GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_3d_t& rtree, double th,
+										bool is_mi)
 {
 	wxStopWatch sw;
 	using namespace std;
@@ -840,52 +921,15 @@ GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_3d_t& rtree, double th, b
 		ss << "Input th (earth mi): " << EarthRadToMi(r);	
 		LOG_MSG(ss.str());
 	}
-	int cnt=0;
-	for (rtree_pt_3d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_3d_val& v = *it;
-		double vx = v.first.get<0>();
-		double vy = v.first.get<1>();
-		double vz = v.first.get<2>();
-		double lon_v, lat_v;
-		UnitToLongLatDeg(vx, vy, vz, lon_v, lat_v);
-		box_3d b(pt_3d(vx-th, vy-th, vz-th), pt_3d(vx+th, vy+th, vz+th));
-		size_t obs = v.second;
-		vector<pt_3d_val> q;
-		rtree.query(bgi::intersects(b), std::back_inserter(q));
-		size_t lcnt = 0;
-		list<pt_3d_val> l;
-		BOOST_FOREACH(pt_3d_val const& w, q) {
-			if (w.second != v.second &&
-				bg::distance(v.first, w.first) <= th)
-			{
-				l.push_front(w);
-				++lcnt;
-			}
-		}
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(lcnt);
-		BOOST_FOREACH(pt_3d_val const& w, l) {
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			double wx = w.first.get<0>();
-			double wy = w.first.get<1>();
-			double wz = w.first.get<2>();
-			double lon_w, lat_w;
-			double d;
-			UnitToLongLatDeg(wx, wy, wz, lon_w, lat_w);
-			if (is_mi) {
-				d = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
-			} else {
-				d = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
-			}
-			neigh.weight = d;
-			e.Push(neigh);
-			++cnt;
-		}
-	}
+	
+	vector<pt_3d_val> pts;
+	pts.reserve(rtree.size());
+	rtree.query(bgi::intersects(rtree.bounds()), back_inserter(pts));
+	
+	GenUtils::RunThreaded(pts.size(), boost::bind(thresh_build_range_3d, &rtree, &pts,
+										 th, is_mi, Wp->gwt, _1, _2));
+	size_t cnt=0;
+	for (size_t i=0; i<Wp->num_obs; ++i) cnt += Wp->gwt[i].Size();
 
 	stringstream ss;
 	ss << "Time to create arc " << th << " threshold GwtWeight,"
@@ -1025,6 +1069,29 @@ void SpatialIndAlgs::get_pt_rtree_stats(const rtree_pt_3d_t& rtree,
 	LOG_MSG(ss.str());
 }
 
+static void knn_build_range_ll(const rtree_pt_lonlat_t* rtree,
+							const std::vector<pt_lonlat_val>* pts,
+							int k, GwtElement* gwt,
+							size_t obs_start, size_t obs_end, int thread_id)
+{
+	std::vector<pt_lonlat_val> q;
+	q.reserve(k);
+	for (size_t i=obs_start; i<=obs_end; ++i) {
+		const pt_lonlat_val& v = (*pts)[i];
+		q.clear();
+		rtree->query(bgi::nearest(v.first, k), std::back_inserter(q));
+		GwtElement& e = gwt[v.second];
+		e.alloc(q.size());
+		BOOST_FOREACH(const pt_lonlat_val& w, q) {
+			if (w.second == v.second) continue;
+			GwtNeighbor neigh;
+			neigh.nbx = w.second;
+			neigh.weight = bg::distance(v.first, w.first);
+			e.Push(neigh);
+		}
+	}
+}
+
 GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_lonlat_t& rtree, int nn)
 {
 	wxStopWatch sw;
@@ -1036,27 +1103,15 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_lonlat_t& rtree, int nn)
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
+	vector<pt_lonlat_val> pts;
+	pts.reserve(rtree.size());
+	rtree.query(bgi::intersects(rtree.bounds()), back_inserter(pts));
+	
 	const int k=nn+1;
-	for (rtree_pt_lonlat_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_lonlat_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_lonlat_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(q.size());
-		BOOST_FOREACH(const pt_lonlat_val& w, q) {
-			if (w.second == v.second) continue;
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			neigh.weight = bg::distance(v.first, w.first);
-			e.Push(neigh);
-			++cnt;
-		}
-	}
+	GenUtils::RunThreaded(pts.size(), boost::bind(knn_build_range_ll, &rtree, &pts, k,
+										 Wp->gwt, _1, _2, _3));
+	size_t cnt=0;
+	for (size_t i=0; i<Wp->num_obs; ++i) cnt += Wp->gwt[i].Size();
 
 	stringstream ss;
 	ss << "Time to create " << nn << "-NN arc-distance GwtWeight "
@@ -52,7 +52,9 @@ void knn_query(const rtree_pt_2d_t& rtree, int nn=6);
  build the correct type of rtree automatically.  If is_arc false,
  then Euclidean distance is used and x, y are normal coordinates and
  is_mi ignored.  If is_arc is true, then arc distances are used and distances
- reported in either kms or miles according to is_mi. */
+ reported in either kms or miles according to is_mi.  Neighbor queries
+ are spread across all available cores with GenUtils::RunThreaded and the
+ result is identical to a single-threaded build. */
 GwtWeight* knn_build(const std::vector<double>& x,
 										 const std::vector<double>& y,
 										 int nn, bool is_arc, bool is_mi);
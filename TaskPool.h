@@ -0,0 +1,40 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_TASK_POOL_H__
+#define __GEODA_CENTER_TASK_POOL_H__
+
+#include <stddef.h>
+
+/** The plain function pointer interface of the shared task pool.  It does
+ not include any boost or wx headers, so that code such as the f2c based
+ regression routines, whose typedefs clash with the boost headers, can use
+ the pool.  The boost::function interface is declared in GenUtils.h. */
+namespace GenUtils {
+	typedef void (*TaskRangeFn)(void* ctx, size_t first, size_t last,
+								int worker_id);
+	typedef bool (*TaskProgressFn)(void* ctx, size_t done, size_t total);
+	/** GenUtils::RunTasks with work(ctx, first, last, worker_id) and, if
+	 progress is not null, progress(ctx, done, total) in place of the
+	 boost::function arguments. */
+	bool RunTasks(size_t ntasks, TaskRangeFn work, TaskProgressFn progress,
+				  void* ctx, size_t grain);
+}
+
+#endif
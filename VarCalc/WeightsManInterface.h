@@ -29,6 +29,7 @@
 #include "GdaFlexValue.h"
 class GalWeight;
 class GeoDaWeight;
+class CsrWeight;
 class ProgressDlg;
 
 
@@ -62,6 +63,18 @@ public:
 	virtual void Remove(boost::uuids::uuid w_uuid) = 0;
 	virtual wxString RecNumToId(boost::uuids::uuid w_uuid, long rec_num) = 0;
 	virtual GalWeight* GetGal(boost::uuids::uuid w_uuid) = 0;
+	/** CSR form of the weights returned by GetGal, or 0 if not loaded. */
+	virtual const CsrWeight* GetCsr(boost::uuids::uuid w_uuid) = 0;
+	/** Eigenvalues of the symmetrized weights kept for the ML spatial
+	 regressions, see TraceApprox::eigenvalues.  Empty until a regression
+	 fills them in or they are read back from a file saved by
+	 SaveEigenvalues.  Cleared when the weights change.  Returns 0 if the
+	 weights are unknown. */
+	virtual std::vector<double>* GetEigenvalues(boost::uuids::uuid w_uuid) = 0;
+	/** Saves the eigenvalues of GetEigenvalues in the directory
+	 <weights file name>.cache beside the weights file, under a key hashed
+	 from the weights, for later sessions. */
+	virtual void SaveEigenvalues(boost::uuids::uuid w_uuid) = 0;
     virtual GeoDaWeight* GetWeights(boost::uuids::uuid w_uuid) = 0;
 	virtual boost::uuids::uuid GetDefault() const = 0;
 	virtual void MakeDefault(boost::uuids::uuid w_uuid) = 0;